@@ -20,6 +20,9 @@
 #include "ipv4-dsr-routing-helper.h"
 #include "ns3/dsr-router-interface.h"
 #include "ns3/ipv4-dsr-routing.h"
+#include "ns3/dsr-decision-trace.h"
+#include "ns3/dsr-route-manager.h"
+#include "ns3/dsr-routing-snapshot.h"
 #include "ns3/ipv4-list-routing.h"
 #include "ns3/log.h"
 
@@ -63,6 +66,19 @@ Ipv4DSRRoutingHelper::PopulateRoutingTables (void)
   DSRRouteManager::BuildDSRRoutingDatabase ();
   DSRRouteManager::InitializeRoutes ();
 }
+void
+Ipv4DSRRoutingHelper::PopulateRoutingTables (std::string snapshot)
+{
+  NS_LOG_FUNCTION (snapshot);
+  DSRRouteManager::BuildDSRRoutingDatabase ();
+  uint64_t lsdbHash = DSRRouteManager::GetLsdbHash ();
+  if (DsrRoutingSnapshot::Load (snapshot, lsdbHash))
+    {
+      return;
+    }
+  DSRRouteManager::InitializeRoutes ();
+  DsrRoutingSnapshot::Save (snapshot, lsdbHash);
+}
 void 
 Ipv4DSRRoutingHelper::RecomputeRoutingTables (void)
 {
@@ -71,5 +87,11 @@ Ipv4DSRRoutingHelper::RecomputeRoutingTables (void)
   DSRRouteManager::InitializeRoutes ();
 }
 
+void
+Ipv4DSRRoutingHelper::EnableDecisionTrace (std::string filename, uint32_t capacity)
+{
+  DsrDecisionTrace::Enable (filename, capacity);
+}
+
 
 } // namespace ns3
@@ -20,6 +20,7 @@
 #ifndef IPV4_DSR_ROUTING_HELPER_H
 #define IPV4_DSR_ROUTING_HELPER_H
 
+#include <string>
 #include "ns3/node-container.h"
 #include "ns3/ipv4-routing-helper.h"
 
@@ -71,6 +72,19 @@ public:
    *
    */
   static void PopulateRoutingTables (void);
+  /**
+   * \brief Populate the routing tables from a snapshot file, or compute
+   * them and save them to it.
+   *
+   * The routing database is always built; if the snapshot was saved for
+   * the same database, its routes are installed instead of being computed
+   * again.  Otherwise the routes are computed as by PopulateRoutingTables ()
+   * and the snapshot is written, so that the following runs of a parameter
+   * sweep over the same topology start right away.
+   *
+   * \param snapshot the snapshot file
+   */
+  static void PopulateRoutingTables (std::string snapshot);
   /**
    * \brief Remove all routes that were previously installed in a prior call
    * to either PopulateRoutingTables() or RecomputeRoutingTables(), and 
@@ -84,6 +98,19 @@ public:
    *
    */
   static void RecomputeRoutingTables (void);
+
+  /**
+   * \brief Record the routing decisions of flagged DSR packets in a binary
+   * trace file.
+   *
+   * The file is written whenever \p capacity records have been buffered and
+   * when the simulation is destroyed.  Decode it with the
+   * dsr-decision-trace-decode program.
+   *
+   * \param filename the trace file
+   * \param capacity the number of records buffered between two writes
+   */
+  static void EnableDecisionTrace (std::string filename, uint32_t capacity = 4096);
 private:
   /**
    * \brief Assignment operator declared private and not implemented to disallow
@@ -9,6 +9,7 @@
 #include "ns3/flow-monitor-module.h"
 #include "dsr-application.h"
 #include "dsr-header.h"
+#include "dsr-flow-tag.h"
 
 
 #define MAX_UINT_32 0xffffffff
@@ -30,7 +31,8 @@ DsrApplication::DsrApplication ()
     m_running (false),
     m_packetSent (0),
     m_budget (MAX_UINT_32),
-    m_flag (false)
+    m_flag (false),
+    m_flowId (0)
 {
 }
 
@@ -92,6 +94,19 @@ DsrApplication::StartApplication ()
     m_packetSent = 0;
     m_socket->Bind ();
     m_socket->Connect (m_peer);
+    // the ports of the socket tell this flow from the others between the
+    // same hosts, see DsrFlowTag
+    Address local;
+    m_socket->GetSockName (local);
+    m_flowId = 0;
+    if (InetSocketAddress::IsMatchingType (local))
+    {
+        m_flowId = (uint32_t)InetSocketAddress::ConvertFrom (local).GetPort () << 16;
+    }
+    if (InetSocketAddress::IsMatchingType (m_peer))
+    {
+        m_flowId |= InetSocketAddress::ConvertFrom (m_peer).GetPort ();
+    }
     SendPacket ();
 }
 
@@ -130,6 +145,7 @@ DsrApplication::SendPacket()
     dsrheader.SetBudget (budget);
     dsrheader.SetFlag (flag);
     packet->AddHeader (dsrheader);
+    packet->AddPacketTag (DsrFlowTag (m_flowId));
     // std::cout << "send size: " << packet->GetSize () << std::endl;
     m_socket->Send (packet);
     if(++ m_packetSent < m_nPackets)
@@ -48,6 +48,7 @@ private:
   uint32_t m_packetSent;
   uint32_t m_budget;
   bool m_flag;
+  uint32_t m_flowId; // local and remote ports, see DsrFlowTag
 };
 }
 
@@ -27,6 +27,9 @@ namespace ns3 {
 
 NS_LOG_COMPONENT_DEFINE ("DSRCandidateQueue");
 
+/// heap slot of a vertex which is not queued
+static const uint32_t NO_SLOT = 0xffffffff;
+
 /**
  * \brief Stream insertion operator.
  *
@@ -51,22 +54,26 @@ operator<< (std::ostream& os, const DsrCandidateQueue& q)
 {
   typedef DsrCandidateQueue::DsrCandidateList_t List_t;
   typedef List_t::const_iterator CIter_t;
-  const DsrCandidateQueue::DsrCandidateList_t& list = q.m_candidates;
+  // the heap is stored in level order; sort a copy into pop order
+  List_t list = q.m_candidates;
+  std::sort (list.begin (), list.end (), &DsrCandidateQueue::Before);
 
   os << "*** CandidateQueue Begin (<id, distance, LSA-type>) ***" << std::endl;
   for (CIter_t iter = list.begin (); iter != list.end (); iter++)
     {
       os << "<" 
-      << (*iter)->GetVertexId () << ", "
-      << (*iter)->GetDistanceFromRoot () << ", "
-      << (*iter)->GetVertexType () << ">" << std::endl;
+      << iter->vertex->GetVertexId () << ", "
+      << iter->vertex->GetDistanceFromRoot () << ", "
+      << iter->vertex->GetVertexType () << ">" << std::endl;
     }
   os << "*** CandidateQueue End ***";
   return os;
 }
 
 DsrCandidateQueue::DsrCandidateQueue()
-  : m_candidates ()
+  : m_candidates (),
+    m_slots (),
+    m_nextSeq (0)
 {
   NS_LOG_FUNCTION (this);
 }
@@ -81,11 +88,21 @@ void
 DsrCandidateQueue::Clear (void)
 {
   NS_LOG_FUNCTION (this);
-  while (!m_candidates.empty ())
+  for (uint32_t i = 0; i < m_candidates.size (); i++)
+    {
+      m_slots[m_candidates[i].index] = NO_SLOT;
+    }
+  m_candidates.clear ();
+  m_nextSeq = 0;
+}
+
+void
+DsrCandidateQueue::Reserve (uint32_t nLSAs)
+{
+  NS_LOG_FUNCTION (this << nLSAs);
+  if (m_slots.size () < nLSAs)
     {
-      DSRVertex *p = Pop ();
-      delete p;
-      p = 0;
+      m_slots.resize (nLSAs, NO_SLOT);
     }
 }
 
@@ -93,12 +110,17 @@ void
 DsrCandidateQueue::Push (DSRVertex *vNew)
 {
   NS_LOG_FUNCTION (this << vNew);
+  uint32_t index = vNew->GetLSA ()->GetIndex ();
+  NS_ASSERT_MSG (index < m_slots.size (), "DsrCandidateQueue::Push (): LSA index beyond Reserve ()");
+  NS_ASSERT_MSG (m_slots[index] == NO_SLOT, "DsrCandidateQueue::Push (): vertex already queued");
 
-  DsrCandidateList_t::iterator i = std::upper_bound (
-      m_candidates.begin (), m_candidates.end (), vNew,
-      &DsrCandidateQueue::CompareDSRVertex
-      );
-  m_candidates.insert (i, vNew);
+  Candidate c;
+  c.vertex = vNew;
+  c.seq = m_nextSeq++;
+  c.index = index;
+  m_candidates.push_back (c);
+  m_slots[index] = m_candidates.size () - 1;
+  SiftUp (m_candidates.size () - 1);
 }
 
 DSRVertex *
@@ -110,8 +132,15 @@ DsrCandidateQueue::Pop (void)
       return 0;
     }
 
-  DSRVertex *v = m_candidates.front ();
-  m_candidates.pop_front ();
+  DSRVertex *v = m_candidates.front ().vertex;
+  m_slots[m_candidates.front ().index] = NO_SLOT;
+  Candidate last = m_candidates.back ();
+  m_candidates.pop_back ();
+  if (!m_candidates.empty ())
+    {
+      Place (0, last);
+      SiftDown (0);
+    }
   return v;
 }
 
@@ -124,7 +153,7 @@ DsrCandidateQueue::Top (void) const
       return 0;
     }
 
-  return m_candidates.front ();
+  return m_candidates.front ().vertex;
 }
 
 bool
@@ -142,21 +171,30 @@ DsrCandidateQueue::Size (void) const
 }
 
 DSRVertex *
-DsrCandidateQueue::Find (const Ipv4Address addr) const
+DsrCandidateQueue::Find (uint32_t index) const
 {
-  NS_LOG_FUNCTION (this);
-  DsrCandidateList_t::const_iterator i = m_candidates.begin ();
-
-  for (; i != m_candidates.end (); i++)
+  NS_LOG_FUNCTION (this << index);
+  if (index >= m_slots.size () || m_slots[index] == NO_SLOT)
     {
-      DSRVertex *v = *i;
-      if (v->GetVertexId () == addr)
-        {
-          return v;
-        }
+      return 0;
     }
+  return m_candidates[m_slots[index]].vertex;
+}
+
+void
+DsrCandidateQueue::DecreaseKey (DSRVertex *v)
+{
+  NS_LOG_FUNCTION (this << v);
+  uint32_t index = v->GetLSA ()->GetIndex ();
+  NS_ASSERT_MSG (index < m_slots.size () && m_slots[index] != NO_SLOT,
+                 "DsrCandidateQueue::DecreaseKey (): vertex not queued");
+  NS_ASSERT (m_candidates[m_slots[index]].vertex == v);
 
-  return 0;
+  // The sorted list kept a re-keyed vertex behind the ones it now ties with;
+  // a fresh sequence number does the same.
+  uint32_t slot = m_slots[index];
+  m_candidates[slot].seq = m_nextSeq++;
+  SiftUp (slot);
 }
 
 void
@@ -164,11 +202,74 @@ DsrCandidateQueue::Reorder (void)
 {
   NS_LOG_FUNCTION (this);
 
-  m_candidates.sort (&DsrCandidateQueue::CompareDSRVertex);
+  for (uint32_t slot = m_candidates.size () / 2; slot-- > 0; )
+    {
+      SiftDown (slot);
+    }
   NS_LOG_LOGIC ("After reordering the CandidateQueue");
   NS_LOG_LOGIC (*this);
 }
 
+bool
+DsrCandidateQueue::Before (const Candidate &c1, const Candidate &c2)
+{
+  if (CompareDSRVertex (c1.vertex, c2.vertex))
+    {
+      return true;
+    }
+  if (CompareDSRVertex (c2.vertex, c1.vertex))
+    {
+      return false;
+    }
+  return c1.seq < c2.seq;
+}
+
+void
+DsrCandidateQueue::Place (uint32_t slot, const Candidate &c)
+{
+  m_candidates[slot] = c;
+  m_slots[c.index] = slot;
+}
+
+void
+DsrCandidateQueue::SiftUp (uint32_t slot)
+{
+  Candidate c = m_candidates[slot];
+  while (slot > 0)
+    {
+      uint32_t parent = (slot - 1) / 2;
+      if (!Before (c, m_candidates[parent]))
+        {
+          break;
+        }
+      Place (slot, m_candidates[parent]);
+      slot = parent;
+    }
+  Place (slot, c);
+}
+
+void
+DsrCandidateQueue::SiftDown (uint32_t slot)
+{
+  Candidate c = m_candidates[slot];
+  uint32_t n = m_candidates.size ();
+  while (2 * slot + 1 < n)
+    {
+      uint32_t child = 2 * slot + 1;
+      if (child + 1 < n && Before (m_candidates[child + 1], m_candidates[child]))
+        {
+          child++;
+        }
+      if (!Before (m_candidates[child], c))
+        {
+          break;
+        }
+      Place (slot, m_candidates[child]);
+      slot = child;
+    }
+  Place (slot, c);
+}
+
 /*
  * In this implementation, DSRVertex follows the ordering where
  * a vertex is ranked first if its GetDistanceFromRoot () is smaller;
@@ -22,7 +22,7 @@
 #define DSR_CANDIDATE_QUEUE_H
 
 #include <stdint.h>
-#include <list>
+#include <vector>
 #include "ns3/ipv4-address.h"
 
 namespace ns3 {
@@ -45,8 +45,12 @@ class DSRVertex;
  *
  * Although a STL priority_queue almost does what we want, the requirement
  * for a Find () operation, the dynamic nature of the data and the derived
- * requirement for a Reorder () operation led us to implement this simple 
- * enhanced priority queue.
+ * requirement for a DecreaseKey () operation led us to implement this
+ * enhanced priority queue.  It is a binary heap with an index from the
+ * LSA index of a vertex to its heap slot, so Push (), Pop () and
+ * DecreaseKey () are O(log n) and Find () is O(1).  Vertices that compare
+ * equal are popped in the order they were pushed, or last had their key
+ * decreased, as they were when the queue was a sorted list.
  */
 class DsrCandidateQueue
 {
@@ -59,21 +63,36 @@ public:
   DsrCandidateQueue ();
 
 /**
- * @brief Destroy an SPF Candidate Queue and release any resources held 
- * by the contents.
+ * @brief Destroy an SPF Candidate Queue.
+ *
+ * The vertices in the queue belong to the DSRVertexArena they were
+ * allocated from and are not deleted.
  *
  * @see DSRVertex
  */
   virtual ~DsrCandidateQueue ();
 
 /**
- * @brief Empty the Candidate Queue and release all of the resources 
- * associated with the Shortest Path First Vertex pointers in the queue.
+ * @brief Empty the Candidate Queue.
+ *
+ * The memory of the queue is kept for the next SPF computation, and the
+ * vertices, which belong to their DSRVertexArena, are not deleted.
  *
  * @see DSRVertex
  */
   void Clear (void);
 
+/**
+ * @brief Size the index of the heap slots for the LSAs of the LSDB.
+ *
+ * The index only grows, so that once it fits the largest LSDB, queueing
+ * vertices allocates nothing.
+ *
+ * @param nLSAs the number of LSAs; the vertices pushed afterward must have
+ * an LSA index below it
+ */
+  void Reserve (uint32_t nLSAs);
+
 /**
  * @brief Push a Shortest Path First Vertex pointer onto the queue according
  * to the priority scheme.
@@ -131,13 +150,27 @@ public:
 
 /**
  * @brief Searches the Candidate Queue for a Shortest Path First Vertex 
- * pointer that points to a vertex having the given IP address.
+ * pointer that points to a vertex of the LSA with the given index.
  *
  * @see DSRVertex
- * @param addr The IP address to search for.
- * @returns The DSRVertex* pointer corresponding to the given IP address.
+ * @see DSRRoutingLSA::GetIndex ()
+ * @param index The LSA index to search for.
+ * @returns The DSRVertex* pointer corresponding to the given LSA index, or
+ * 0 if it is not queued.
  */
-  DSRVertex* Find (const Ipv4Address addr) const;
+  DSRVertex* Find (uint32_t index) const;
+
+/**
+ * @brief Restore the priority of a vertex whose m_distanceFromRoot has
+ * just been lowered.
+ *
+ * The vertex must be in the queue.  This is cheaper than Reorder () when
+ * a single vertex changes during the routing calculations.
+ *
+ * @see DSRVertex
+ * @param v The Shortest Path First Vertex whose distance was lowered.
+ */
+  void DecreaseKey (DSRVertex *v);
 
 /**
  * @brief Reorders the Candidate Queue according to the priority scheme.
@@ -184,12 +217,51 @@ private:
  */
   static bool CompareDSRVertex (const DSRVertex* v1, const DSRVertex* v2);
 
-  typedef std::list<DSRVertex*> DsrCandidateList_t; //!< container of DSRVertex pointers
+  /// A heap slot: a vertex and the sequence number breaking ties in its key
+  struct Candidate
+  {
+    DSRVertex *vertex; //!< the vertex
+    uint64_t seq;      //!< push (or last decrease-key) order
+    uint32_t index;    //!< LSA index of the vertex, its key in m_slots
+  };
+
+  /**
+   * \brief return true if c1 should be popped before c2
+   * \param c1 first operand
+   * \param c2 second operand
+   * \return True if c1 should be popped before c2; false otherwise
+   */
+  static bool Before (const Candidate &c1, const Candidate &c2);
+
+  /**
+   * \brief Move the candidate at a slot towards the top of the heap
+   * \param slot the heap slot
+   */
+  void SiftUp (uint32_t slot);
+
+  /**
+   * \brief Move the candidate at a slot towards the bottom of the heap
+   * \param slot the heap slot
+   */
+  void SiftDown (uint32_t slot);
+
+  /**
+   * \brief Store a candidate at a slot and index it
+   * \param slot the heap slot
+   * \param c the candidate
+   */
+  void Place (uint32_t slot, const Candidate &c);
+
+  typedef std::vector<Candidate> DsrCandidateList_t; //!< binary heap of candidates
   DsrCandidateList_t m_candidates;  //!< DSRVertex candidates
+  std::vector<uint32_t> m_slots; //!< heap slot by LSA index, or NO_SLOT
+  uint64_t m_nextSeq; //!< next tie-break sequence number
 
   /**
    * \brief Stream insertion operator.
    *
+   * The candidates are printed in the order they would be popped.
+   *
    * \param os the reference to the output stream
    * \param q the CandidateQueue
    * \returns the reference to the output stream
@@ -0,0 +1,137 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+
+#include <fstream>
+#include <vector>
+#include "ns3/assert.h"
+#include "ns3/fatal-error.h"
+#include "ns3/log.h"
+#include "ns3/simulation-singleton.h"
+#include "dsr-decision-trace.h"
+
+namespace ns3 {
+
+NS_LOG_COMPONENT_DEFINE ("DsrDecisionTrace");
+
+/**
+ * \ingroup dsr-routing
+ *
+ * \brief State of the decision trace, destroyed with the simulation.
+ */
+class DsrDecisionTraceImpl
+{
+public:
+  DsrDecisionTraceImpl ();
+  ~DsrDecisionTraceImpl ();
+
+  /**
+   * \brief Start tracing to a file, truncating it.
+   * \param filename the trace file
+   * \param capacity the number of records buffered between two writes
+   */
+  void Enable (std::string filename, uint32_t capacity);
+  /**
+   * \brief Append a record to the ring, writing the ring out if it is full.
+   * \param record the record
+   */
+  void Record (const DsrDecisionRecord &record);
+  /**
+   * \brief Write the buffered records to the trace file.
+   */
+  void Flush (void);
+
+  bool m_enabled;                          //!< true once Enable has been called
+private:
+  std::ofstream m_file;                    //!< the trace file
+  std::vector<DsrDecisionRecord> m_ring;   //!< preallocated records
+  uint32_t m_count;                        //!< number of records in m_ring
+};
+
+DsrDecisionTraceImpl::DsrDecisionTraceImpl ()
+  : m_enabled (false),
+    m_count (0)
+{
+  NS_LOG_FUNCTION (this);
+}
+
+DsrDecisionTraceImpl::~DsrDecisionTraceImpl ()
+{
+  NS_LOG_FUNCTION (this);
+  Flush ();
+}
+
+void
+DsrDecisionTraceImpl::Enable (std::string filename, uint32_t capacity)
+{
+  NS_LOG_FUNCTION (this << filename << capacity);
+  NS_ASSERT (capacity > 0);
+  Flush ();
+  if (m_file.is_open ())
+    {
+      m_file.close ();
+    }
+  m_file.open (filename.c_str (), std::ios::out | std::ios::binary | std::ios::trunc);
+  if (!m_file.is_open ())
+    {
+      NS_FATAL_ERROR ("Can not open decision trace file " << filename);
+    }
+  uint32_t fileHeader[3] = { DSR_DECISION_TRACE_MAGIC, DSR_DECISION_TRACE_VERSION, sizeof (DsrDecisionRecord) };
+  m_file.write ((const char *)fileHeader, sizeof (fileHeader));
+  m_ring.resize (capacity);
+  m_count = 0;
+  m_enabled = true;
+}
+
+void
+DsrDecisionTraceImpl::Record (const DsrDecisionRecord &record)
+{
+  m_ring[m_count++] = record;
+  if (m_count == m_ring.size ())
+    {
+      Flush ();
+    }
+}
+
+void
+DsrDecisionTraceImpl::Flush (void)
+{
+  NS_LOG_FUNCTION (this << m_count);
+  if (m_count == 0 || !m_file.is_open ())
+    {
+      return;
+    }
+  m_file.write ((const char *)&m_ring[0], m_count * sizeof (DsrDecisionRecord));
+  m_file.flush ();
+  m_count = 0;
+}
+
+void
+DsrDecisionTrace::Enable (std::string filename, uint32_t capacity)
+{
+  NS_LOG_FUNCTION (filename << capacity);
+  SimulationSingleton<DsrDecisionTraceImpl>::Get ()->Enable (filename, capacity);
+}
+
+bool
+DsrDecisionTrace::IsEnabled (void)
+{
+  return SimulationSingleton<DsrDecisionTraceImpl>::Get ()->m_enabled;
+}
+
+void
+DsrDecisionTrace::Record (const DsrDecisionRecord &record)
+{
+  DsrDecisionTraceImpl *impl = SimulationSingleton<DsrDecisionTraceImpl>::Get ();
+  if (impl->m_enabled)
+    {
+      impl->Record (record);
+    }
+}
+
+void
+DsrDecisionTrace::Flush (void)
+{
+  NS_LOG_FUNCTION_NOARGS ();
+  SimulationSingleton<DsrDecisionTraceImpl>::Get ()->Flush ();
+}
+
+} // namespace ns3
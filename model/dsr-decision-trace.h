@@ -0,0 +1,108 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+#ifndef DSR_DECISION_TRACE_H
+#define DSR_DECISION_TRACE_H
+
+#include <stdint.h>
+#include <string>
+
+namespace ns3 {
+
+/// Magic number at the start of a decision trace file ("DSRT")
+#define DSR_DECISION_TRACE_MAGIC 0x54525344
+/// Version of the decision trace file format
+#define DSR_DECISION_TRACE_VERSION 1
+
+/**
+ * \ingroup dsr-routing
+ *
+ * \brief Fixed-size record of one step of a budget-aware routing decision.
+ *
+ * Records are written to the trace file as they are laid out in memory,
+ * after a file header made of the magic number, the format version and
+ * sizeof (DsrDecisionRecord), all as uint32_t.
+ */
+struct DsrDecisionRecord
+{
+  /// What a record describes
+  enum Type
+  {
+    DROP_ROUTE = 0, //!< a candidate route is beyond the remaining budget
+    NO_ROUTE = 1,   //!< no candidate route is within the remaining budget
+    CONGESTED = 2,  //!< both lanes of a next hop are full
+    TIMEOUT = 3,    //!< all lane weights are zero
+    GOOD_ROUTE = 4, //!< lane weights of a good route
+    SELECT = 5      //!< selected route and lane
+  };
+
+  int64_t time;      //!< simulation time, in nanoseconds
+  uint32_t node;     //!< id of the node taking the decision
+  uint32_t dest;     //!< destination address
+  uint32_t budget;   //!< remaining budget, in microseconds
+  uint16_t route;    //!< index of the candidate route
+  uint8_t type;      //!< record type, see Type
+  uint8_t lane;      //!< selected lane (SELECT)
+  uint32_t qlFast;   //!< fast lane length of the next hop, in packets
+  uint32_t qlSlow;   //!< slow lane length of the next hop, in packets
+  double delay;      //!< clamped per-hop budget, in milliseconds
+  double edqFast;    //!< estimated fast lane delay, in milliseconds
+  double edqSlow;    //!< estimated slow lane delay, in milliseconds
+  double boundFast;  //!< fast lane delay bound, in milliseconds
+  double boundSlow;  //!< slow lane delay bound, in milliseconds
+  double weightFast; //!< fast lane weight
+  double weightSlow; //!< slow lane weight
+};
+
+/**
+ * \ingroup dsr-routing
+ *
+ * \brief Binary trace of the routing decisions of flagged DSR packets.
+ *
+ * Records are copied into a preallocated ring which is written to the
+ * trace file whenever it fills up, when Flush is called and when the
+ * simulation is destroyed.  Use the dsr-decision-trace-decode program to
+ * print a trace file as text.
+ */
+class DsrDecisionTrace
+{
+public:
+  /**
+   * \brief Start tracing to a file, truncating it.
+   * \param filename the trace file
+   * \param capacity the number of records buffered between two writes
+   */
+  static void Enable (std::string filename, uint32_t capacity = 4096);
+
+  /**
+   * \return true if tracing has been enabled
+   */
+  static bool IsEnabled (void);
+
+  /**
+   * \brief Append a record to the ring, writing the ring out if it is full.
+   * \param record the record
+   */
+  static void Record (const DsrDecisionRecord &record);
+
+  /**
+   * \brief Write the buffered records to the trace file.
+   */
+  static void Flush (void);
+
+private:
+  /**
+   * \brief Copy construction is disallowed.
+   * \param o object to copy from
+   */
+  DsrDecisionTrace (DsrDecisionTrace &o);
+
+  /**
+   * \brief Copy assignment operator is disallowed.
+   * \param o object to copy from
+   * \returns the copied object
+   */
+  DsrDecisionTrace& operator= (DsrDecisionTrace &o);
+};
+
+} // namespace ns3
+
+#endif /* DSR_DECISION_TRACE_H */
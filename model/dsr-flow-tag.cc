@@ -0,0 +1,72 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+
+#include "dsr-flow-tag.h"
+
+namespace ns3 {
+
+NS_OBJECT_ENSURE_REGISTERED (DsrFlowTag);
+
+DsrFlowTag::DsrFlowTag ()
+  : m_flowId (0)
+{
+}
+
+DsrFlowTag::DsrFlowTag (uint32_t flowId)
+  : m_flowId (flowId)
+{
+}
+
+TypeId
+DsrFlowTag::GetTypeId (void)
+{
+  static TypeId tid = TypeId ("ns3::DsrFlowTag")
+    .SetParent<Tag> ()
+    .SetGroupName ("Dsr-routing")
+    .AddConstructor<DsrFlowTag> ()
+  ;
+  return tid;
+}
+
+TypeId
+DsrFlowTag::GetInstanceTypeId (void) const
+{
+  return GetTypeId ();
+}
+
+uint32_t
+DsrFlowTag::GetSerializedSize (void) const
+{
+  return 4;
+}
+
+void
+DsrFlowTag::Serialize (TagBuffer i) const
+{
+  i.WriteU32 (m_flowId);
+}
+
+void
+DsrFlowTag::Deserialize (TagBuffer i)
+{
+  m_flowId = i.ReadU32 ();
+}
+
+void
+DsrFlowTag::Print (std::ostream &os) const
+{
+  os << "flowId=" << m_flowId;
+}
+
+void
+DsrFlowTag::SetFlowId (uint32_t flowId)
+{
+  m_flowId = flowId;
+}
+
+uint32_t
+DsrFlowTag::GetFlowId (void) const
+{
+  return m_flowId;
+}
+
+} // namespace ns3
@@ -0,0 +1,60 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+#ifndef DSR_FLOW_TAG_H
+#define DSR_FLOW_TAG_H
+
+#include <stdint.h>
+#include "ns3/tag.h"
+
+namespace ns3 {
+
+/**
+ * \ingroup dsr-routing
+ *
+ * \brief Packet tag telling the flows between the same two hosts apart.
+ *
+ * The source application sets it on every packet, since the routing
+ * decision at the source is taken before the transport header is added,
+ * and the DSR header follows that header on the wire.  DsrApplication
+ * uses the local and remote ports of its socket as the flow id, so that
+ * Ipv4DSRRouting hashes the same 5-tuple at every hop.
+ */
+class DsrFlowTag : public Tag
+{
+public:
+  DsrFlowTag ();
+
+  /**
+   * \brief Construct a tag.
+   * \param flowId the flow id
+   */
+  DsrFlowTag (uint32_t flowId);
+
+  /**
+   * \brief Get the type ID.
+   * \return the object TypeId
+   */
+  static TypeId GetTypeId (void);
+  virtual TypeId GetInstanceTypeId (void) const;
+  virtual uint32_t GetSerializedSize (void) const;
+  virtual void Serialize (TagBuffer i) const;
+  virtual void Deserialize (TagBuffer i);
+  virtual void Print (std::ostream &os) const;
+
+  /**
+   * \brief Set the flow id.
+   * \param flowId the flow id
+   */
+  void SetFlowId (uint32_t flowId);
+
+  /**
+   * \return the flow id
+   */
+  uint32_t GetFlowId (void) const;
+
+private:
+  uint32_t m_flowId; //!< flow id, unique among the flows of a source and destination
+};
+
+} // namespace ns3
+
+#endif /* DSR_FLOW_TAG_H */
@@ -27,22 +27,43 @@
 #include <queue>
 #include <algorithm>
 #include <iostream>
+#include <atomic>
+#include <functional>
+#include <thread>
 #include "ns3/assert.h"
 #include "ns3/fatal-error.h"
 #include "ns3/log.h"
+#include "ns3/simulator.h"
+#include "ns3/global-value.h"
+#include "ns3/uinteger.h"
 #include "ns3/node-list.h"
+#include "ns3/node.h"
+#include "ns3/net-device.h"
+#include "ns3/channel.h"
 #include "ns3/ipv4.h"
 #include "ns3/ipv4-routing-protocol.h"
 #include "ns3/ipv4-list-routing.h"
 #include "dsr-router-interface.h"
 #include "dsr-route-manager-impl.h"
 #include "dsr-candidate-queue.h"
+#include "dsr-route-profile.h"
 #include "ipv4-dsr-routing.h"
 
 namespace ns3 {
 
 NS_LOG_COMPONENT_DEFINE ("DSRRouteManagerImpl");
 
+/**
+ * \brief Number of threads computing the SPF trees of InitializeRoutes.
+ *
+ * Can be set with NS_GLOBAL_VALUE="DsrSpfThreads=<n>" or --DsrSpfThreads.
+ */
+static GlobalValue g_dsrSpfThreads ("DsrSpfThreads",
+                                    "Number of threads computing the SPF trees when routes are populated; "
+                                    "0 uses one thread per hardware thread",
+                                    UintegerValue (1),
+                                    MakeUintegerChecker<uint32_t> ());
+
 /**
  * \brief Stream insertion operator.
  *
@@ -57,27 +78,6 @@ operator<< (std::ostream& os, const DSRVertex::NodeExit_t& exit)
   return os;
 }
 
-std::ostream& 
-operator<< (std::ostream& os, const DSRVertex::ListOfDSRVertex_t& vs)
-{
-  typedef DSRVertex::ListOfDSRVertex_t::const_iterator CIter_t;
-  os << "{";
-  for (CIter_t iter = vs.begin (); iter != vs.end ();)
-    {
-      os << (*iter)->m_vertexId;
-      if (++iter != vs.end ()) 
-        {
-          os << ", ";
-        }
-      else 
-        { 
-          break;
-        }
-    }
-  os << "}";
-  return os;
-}
-
 // ---------------------------------------------------------------------------
 //
 // DSRVertex Implementation
@@ -93,22 +93,44 @@ DSRVertex::DSRVertex () :
   m_nextHop ("0.0.0.0"),
   m_parents (),
   m_children (),
-  m_vertexProcessed (false)
+  m_vertexProcessed (false),
+  m_arena (0),
+  m_index (0)
 {
   NS_LOG_FUNCTION (this);
 }
 
 DSRVertex::DSRVertex (DSRRoutingLSA* lsa) : 
-  m_vertexId (lsa->GetLinkStateId ()),
-  m_lsa (lsa),
-  m_distanceFromRoot (DISTINFINITY), 
-  m_rootOif (DISTINFINITY),
-  m_nextHop ("0.0.0.0"),
+  m_vertexType (VertexUnknown), 
+  m_lsa (0),
   m_parents (),
   m_children (),
-  m_vertexProcessed (false)
+  m_arena (0),
+  m_index (0)
+{
+  NS_LOG_FUNCTION (this << lsa);
+  Init (lsa);
+}
+
+DSRVertex::~DSRVertex ()
+{
+  NS_LOG_FUNCTION (this);
+}
+
+void
+DSRVertex::Init (DSRRoutingLSA* lsa)
 {
   NS_LOG_FUNCTION (this << lsa);
+  m_vertexType = VertexUnknown;
+  m_vertexId = lsa->GetLinkStateId ();
+  m_lsa = lsa;
+  m_distanceFromRoot = DISTINFINITY;
+  m_rootOif = DISTINFINITY;
+  m_nextHop = Ipv4Address::GetZero ();
+  m_ecmpRootExits.clear ();
+  m_parents.clear ();
+  m_children.clear ();
+  m_vertexProcessed = false;
 
   if (lsa->GetLSType () == DSRRoutingLSA::RouterLSA) 
     {
@@ -122,57 +144,6 @@ DSRVertex::DSRVertex (DSRRoutingLSA* lsa) :
     }
 }
 
-DSRVertex::~DSRVertex ()
-{
-  NS_LOG_FUNCTION (this);
-
-  NS_LOG_LOGIC ("Children vertices - " << m_children);
-  NS_LOG_LOGIC ("Parent verteices - " << m_parents);
-
-  // find this node from all its parents and remove the entry of this node
-  // from all its parents
-  for (ListOfDSRVertex_t::iterator piter = m_parents.begin (); 
-       piter != m_parents.end ();
-       piter++)
-    {
-      // remove the current vertex from its parent's children list. Check
-      // if the size of the list is reduced, or the child<->parent relation
-      // is not bidirectional
-      uint32_t orgCount = (*piter)->m_children.size ();
-      (*piter)->m_children.remove (this);
-      uint32_t newCount = (*piter)->m_children.size ();
-      if (orgCount > newCount)
-        {
-          NS_ASSERT_MSG (orgCount > newCount, "Unable to find the current vertex from its parents --- impossible!");
-        }
-    }
-
-  // delete children
-  while (m_children.size () > 0)
-    {
-      // pop out children one by one. Some children may disappear 
-      // when deleting some other children in the list. As a result,
-      // it is necessary to use pop to walk through all children, instead
-      // of using iterator.
-      //
-      // Note that m_children.pop_front () is not necessary as this
-      // p is removed from the children list when p is deleted
-      DSRVertex* p = m_children.front ();
-      // 'p' == 0, this child is already deleted by its other parent
-      if (p == 0) continue;
-      NS_LOG_LOGIC ("Parent vertex-" << m_vertexId << " deleting its child vertex-" << p->GetVertexId ());
-      delete p;
-      p = 0;
-    }
-  m_children.clear ();
-  // delete parents
-  m_parents.clear ();
-  // delete root exit direction
-  m_ecmpRootExits.clear ();
-
-  NS_LOG_LOGIC ("Vertex-" << m_vertexId << " completed deleted");
-}
-
 void
 DSRVertex::SetVertexType (DSRVertex::VertexType type)
 {
@@ -234,9 +205,11 @@ DSRVertex::SetParent (DSRVertex* parent)
 {
   NS_LOG_FUNCTION (this << parent);
 
+  NS_ASSERT_MSG (m_arena && parent->m_arena == m_arena,
+                 "DSRVertex::SetParent (): vertices not allocated from the same arena");
   // always maintain only one parent when using setter/getter methods
   m_parents.clear ();
-  m_parents.push_back (parent);
+  m_parents.push_back (parent->m_index);
 }
 
 DSRVertex*
@@ -250,12 +223,7 @@ DSRVertex::GetParent (uint32_t i) const
       NS_LOG_LOGIC ("Index to DSRVertex's parent is out-of-range.");
       return 0;
     }
-  ListOfDSRVertex_t::const_iterator iter = m_parents.begin ();
-  while (i-- > 0) 
-    {
-      iter++;
-    }
-  return *iter;
+  return m_arena->Get (m_parents[i]);
 }
 
 void 
@@ -263,14 +231,15 @@ DSRVertex::MergeParent (const DSRVertex* v)
 {
   NS_LOG_FUNCTION (this << v);
 
-  NS_LOG_LOGIC ("Before merge, list of parents = " << m_parents);
+  NS_ASSERT (v->m_arena == m_arena);
+  NS_LOG_LOGIC ("Before merge, " << m_parents.size () << " parents");
   // combine the two lists first, and then remove any duplicated after
   m_parents.insert (m_parents.end (), 
                     v->m_parents.begin (), v->m_parents.end ());
   // remove duplication
-  m_parents.sort ();
-  m_parents.unique ();
-  NS_LOG_LOGIC ("After merge, list of parents = " << m_parents);
+  std::sort (m_parents.begin (), m_parents.end ());
+  m_parents.erase (std::unique (m_parents.begin (), m_parents.end ()), m_parents.end ());
+  NS_LOG_LOGIC ("After merge, " << m_parents.size () << " parents");
 }
 
 void 
@@ -298,13 +267,8 @@ DSRVertex::NodeExit_t
 DSRVertex::GetRootExitDirection (uint32_t i) const
 {
   NS_LOG_FUNCTION (this << i);
-  typedef ListOfNodeExit_t::const_iterator CIter_t;
-
   NS_ASSERT_MSG (i < m_ecmpRootExits.size (), "Index out-of-range when accessing DSRVertex::m_ecmpRootExits!");
-  CIter_t iter = m_ecmpRootExits.begin ();
-  while (i-- > 0) { iter++; }
-
-  return *iter;
+  return m_ecmpRootExits[i];
 }
 
 DSRVertex::NodeExit_t 
@@ -327,8 +291,9 @@ DSRVertex::MergeRootExitDirections (const DSRVertex* vertex)
   const ListOfNodeExit_t& extList = vertex->m_ecmpRootExits;
   m_ecmpRootExits.insert (m_ecmpRootExits.end (), 
                           extList.begin (), extList.end ());
-  m_ecmpRootExits.sort ();
-  m_ecmpRootExits.unique ();
+  std::sort (m_ecmpRootExits.begin (), m_ecmpRootExits.end ());
+  m_ecmpRootExits.erase (std::unique (m_ecmpRootExits.begin (), m_ecmpRootExits.end ()),
+                         m_ecmpRootExits.end ());
 }
 
 void 
@@ -342,9 +307,7 @@ DSRVertex::InheritAllRootExitDirections (const DSRVertex* vertex)
     {
       NS_LOG_WARN ("x root exit directions in this vertex are going to be discarded");
     }
-  m_ecmpRootExits.clear ();
-  m_ecmpRootExits.insert (m_ecmpRootExits.end (), 
-                          vertex->m_ecmpRootExits.begin (), vertex->m_ecmpRootExits.end ());
+  m_ecmpRootExits.assign (vertex->m_ecmpRootExits.begin (), vertex->m_ecmpRootExits.end ());
 }
 
 uint32_t 
@@ -365,26 +328,17 @@ DSRVertex*
 DSRVertex::GetChild (uint32_t n) const
 {
   NS_LOG_FUNCTION (this << n);
-  uint32_t j = 0;
-
-  for ( ListOfDSRVertex_t::const_iterator i = m_children.begin ();
-        i != m_children.end ();
-        i++, j++)
-    {
-      if (j == n)
-        {
-          return *i;
-        }
-    }
-  NS_ASSERT_MSG (false, "Index <n> out of range.");
-  return 0;
+  NS_ASSERT_MSG (n < m_children.size (), "Index <n> out of range.");
+  return m_arena->Get (m_children[n]);
 }
 
 uint32_t
 DSRVertex::AddChild (DSRVertex* child)
 {
   NS_LOG_FUNCTION (this << child);
-  m_children.push_back (child);
+  NS_ASSERT_MSG (m_arena && child->m_arena == m_arena,
+                 "DSRVertex::AddChild (): vertices not allocated from the same arena");
+  m_children.push_back (child->m_index);
   return m_children.size ();
 }
 
@@ -413,6 +367,78 @@ DSRVertex::ClearVertexProcessed (void)
   this->SetVertexProcessed (false);
 }
 
+// ---------------------------------------------------------------------------
+//
+// DSRVertexArena Implementation
+//
+// ---------------------------------------------------------------------------
+
+const uint32_t DSRVertexArena::BLOCK_SIZE;
+
+DSRVertexArena::DSRVertexArena ()
+  : m_blocks (),
+    m_size (0)
+{
+  NS_LOG_FUNCTION (this);
+}
+
+DSRVertexArena::~DSRVertexArena ()
+{
+  NS_LOG_FUNCTION (this);
+  for (uint32_t i = 0; i < m_blocks.size (); i++)
+    {
+      delete [] m_blocks[i];
+    }
+  m_blocks.clear ();
+}
+
+DSRVertex*
+DSRVertexArena::Allocate (DSRRoutingLSA* lsa)
+{
+  NS_LOG_FUNCTION (this << lsa);
+  if (m_size == m_blocks.size () * BLOCK_SIZE)
+    {
+      DSRVertex *block = new DSRVertex[BLOCK_SIZE];
+      for (uint32_t i = 0; i < BLOCK_SIZE; i++)
+        {
+          block[i].m_arena = this;
+          block[i].m_index = m_size + i;
+        }
+      m_blocks.push_back (block);
+    }
+  DSRVertex *v = Get (m_size++);
+  v->Init (lsa);
+  return v;
+}
+
+void
+DSRVertexArena::Release (DSRVertex* v)
+{
+  NS_LOG_FUNCTION (this << v);
+  NS_ASSERT_MSG (m_size > 0 && v == Get (m_size - 1),
+                 "DSRVertexArena::Release (): not the last vertex allocated");
+  m_size--;
+}
+
+void
+DSRVertexArena::Reset (void)
+{
+  NS_LOG_FUNCTION (this);
+  m_size = 0;
+}
+
+DSRVertex*
+DSRVertexArena::Get (uint32_t index) const
+{
+  return &m_blocks[index / BLOCK_SIZE][index % BLOCK_SIZE];
+}
+
+uint32_t
+DSRVertexArena::GetNVertices (void) const
+{
+  return m_size;
+}
+
 // ---------------------------------------------------------------------------
 //
 // DSRRouteManagerLSDB Implementation
@@ -422,7 +448,9 @@ DSRVertex::ClearVertexProcessed (void)
 DSRRouteManagerLSDB::DSRRouteManagerLSDB ()
   :
     m_database (),
-    m_extdatabase ()
+    m_lsas (),
+    m_extdatabase (),
+    m_linkData ()
 {
   NS_LOG_FUNCTION (this);
 }
@@ -445,6 +473,8 @@ DSRRouteManagerLSDB::~DSRRouteManagerLSDB ()
     }
   NS_LOG_LOGIC ("clear map");
   m_database.clear ();
+  m_lsas.clear ();
+  m_linkData.clear ();
 }
 
 void
@@ -469,8 +499,107 @@ DSRRouteManagerLSDB::Insert (Ipv4Address addr, DSRRoutingLSA* lsa)
     } 
   else
     {
-      m_database.insert (LSDBPair_t (addr, lsa));
+      if (m_database.insert (LSDBPair_t (addr, lsa)).second)
+        {
+          std::map<Ipv4Address, uint32_t>::iterator v = m_vacant.find (addr);
+          if (v != m_vacant.end ())
+            {
+              lsa->SetIndex (v->second);
+              m_lsas[v->second] = lsa;
+              m_vacant.erase (v);
+            }
+          else
+            {
+              lsa->SetIndex (m_lsas.size ());
+              m_lsas.push_back (lsa);
+            }
+        }
+//
+// Index the transit network link records by link data, for GetLSAByLinkData.
+//
+      for (uint32_t j = 0; j < lsa->GetNLinkRecords (); j++)
+        {
+          DSRRoutingLinkRecord *lr = lsa->GetLinkRecord (j);
+          if (lr->GetLinkType () == DSRRoutingLinkRecord::TransitNetwork)
+            {
+              m_linkData.insert (std::make_pair (lr->GetLinkData (), lsa));
+            }
+        }
+    }
+}
+
+void
+DSRRouteManagerLSDB::Remove (const std::set<Ipv4Address> &routers, std::vector<DSRRoutingLSA*> &removed)
+{
+  NS_LOG_FUNCTION (this << routers.size ());
+  m_linkData.clear ();
+  for (uint32_t i = 0; i < m_lsas.size (); i++)
+    {
+      DSRRoutingLSA *lsa = m_lsas[i];
+      if (lsa == 0)
+        {
+          continue;
+        }
+      if (routers.count (lsa->GetAdvertisingRouter ()) == 0)
+        {
+          for (uint32_t j = 0; j < lsa->GetNLinkRecords (); j++)
+            {
+              DSRRoutingLinkRecord *lr = lsa->GetLinkRecord (j);
+              if (lr->GetLinkType () == DSRRoutingLinkRecord::TransitNetwork)
+                {
+                  m_linkData.insert (std::make_pair (lr->GetLinkData (), lsa));
+                }
+            }
+          continue;
+        }
+      LSDBMap_t::iterator k = m_database.find (lsa->GetLinkStateId ());
+      if (k != m_database.end () && k->second == lsa)
+        {
+          m_database.erase (k);
+        }
+      m_vacant[lsa->GetLinkStateId ()] = i;
+      m_lsas[i] = 0;
+      removed.push_back (lsa);
+    }
+
+  std::vector<DSRRoutingLSA*> ext;
+  ext.swap (m_extdatabase);
+  for (uint32_t i = 0; i < ext.size (); i++)
+    {
+      if (routers.count (ext[i]->GetAdvertisingRouter ()) == 0)
+        {
+          m_extdatabase.push_back (ext[i]);
+        }
+      else
+        {
+          removed.push_back (ext[i]);
+        }
+    }
+}
+
+bool
+DSRRouteManagerLSDB::Compact ()
+{
+  NS_LOG_FUNCTION (this << m_vacant.size ());
+  if (m_vacant.empty ())
+    {
+      return false;
+    }
+  m_vacant.clear ();
+  std::vector<DSRRoutingLSA*> lsas;
+  lsas.swap (m_lsas);
+  bool moved = false;
+  for (uint32_t i = 0; i < lsas.size (); i++)
+    {
+      if (lsas[i] == 0)
+        {
+          continue;
+        }
+      moved = moved || i != m_lsas.size ();
+      lsas[i]->SetIndex (m_lsas.size ());
+      m_lsas.push_back (lsas[i]);
     }
+  return moved;
 }
 
 DSRRoutingLSA*
@@ -494,38 +623,41 @@ DSRRouteManagerLSDB::GetLSA (Ipv4Address addr) const
 //
 // Look up an LSA by its address.
 //
-  LSDBMap_t::const_iterator i;
-  for (i= m_database.begin (); i!= m_database.end (); i++)
+  DsrRouteProfile::Count (DsrRouteProfile::LSA_LOOKUPS);
+  LSDBMap_t::const_iterator i = m_database.find (addr);
+  if (i != m_database.end ())
     {
-      if (i->first == addr)
-        {
-          return i->second;
-        }
+      return i->second;
     }
   return 0;
 }
 
+uint32_t
+DSRRouteManagerLSDB::GetNumLSAs () const
+{
+  NS_LOG_FUNCTION (this);
+  return m_database.size ();
+}
+
+DSRRoutingLSA*
+DSRRouteManagerLSDB::GetLSAByIndex (uint32_t index) const
+{
+  NS_LOG_FUNCTION (this << index);
+  return m_lsas.at (index);
+}
+
 DSRRoutingLSA*
 DSRRouteManagerLSDB::GetLSAByLinkData (Ipv4Address addr) const
 {
   NS_LOG_FUNCTION (this << addr);
 //
-// Look up an LSA by its address.
+// Look up an LSA by the link data of one of its transit network link records.
 //
-  LSDBMap_t::const_iterator i;
-  for (i= m_database.begin (); i!= m_database.end (); i++)
+  DsrRouteProfile::Count (DsrRouteProfile::LSA_LOOKUPS);
+  LinkDataMap_t::const_iterator i = m_linkData.find (addr);
+  if (i != m_linkData.end ())
     {
-      DSRRoutingLSA* temp = i->second;
-// Iterate among temp's Link Records
-      for (uint32_t j = 0; j < temp->GetNLinkRecords (); j++)
-        {
-          DSRRoutingLinkRecord *lr = temp->GetLinkRecord (j);
-          if ( lr->GetLinkType () == DSRRoutingLinkRecord::TransitNetwork &&
-               lr->GetLinkData () == addr)
-            {
-              return temp;
-            }
-        }
+      return i->second;
     }
   return 0;
 }
@@ -603,7 +735,9 @@ DSRRouteManagerNSDB::GetNumNetDevices () const
 
 DSRRouteManagerImpl::DSRRouteManagerImpl () 
   :
-    m_spfroot (0)
+    m_updateIncremental (true),
+    m_keepSPFTrees (false),
+    m_writeNetworkRoutes (true)
 {
   NS_LOG_FUNCTION (this);
   m_lsdb = new DSRRouteManagerLSDB ();
@@ -627,6 +761,7 @@ DSRRouteManagerImpl::DebugUseLsdb (DSRRouteManagerLSDB* lsdb)
       delete m_lsdb;
     }
   m_lsdb = lsdb;
+  BuildSPFGraph ();
 }
 
 void
@@ -643,19 +778,12 @@ DSRRouteManagerImpl::DeleteDSRRoutes ()
           continue;
         }
       Ptr<Ipv4DSRRouting> gr = router->GetRoutingProtocol ();
-      uint32_t j = 0;
-      uint32_t nRoutes = gr->GetNRoutes ();
       NS_LOG_LOGIC ("Deleting " << gr->GetNRoutes ()<< " routes from node " << node->GetId ());
-      // Each time we delete route 0, the route index shifts downward
-      // We can delete all routes if we delete the route numbered 0
-      // nRoutes times
-      for (j = 0; j < nRoutes; j++)
-        {
-          NS_LOG_LOGIC ("Deleting global route " << j << " from node " << node->GetId ());
-          gr->RemoveRoute (0);
-        }
-      NS_LOG_LOGIC ("Deleted " << j << " global routes from node "<< node->GetId ());
+      gr->RemoveAllRoutes ();
     }
+  m_spfTrees.clear ();
+  m_spfResults.clear ();
+  m_graph = SPFGraph ();
   if (m_lsdb)
     {
       NS_LOG_LOGIC ("Deleting LSDB, creating new one");
@@ -677,6 +805,10 @@ void
 DSRRouteManagerImpl::BuildDSRRoutingDatabase () 
 {
   NS_LOG_FUNCTION (this);
+  DsrRouteProfileScope profile (DsrRouteProfile::BUILD_DATABASE);
+  m_routers.clear ();
+  m_addresses.clear ();
+  m_spfResults.clear ();
 //
 // Walk the list of nodes looking for the DSRRouter Interface.  Nodes with
 // global router interfaces are, not too surprisingly, our routers.
@@ -684,15 +816,46 @@ DSRRouteManagerImpl::BuildDSRRoutingDatabase ()
   NodeList::Iterator listEnd = NodeList::End ();
   for (NodeList::Iterator i = NodeList::Begin (); i != listEnd; i++)
     {
-      Ptr<Node> node = *i;
-      Ptr<DSRRouter> rtr = node->GetObject<DSRRouter> ();
+      AddNodeToDatabase (*i);
+    }
+  BuildSPFGraph ();
+}
+
+void
+DSRRouteManagerImpl::AddNodeToDatabase (Ptr<Node> node)
+{
+  NS_LOG_FUNCTION (this << node->GetId ());
 //
-// Ignore nodes that aren't participating in routing.
+// Index the interface addresses of every node, so that the node on the far
+// side of a link is found without walking the list of nodes again.
 //
-      if (!rtr)
+  Ptr<Ipv4> ipv4 = node->GetObject<Ipv4> ();
+  if (ipv4)
+    {
+      for (uint32_t j = 0; j < ipv4->GetNInterfaces (); j++)
         {
-          continue;
+          if (ipv4->GetNAddresses (j) == 0)
+            {
+              continue;
+            }
+          Ipv4Address addr = ipv4->GetAddress (j, 0).GetLocal ();
+          if (!addr.IsLocalhost ())
+            {
+              AddressEntry entry;
+              entry.node = node;
+              entry.interface = j;
+              m_addresses.insert (std::make_pair (addr, entry));
+            }
         }
+    }
+  Ptr<DSRRouter> rtr = node->GetObject<DSRRouter> ();
+//
+// Ignore nodes that aren't participating in routing.
+//
+  if (!rtr)
+    {
+      return;
+    }
 //
 // You must call DiscoverLSAs () before trying to use any routing info or to
 // update LSAs.  DiscoverLSAs () drives the process of discovering routes in
@@ -701,73 +864,407 @@ DSRRouteManagerImpl::BuildDSRRoutingDatabase ()
 // DiscoverLSAs () will get zero as the number since no routes have been 
 // found.
 //
-      Ptr<Ipv4DSRRouting> grouting = rtr->GetRoutingProtocol ();
-      uint32_t numLSAs = rtr->DiscoverLSAs ();
-      NS_LOG_LOGIC ("Found " << numLSAs << " LSAs");
-
-      for (uint32_t j = 0; j < numLSAs; ++j)
+  Ptr<Ipv4DSRRouting> grouting = rtr->GetRoutingProtocol ();
+//
+// Remember where the routes of this router go, so that the SPF calculations
+// do not have to walk the list of nodes again for every vertex.
+//
+  RouterEntry &entry = m_routers[rtr->GetRouterId ()];
+  entry.node = node;
+  entry.routing = grouting;
+  entry.ipv4 = ipv4;
+  entry.addresses.clear ();
+  for (uint32_t j = 0; ipv4 && j < ipv4->GetNInterfaces (); j++)
+    {
+      for (uint32_t k = 0; k < ipv4->GetNAddresses (j); k++)
         {
-          DSRRoutingLSA* lsa = new DSRRoutingLSA ();
+          entry.addresses.push_back (std::make_pair (j, ipv4->GetAddress (j, k).GetLocal ()));
+        }
+    }
+  uint32_t numLSAs = rtr->DiscoverLSAs ();
+  NS_LOG_LOGIC ("Found " << numLSAs << " LSAs");
+
+  for (uint32_t j = 0; j < numLSAs; ++j)
+    {
+      DSRRoutingLSA* lsa = new DSRRoutingLSA ();
 //
 // This is the call to actually fetch a Link State Advertisement from the 
 // router.
 //
-          rtr->GetLSA (j, *lsa);
-          NS_LOG_LOGIC (*lsa);
+      rtr->GetLSA (j, *lsa);
+      NS_LOG_LOGIC (*lsa);
 //
 // Write the newly discovered link state advertisement to the database.
 //
-          m_lsdb->Insert (lsa->GetLinkStateId (), lsa); 
-        }
+      m_lsdb->Insert (lsa->GetLinkStateId (), lsa);
     }
 }
 
 //
-// For each node that is a global router (which is determined by the presence
-// of an aggregated DSRRouter interface), run the Dijkstra SPF calculation
-// on the database rooted at that router, and populate the node forwarding
-// tables.
-//
-// This function parallels RFC2328, Section 16.1.1, and quagga ospfd
-//
-// This calculation yields the set of intra-area routes associated
-// with an area (called hereafter Area A).  A router calculates the
-// shortest-path tree using itself as the root.  The formation
-// of the shortest path tree is done here in two stages.  In the
-// first stage, only links between routers and transit networks are
-// considered.  Using the Dijkstra algorithm, a tree is formed from
-// this subset of the link state database.  In the second stage,
-// leaves are added to the tree by considering the links to stub
-// networks.
-//
-// The area's link state database is represented as a directed graph.
-// The graph's vertices are routers, transit networks and stub networks.
-//
-// The first stage of the procedure (i.e., the Dijkstra algorithm)
-// can now be summarized as follows. At each iteration of the
-// algorithm, there is a list of candidate vertices.  Paths from
-// the root to these vertices have been found, but not necessarily
-// the shortest ones.  However, the paths to the candidate vertex
-// that is closest to the root are guaranteed to be shortest; this
-// vertex is added to the shortest-path tree, removed from the
-// candidate list, and its adjacent vertices are examined for
-// possible addition to/modification of the candidate list.  The
-// algorithm then iterates again.  It terminates when the candidate
-// list becomes empty. 
+// An interface event on a node changes the LSAs of that node, and those of
+// the nodes on the other side of its channels: a point-to-point link record
+// needs the remote interface up, and the routers on a broadcast channel
+// elect its designated router among themselves.  Bridges extend a broadcast
+// segment over several channels, so they are not followed.
 //
-void
-DSRRouteManagerImpl::InitializeRoutes ()
+bool
+DSRRouteManagerImpl::CollectDirtyNodes (std::set<uint32_t> &nodes) const
 {
   NS_LOG_FUNCTION (this);
-//
-// Walk the list of nodes in the system.
-//
-  NS_LOG_INFO ("About to start SPF calculation");
-  NodeList::Iterator listEnd = NodeList::End ();
-  for (NodeList::Iterator i = NodeList::Begin (); i != listEnd; i++)
+  if (m_dirtyNodes.empty ())
     {
-      Ptr<Node> node = *i;
-      //
+      return false;
+    }
+  for (std::set<uint32_t>::const_iterator n = m_dirtyNodes.begin (); n != m_dirtyNodes.end (); n++)
+    {
+      Ptr<Node> node = NodeList::GetNode (*n);
+      nodes.insert (*n);
+      for (uint32_t i = 0; i < node->GetNDevices (); i++)
+        {
+          Ptr<Channel> channel = node->GetDevice (i)->GetChannel ();
+          if (channel == 0)
+            {
+              continue;
+            }
+          for (uint32_t j = 0; j < channel->GetNDevices (); j++)
+            {
+              Ptr<Node> remote = channel->GetDevice (j)->GetNode ();
+              if (!nodes.insert (remote->GetId ()).second)
+                {
+                  continue;
+                }
+              for (uint32_t k = 0; k < remote->GetNDevices (); k++)
+                {
+                  if (remote->GetDevice (k)->IsBridge ())
+                    {
+                      NS_LOG_LOGIC ("Bridge on node " << remote->GetId ());
+                      return false;
+                    }
+                }
+            }
+        }
+    }
+  return true;
+}
+
+bool
+DSRRouteManagerImpl::UpdateDSRRoutingDatabase (const std::set<uint32_t> &nodes,
+                                               std::vector<DSRRoutingLSA *> &removed)
+{
+  NS_LOG_FUNCTION (this << nodes.size ());
+  m_spfResults.clear ();
+  std::set<Ipv4Address> routers;
+  for (std::set<uint32_t>::const_iterator n = nodes.begin (); n != nodes.end (); n++)
+    {
+      Ptr<DSRRouter> rtr = NodeList::GetNode (*n)->GetObject<DSRRouter> ();
+      if (rtr)
+        {
+          routers.insert (rtr->GetRouterId ());
+          m_routers.erase (rtr->GetRouterId ());
+        }
+    }
+  for (AddressIndex_t::iterator a = m_addresses.begin (); a != m_addresses.end (); )
+    {
+      if (nodes.count (a->second.node->GetId ()) != 0)
+        {
+          a = m_addresses.erase (a);
+        }
+      else
+        {
+          a++;
+        }
+    }
+  m_lsdb->Remove (routers, removed);
+  for (std::set<uint32_t>::const_iterator n = nodes.begin (); n != nodes.end (); n++)
+    {
+      AddNodeToDatabase (NodeList::GetNode (*n));
+    }
+  bool moved = m_lsdb->Compact ();
+  BuildSPFGraph ();
+  return !moved;
+}
+
+/**
+ * \brief Add a word to a 64 bit FNV-1a hash, byte by byte.
+ *
+ * \param hash the hash so far
+ * \param word the word
+ * \returns the new hash
+ */
+static uint64_t
+HashWord (uint64_t hash, uint32_t word)
+{
+  for (uint32_t i = 0; i < 4; i++)
+    {
+      hash ^= (word >> (8 * i)) & 0xff;
+      hash *= 1099511628211ULL;
+    }
+  return hash;
+}
+
+uint64_t
+DSRRouteManagerImpl::GetLsdbHash (void) const
+{
+  NS_LOG_FUNCTION (this);
+  uint64_t hash = 14695981039346656037ULL;
+  hash = HashWord (hash, m_lsdb->GetNumLSAs ());
+  for (uint32_t i = 0; i < m_lsdb->GetNumLSAs (); i++)
+    {
+      DSRRoutingLSA *lsa = m_lsdb->GetLSAByIndex (i);
+      hash = HashWord (hash, lsa->GetLSType ());
+      hash = HashWord (hash, lsa->GetLinkStateId ().Get ());
+      hash = HashWord (hash, lsa->GetAdvertisingRouter ().Get ());
+      hash = HashWord (hash, lsa->GetNetworkLSANetworkMask ().Get ());
+      hash = HashWord (hash, lsa->GetNLinkRecords ());
+      for (uint32_t j = 0; j < lsa->GetNLinkRecords (); j++)
+        {
+          DSRRoutingLinkRecord *l = lsa->GetLinkRecord (j);
+          hash = HashWord (hash, l->GetLinkType ());
+          hash = HashWord (hash, l->GetLinkId ().Get ());
+          hash = HashWord (hash, l->GetLinkData ().Get ());
+          hash = HashWord (hash, l->GetMetric ());
+        }
+      hash = HashWord (hash, lsa->GetNAttachedRouters ());
+      for (uint32_t j = 0; j < lsa->GetNAttachedRouters (); j++)
+        {
+          hash = HashWord (hash, lsa->GetAttachedRouter (j).Get ());
+        }
+    }
+  hash = HashWord (hash, m_lsdb->GetNumExtLSAs ());
+  for (uint32_t i = 0; i < m_lsdb->GetNumExtLSAs (); i++)
+    {
+      DSRRoutingLSA *extlsa = m_lsdb->GetExtLSA (i);
+      hash = HashWord (hash, extlsa->GetLinkStateId ().Get ());
+      hash = HashWord (hash, extlsa->GetAdvertisingRouter ().Get ());
+      hash = HashWord (hash, extlsa->GetNetworkLSANetworkMask ().Get ());
+    }
+//
+// The routes name outgoing interfaces by index, which the LSAs do not carry.
+//
+  hash = HashWord (hash, m_routers.size ());
+  for (RouterIndex_t::const_iterator r = m_routers.begin (); r != m_routers.end (); r++)
+    {
+      hash = HashWord (hash, r->first.Get ());
+      hash = HashWord (hash, r->second.node->GetId ());
+      hash = HashWord (hash, r->second.addresses.size ());
+      for (uint32_t j = 0; j < r->second.addresses.size (); j++)
+        {
+          hash = HashWord (hash, r->second.addresses[j].first);
+          hash = HashWord (hash, r->second.addresses[j].second.Get ());
+        }
+    }
+  return hash;
+}
+
+const DSRRouteManagerImpl::RouterEntry *
+DSRRouteManagerImpl::LookupRouter (Ipv4Address routerId) const
+{
+  RouterIndex_t::const_iterator it = m_routers.find (routerId);
+  if (it == m_routers.end ())
+    {
+      NS_LOG_LOGIC ("No DSRRouter with router ID " << routerId);
+      return 0;
+    }
+  return &it->second;
+}
+
+const uint32_t DSRRouteManagerImpl::SPFGraph::NO_VERTEX;
+
+//
+// Lay the LSDB out as arrays indexed by LSA, so that the SPF calculations
+// follow the links by index rather than by looking the far end of every link
+// up in the LSDB maps, once per link and per root.  Everything the root
+// vertex needs from a link -- the link record of the far end back to it and
+// the outgoing interface -- is found here once as well.
+//
+void
+DSRRouteManagerImpl::BuildSPFGraph (void)
+{
+  NS_LOG_FUNCTION (this);
+  SPFGraph &g = m_graph;
+  uint32_t n = m_lsdb->GetNumLSAs ();
+  g.lsas.resize (n);
+  g.edgeStart.assign (1, 0);
+  g.stubStart.assign (1, 0);
+  g.edges.clear ();
+  g.stubs.clear ();
+  g.externals.clear ();
+
+  for (uint32_t i = 0; i < n; i++)
+    {
+      DSRRoutingLSA *lsa = m_lsdb->GetLSAByIndex (i);
+      g.lsas[i] = lsa;
+      if (lsa->GetLSType () == DSRRoutingLSA::RouterLSA)
+        {
+          const RouterEntry *rtr = LookupRouter (lsa->GetLinkStateId ());
+          for (uint32_t j = 0; j < lsa->GetNLinkRecords (); j++)
+            {
+              DSRRoutingLinkRecord *l = lsa->GetLinkRecord (j);
+              if (l->GetLinkType () == DSRRoutingLinkRecord::StubNetwork)
+                {
+                  g.stubs.push_back (l);
+                  continue;
+                }
+              NS_ASSERT_MSG (l->GetLinkType () == DSRRoutingLinkRecord::PointToPoint
+                             || l->GetLinkType () == DSRRoutingLinkRecord::TransitNetwork,
+                             "illegal Link Type");
+              SPFGraph::Edge edge;
+              edge.target = SPFGraph::NO_VERTEX;
+              edge.metric = l->GetMetric ();
+              edge.interface = -1;
+              edge.record = l;
+              edge.reverse = 0;
+              DSRRoutingLSA *w_lsa = m_lsdb->GetLSA (l->GetLinkId ());
+              if (w_lsa)
+                {
+                  edge.target = w_lsa->GetIndex ();
+                  edge.reverse = FindLinkRecord (w_lsa, lsa->GetLinkStateId ());
+                  if (w_lsa->GetLSType () == DSRRoutingLSA::NetworkLSA)
+                    {
+                      edge.interface = FindInterfaceForPrefix (rtr, w_lsa->GetLinkStateId (),
+                                                               w_lsa->GetNetworkLSANetworkMask ());
+                    }
+                  else
+                    {
+                      edge.interface = FindInterfaceForPrefix (rtr, l->GetLinkData (),
+                                                               Ipv4Mask ("255.255.255.255"));
+                    }
+                }
+              g.edges.push_back (edge);
+            }
+        }
+      else if (lsa->GetLSType () == DSRRoutingLSA::NetworkLSA)
+        {
+          for (uint32_t j = 0; j < lsa->GetNAttachedRouters (); j++)
+            {
+              DSRRoutingLSA *w_lsa = m_lsdb->GetLSAByLinkData (lsa->GetAttachedRouter (j));
+              if (!w_lsa)
+                {
+                  continue;
+                }
+              SPFGraph::Edge edge;
+              edge.target = w_lsa->GetIndex ();
+              edge.metric = 0;
+              edge.interface = -1;
+              edge.record = 0;
+              edge.reverse = FindLinkRecord (w_lsa, lsa->GetLinkStateId ());
+              g.edges.push_back (edge);
+            }
+        }
+      g.edgeStart.push_back (g.edges.size ());
+      g.stubStart.push_back (g.stubs.size ());
+    }
+
+  for (uint32_t i = 0; i < m_lsdb->GetNumExtLSAs (); i++)
+    {
+      DSRRoutingLSA *extlsa = m_lsdb->GetExtLSA (i);
+      DSRRoutingLSA *rlsa = m_lsdb->GetLSA (extlsa->GetAdvertisingRouter ());
+      uint32_t advertiser = SPFGraph::NO_VERTEX;
+      if (rlsa && rlsa->GetLSType () == DSRRoutingLSA::RouterLSA)
+        {
+          advertiser = rlsa->GetIndex ();
+        }
+      g.externals.push_back (std::make_pair (extlsa, advertiser));
+    }
+  NS_LOG_LOGIC ("SPF graph of " << n << " vertices, " << g.edges.size () << " edges, " <<
+                g.stubs.size () << " stubs and " << g.externals.size () << " externals");
+}
+
+DSRRoutingLinkRecord *
+DSRRouteManagerImpl::FindLinkRecord (DSRRoutingLSA *lsa, Ipv4Address linkId) const
+{
+  for (uint32_t i = 0; i < lsa->GetNLinkRecords (); i++)
+    {
+      DSRRoutingLinkRecord *l = lsa->GetLinkRecord (i);
+      if (l->GetLinkId () == linkId)
+        {
+          return l;
+        }
+    }
+  return 0;
+}
+
+//
+// For each node that is a global router (which is determined by the presence
+// of an aggregated DSRRouter interface), run the Dijkstra SPF calculation
+// on the database rooted at that router, and populate the node forwarding
+// tables.
+//
+// This function parallels RFC2328, Section 16.1.1, and quagga ospfd
+//
+// This calculation yields the set of intra-area routes associated
+// with an area (called hereafter Area A).  A router calculates the
+// shortest-path tree using itself as the root.  The formation
+// of the shortest path tree is done here in two stages.  In the
+// first stage, only links between routers and transit networks are
+// considered.  Using the Dijkstra algorithm, a tree is formed from
+// this subset of the link state database.  In the second stage,
+// leaves are added to the tree by considering the links to stub
+// networks.
+//
+// The area's link state database is represented as a directed graph.
+// The graph's vertices are routers, transit networks and stub networks.
+//
+// The first stage of the procedure (i.e., the Dijkstra algorithm)
+// can now be summarized as follows. At each iteration of the
+// algorithm, there is a list of candidate vertices.  Paths from
+// the root to these vertices have been found, but not necessarily
+// the shortest ones.  However, the paths to the candidate vertex
+// that is closest to the root are guaranteed to be shortest; this
+// vertex is added to the shortest-path tree, removed from the
+// candidate list, and its adjacent vertices are examined for
+// possible addition to/modification of the candidate list.  The
+// algorithm then iterates again.  It terminates when the candidate
+// list becomes empty. 
+//
+void
+DSRRouteManagerImpl::InitializeRoutes ()
+{
+  NS_LOG_FUNCTION (this);
+  DsrRouteProfileScope profile (DsrRouteProfile::INITIALIZE_ROUTES);
+//
+// The SPF trees are only kept for UpdateRoutes when some router recomputes
+// its routes incrementally; they take memory in the square of the routers.
+//
+  m_keepSPFTrees = false;
+  for (RouterIndex_t::const_iterator n = m_routers.begin (); !m_keepSPFTrees && n != m_routers.end (); n++)
+    {
+      m_keepSPFTrees = n->second.routing && n->second.routing->IsIncrementalRecompute ();
+    }
+//
+// Walk the list of nodes in the system.
+//
+  NS_LOG_INFO ("About to start SPF calculation");
+  NodeList::Iterator listEnd = NodeList::End ();
+//
+// Compute the trees of all the neighbors first, possibly in parallel; the
+// loop below then only installs the routes.
+//
+  std::vector<Ipv4Address> roots;
+  for (NodeList::Iterator i = NodeList::Begin (); i != listEnd; i++)
+    {
+      Ptr<DSRRouter> rtr = (*i)->GetObject<DSRRouter> ();
+      if (rtr == 0 || (*i)->GetSystemId () != Simulator::GetSystemId ())
+        {
+          continue;
+        }
+      DSRRoutingLSA *lsa = m_lsdb->GetLSA (rtr->GetRouterId ());
+      for (uint32_t j = 0; lsa && j < lsa->GetNLinkRecords (); j++)
+        {
+          DSRRoutingLinkRecord *l = lsa->GetLinkRecord (j);
+          if (l->GetLinkType () == DSRRoutingLinkRecord::PointToPoint
+              || l->GetLinkType () == DSRRoutingLinkRecord::TransitNetwork)
+            {
+              roots.push_back (l->GetLinkId ());
+            }
+        }
+    }
+  SPFCalculateTrees (roots);
+
+  for (NodeList::Iterator i = NodeList::Begin (); i != listEnd; i++)
+    {
+      Ptr<Node> node = *i;
+      //
       // Look for the DSRRouter interface that indicates that the node is
       // participating in routing.
       //
@@ -785,11 +1282,11 @@ DSRRouteManagerImpl::InitializeRoutes ()
       // if the node has a DSR router interface, then run the DSR routing
       // algorithms.
       //
-        DSRVertex *v;
+        DSRVertex vertex (m_lsdb->GetLSA(rtr->GetRouterId ()));
+        DSRVertex *v = &vertex;
         DSRRoutingLSA* w_lsa = 0;
         DSRRoutingLinkRecord *l = 0;
         uint32_t numRecordsInVertex = 0;
-        v = new DSRVertex (m_lsdb->GetLSA(rtr->GetRouterId ()));
         //
         // V points to a Router-LSA or Network-LSA
         // Loop over the links in router LSA or attached routers in Network LSA
@@ -829,51 +1326,7 @@ DSRRouteManagerImpl::InitializeRoutes ()
               //
               if (l->GetLinkType () == DSRRoutingLinkRecord::PointToPoint)
                 {
-                  //
-                  // Lookup the link state advertisement of the new link -- we call it <w> in
-                  // the link state database.
-                  //
-                  w_lsa = m_lsdb->GetLSA (l->GetLinkId ());
-                  NS_ASSERT (w_lsa);
-                  NS_LOG_LOGIC ("Found a P2P record from " << 
-                                v->GetVertexId () << " to " << w_lsa->GetLinkStateId ());
-                  Ptr<DSRRouter> router = node->GetObject<DSRRouter> ();
-                  if (router == 0)
-                    {
-                      continue;
-                    }
-                  Ptr<Ipv4DSRRouting> gr = router->GetRoutingProtocol ();
-                  NS_ASSERT (gr);
-                  DSRRoutingLinkRecord *linkRemote =0;
-                  DSRVertex* w = new DSRVertex (w_lsa);
-                  linkRemote = SPFGetNextLink (w, v, linkRemote);
-                  Ptr<Ipv4> ipv4 = node->GetObject<Ipv4> ();
-                  int32_t Iface = ipv4->GetInterfaceForAddress (l->GetLinkData ());
-                  // std::cout << "The interface = " << Iface << std::endl;
-                  // gr->AddHostRouteTo (linkRemote->GetLinkData (), linkRemote->GetLinkData (), Iface, l->GetMetric ());
-
-                  // todo
-                  for (NodeList::Iterator j = NodeList::Begin (); j != listEnd; j++)
-                    {
-                      Ptr<Node> nextNode = *j;
-                      Ptr<Ipv4> nextIpv4 = nextNode->GetObject<Ipv4> ();
-                      for (uint32_t iter =0; iter < nextIpv4->GetNInterfaces (); iter ++)
-                        {
-                          Ipv4InterfaceAddress ifc = nextIpv4->GetAddress (iter,0);
-                          Ipv4Address addr = ifc.GetLocal ();
-                          if (addr == linkRemote->GetLinkData ())
-                            {
-                              std::cout << "true" << std::endl;
-                              for (uint32_t nIfc = 1; nIfc < nextIpv4->GetNInterfaces (); nIfc ++)
-                                {
-                                  gr->AddHostRouteTo (nextIpv4->GetAddress (nIfc,0).GetLocal (), linkRemote->GetLinkData (), Iface, l->GetMetric ());
-                                }
-                            }
-                        }
-                    }   
-
-
-                  SPFCalculate (w_lsa->GetLinkStateId (), rtr->GetRouterId (), linkRemote, Iface);
+                  InitializeRoutesOnLink (node, v, l);
                 }
                 else if (l->GetLinkType () == 
                           DSRRoutingLinkRecord::TransitNetwork)
@@ -894,103 +1347,479 @@ DSRRouteManagerImpl::InitializeRoutes ()
   NS_LOG_INFO ("Finished DSR-SPF calculation");
 }
 
+void
+DSRRouteManagerImpl::ScheduleRoutesUpdate (uint32_t nodeId, Time holdDown, bool incremental)
+{
+  NS_LOG_FUNCTION (this << nodeId << holdDown << incremental);
+  m_dirtyNodes.insert (nodeId);
+  if (m_updateEvent.IsRunning ())
+    {
+      m_updateIncremental = m_updateIncremental && incremental;
+      return;
+    }
+  m_updateIncremental = incremental;
+  m_updateEvent = Simulator::Schedule (holdDown, &DSRRouteManagerImpl::DoRoutesUpdate, this);
+}
+
+void
+DSRRouteManagerImpl::DoRoutesUpdate (void)
+{
+  NS_LOG_FUNCTION (this);
+  NS_LOG_INFO ("Recomputing routes for interface events on " << m_dirtyNodes.size () << " nodes");
+  DsrRouteProfile::Update ();
+  DsrRouteProfile::Reset ();
+  if (m_updateIncremental)
+    {
+      UpdateRoutes ();
+    }
+  else
+    {
+      DeleteDSRRoutes ();
+      BuildDSRRoutingDatabase ();
+      InitializeRoutes ();
+    }
+  m_dirtyNodes.clear ();
+  DsrRouteProfile::Write ();
+}
+
+void
+DSRRouteManagerImpl::InitializeRoutesOnLink (Ptr<Node> node, DSRVertex *v, DSRRoutingLinkRecord *l)
+{
+  NS_LOG_FUNCTION (this << node->GetId () << l->GetLinkId ());
 //
-// This method is derived from quagga ospf_spf_next ().  See RFC2328 Section 
-// 16.1 (2) for further details.
+// Lookup the link state advertisement of the new link -- we call it <w> in
+// the link state database.
 //
-// We're passed a parameter <v> that is a vertex which is already in the SPF
-// tree.  A vertex represents a router node.  We also get a reference to the
-// SPF candidate queue, which is a priority queue containing the shortest paths
-// to the networks we know about.
+  DSRRoutingLSA *w_lsa = m_lsdb->GetLSA (l->GetLinkId ());
+  NS_ASSERT (w_lsa);
+  NS_LOG_LOGIC ("Found a P2P record from " << 
+                v->GetVertexId () << " to " << w_lsa->GetLinkStateId ());
+  Ptr<DSRRouter> router = node->GetObject<DSRRouter> ();
+  if (router == 0)
+    {
+      return;
+    }
+  Ptr<Ipv4DSRRouting> gr = router->GetRoutingProtocol ();
+  NS_ASSERT (gr);
+  DSRRoutingLinkRecord *linkRemote =0;
+  DSRVertex w (w_lsa);
+  linkRemote = SPFGetNextLink (&w, v, linkRemote);
+  Ptr<Ipv4> ipv4 = node->GetObject<Ipv4> ();
+  int32_t Iface = ipv4->GetInterfaceForAddress (l->GetLinkData ());
+  // std::cout << "The interface = " << Iface << std::endl;
+  // gr->AddHostRouteTo (linkRemote->GetLinkData (), linkRemote->GetLinkData (), Iface, l->GetMetric ());
+
+  // host routes to all the addresses of the neighbor, through the link
+  AddressIndex_t::const_iterator neighbor = m_addresses.find (linkRemote->GetLinkData ());
+  if (neighbor != m_addresses.end ())
+    {
+      Ptr<Ipv4> nextIpv4 = neighbor->second.node->GetObject<Ipv4> ();
+      for (uint32_t nIfc = 1; nIfc < nextIpv4->GetNInterfaces (); nIfc ++)
+        {
+          gr->AddHostRouteTo (nextIpv4->GetAddress (nIfc,0).GetLocal (), linkRemote->GetLinkData (), Iface, l->GetMetric ());
+          DsrRouteProfile::Count (DsrRouteProfile::ENTRIES_INSTALLED);
+        }
+    }
+
+  SPFCalculate (w_lsa->GetLinkStateId (), v->GetVertexId (), linkRemote, Iface);
+}
+
 //
-// We examine the links in v's LSA and update the list of candidates with any
-// vertices not already on the list.  If a lower-cost path is found to a
-// vertex already on the candidate list, store the new (lower) cost.
+// Two LSAs describe the same links if they have the same link records, in
+// the same order (DSRRouter::DiscoverLSAs walks the devices of a node in a
+// fixed order).
 //
-void
-DSRRouteManagerImpl::SPFNext (DSRVertex* v, DsrCandidateQueue& candidate)
+static bool
+SameLinkRecord (const DSRRoutingLinkRecord *a, const DSRRoutingLinkRecord *b)
 {
-  NS_LOG_FUNCTION (this << v << &candidate);
+  return a->GetLinkType () == b->GetLinkType ()
+         && a->GetLinkId () == b->GetLinkId ()
+         && a->GetLinkData () == b->GetLinkData ()
+         && a->GetMetric () == b->GetMetric ();
+}
 
-  DSRVertex* w = 0;
-  DSRRoutingLSA* w_lsa = 0;
-  DSRRoutingLinkRecord *l = 0;
-  uint32_t distance = 0;
-  uint32_t numRecordsInVertex = 0;
+static bool
+HasLinkRecord (const DSRRoutingLSA *lsa, const DSRRoutingLinkRecord *l)
+{
+  if (lsa == 0)
+    {
+      return false;
+    }
+  for (uint32_t i = 0; i < lsa->GetNLinkRecords (); i++)
+    {
+      if (SameLinkRecord (lsa->GetLinkRecord (i), l))
+        {
+          return true;
+        }
+    }
+  return false;
+}
+
+static bool
+SameLSA (const DSRRoutingLSA *a, const DSRRoutingLSA *b)
+{
+  if (a == 0 || b == 0)
+    {
+      return a == b;
+    }
+  if (a->GetLSType () != b->GetLSType ()
+      || a->GetLinkStateId () != b->GetLinkStateId ()
+      || a->GetAdvertisingRouter () != b->GetAdvertisingRouter ()
+      || a->GetNetworkLSANetworkMask () != b->GetNetworkLSANetworkMask ()
+      || a->GetNLinkRecords () != b->GetNLinkRecords ()
+      || a->GetNAttachedRouters () != b->GetNAttachedRouters ())
+    {
+      return false;
+    }
+  for (uint32_t i = 0; i < a->GetNLinkRecords (); i++)
+    {
+      if (!SameLinkRecord (a->GetLinkRecord (i), b->GetLinkRecord (i)))
+        {
+          return false;
+        }
+    }
+  for (uint32_t i = 0; i < a->GetNAttachedRouters (); i++)
+    {
+      if (a->GetAttachedRouter (i) != b->GetAttachedRouter (i))
+        {
+          return false;
+        }
+    }
+  return true;
+}
+
+static void
+DeleteLSAs (std::vector<DSRRoutingLSA *> &lsas)
+{
+  for (uint32_t i = 0; i < lsas.size (); i++)
+    {
+      delete lsas[i];
+    }
+  lsas.clear ();
+}
+
+static bool
+HasTransitLink (const DSRRoutingLSA *lsa)
+{
+  for (uint32_t i = 0; lsa && i < lsa->GetNLinkRecords (); i++)
+    {
+      if (lsa->GetLinkRecord (i)->GetLinkType () == DSRRoutingLinkRecord::TransitNetwork)
+        {
+          return true;
+        }
+    }
+  return false;
+}
+
+bool
+DSRRouteManagerImpl::SPFTreeAffected (Ipv4Address root, const SPFTree &tree,
+                                      DSRRoutingLSA *oldLsa, DSRRoutingLSA *newLsa) const
+{
+  Ipv4Address x = newLsa ? newLsa->GetLinkStateId () : oldLsa->GetLinkStateId ();
+  if (x == root)
+    {
+      return true;
+    }
+  uint32_t dx = TreeDistance (tree, x);
+  bool reached = dx != DISTINFINITY;
+  if (reached && tree.truncated)
+    {
+      return true;
+    }
 //
-// V points to a Router-LSA or Network-LSA
-// Loop over the links in router LSA or attached routers in Network LSA
+// Every router the tree reaches gives the initial roots a host route to the
+// local address of each of its point-to-point links, whether or not the link
+// is on a shortest path (see SPFIntraAddRouter), and its stub links become
+// network routes of the root.  So any point-to-point or stub link which
+// appears on or disappears from a reached router affects the tree.
 //
-  if (v->GetVertexType () == DSRVertex::VertexRouter)
+  for (uint32_t i = 0; reached && oldLsa && i < oldLsa->GetNLinkRecords (); i++)
+    {
+      if (!HasLinkRecord (newLsa, oldLsa->GetLinkRecord (i)))
+        {
+          return true;
+        }
+    }
+//
+// A router out of the tree only matters if one of its new links reaches a
+// vertex of the tree, which may then reach it.
+//
+  for (uint32_t i = 0; newLsa && i < newLsa->GetNLinkRecords (); i++)
     {
-      numRecordsInVertex = v->GetLSA ()->GetNLinkRecords (); 
+      DSRRoutingLinkRecord *l = newLsa->GetLinkRecord (i);
+      if (HasLinkRecord (oldLsa, l))
+        {
+          continue;
+        }
+      if (reached)
+        {
+          return true;
+        }
+      if (l->GetLinkType () == DSRRoutingLinkRecord::PointToPoint
+          && TreeDistance (tree, l->GetLinkId ()) != DISTINFINITY)
+        {
+          return true;
+        }
     }
-  if (v->GetVertexType () == DSRVertex::VertexNetwork)
+  return false;
+}
+
+uint32_t
+DSRRouteManagerImpl::TreeDistance (const SPFTree &tree, Ipv4Address id) const
+{
+  DSRRoutingLSA *lsa = m_lsdb->GetLSA (id);
+  if (lsa == 0 || lsa->GetIndex () >= tree.distance.size ())
     {
-      numRecordsInVertex = v->GetLSA ()->GetNAttachedRouters (); 
+      return DISTINFINITY;
     }
+  return tree.distance[lsa->GetIndex ()];
+}
 
-  for (uint32_t i = 0; i < numRecordsInVertex; i++)
+void
+DSRRouteManagerImpl::UpdateRoutes ()
+{
+  NS_LOG_FUNCTION (this);
+  DsrRouteProfileScope profile (DsrRouteProfile::UPDATE_ROUTES);
+  if (m_spfTrees.empty ())
     {
-// Get w_lsa:  In case of V is Router-LSA
-      if (v->GetVertexType () == DSRVertex::VertexRouter) 
+      DeleteDSRRoutes ();
+      BuildDSRRoutingDatabase ();
+      InitializeRoutes ();
+      return;
+    }
+
+//
+// Discover again the LSAs of the nodes with interface events and of their
+// neighbors only; the LSAs of the other routers can not have changed.
+//
+  std::set<uint32_t> nodes;
+  if (!CollectDirtyNodes (nodes))
+    {
+      NS_LOG_LOGIC ("No interface event recorded or bridges involved, discovering all LSAs");
+      nodes.clear ();
+      for (uint32_t i = 0; i < NodeList::GetNNodes (); i++)
         {
-          NS_LOG_LOGIC ("Examining link " << i << " of " << 
-                        v->GetVertexId () << "'s " <<
-                        v->GetLSA ()->GetNLinkRecords () << " link records");
+          nodes.insert (i);
+        }
+    }
+  std::vector<DSRRoutingLSA *> removed;
+  bool full = !UpdateDSRRoutingDatabase (nodes, removed);
+
 //
-// (a) If this is a link to a stub network, examine the next link in V's LSA.
-// Links to stub networks will be considered in the second stage of the
-// shortest path calculation.
+// Collect the routers whose LSA changed.  Routes through transit networks
+// are installed with interface numbers which are not the outgoing interface
+// (see InitializeRoutes), so they can not be replaced selectively; neither
+// can AS external routes, which every tree installs.  The trees are indexed
+// by LSA, so they are of no use either once the LSAs were indexed again.
 //
-          l = v->GetLSA ()->GetLinkRecord (i);
-          NS_ASSERT (l != 0);
-          if (l->GetLinkType () == DSRRoutingLinkRecord::StubNetwork)
-            {
-              NS_LOG_LOGIC ("Found a Stub record to " << l->GetLinkId ());
-              continue;
-            }
+  std::map<Ipv4Address, DSRRoutingLSA *> oldLsas;
+  std::vector<DSRRoutingLSA *> oldExtLsas;
+  for (uint32_t i = 0; i < removed.size (); i++)
+    {
+      if (removed[i]->GetLSType () == DSRRoutingLSA::ASExternalLSAs)
+        {
+          oldExtLsas.push_back (removed[i]);
+        }
+      else
+        {
+          oldLsas[removed[i]->GetLinkStateId ()] = removed[i];
+          full = full || HasTransitLink (removed[i]);
+        }
+    }
+  std::vector<DSRRoutingLSA *> newExtLsas;
+  for (uint32_t i = 0; i < m_lsdb->GetNumExtLSAs (); i++)
+    {
+      DSRRoutingLSA *lsa = m_lsdb->GetExtLSA (i);
+      const RouterEntry *r = LookupRouter (lsa->GetAdvertisingRouter ());
+      if (r && nodes.count (r->node->GetId ()) != 0)
+        {
+          newExtLsas.push_back (lsa);
+        }
+    }
+  full = full || oldExtLsas.size () != newExtLsas.size ();
+  for (uint32_t i = 0; !full && i < newExtLsas.size (); i++)
+    {
+      full = !SameLSA (oldExtLsas[i], newExtLsas[i]);
+    }
+  for (uint32_t i = 0; !full && i < m_lsdb->GetNumLSAs (); i++)
+    {
+      full = HasTransitLink (m_lsdb->GetLSAByIndex (i));
+    }
+  std::vector<std::pair<DSRRoutingLSA *, DSRRoutingLSA *> > changed;
+  std::set<Ipv4Address> changedRouters;
+  for (std::set<uint32_t>::const_iterator n = nodes.begin (); !full && n != nodes.end (); n++)
+    {
+      Ptr<DSRRouter> rtr = NodeList::GetNode (*n)->GetObject<DSRRouter> ();
+      if (rtr == 0)
+        {
+          continue;
+        }
+      Ipv4Address id = rtr->GetRouterId ();
+      std::map<Ipv4Address, DSRRoutingLSA *>::const_iterator o = oldLsas.find (id);
+      DSRRoutingLSA *oldLsa = o == oldLsas.end () ? 0 : o->second;
+      DSRRoutingLSA *newLsa = m_lsdb->GetLSA (id);
+      if (!SameLSA (oldLsa, newLsa))
+        {
+          changed.push_back (std::make_pair (oldLsa, newLsa));
+          changedRouters.insert (id);
+        }
+    }
+  if (full)
+    {
+      NS_LOG_LOGIC ("Transit networks or external LSAs involved, recomputing all routes");
+      DeleteLSAs (removed);
+      DeleteDSRRoutes ();
+      BuildDSRRoutingDatabase ();
+      InitializeRoutes ();
+      return;
+    }
+  if (changed.empty ())
+    {
+      NS_LOG_LOGIC ("No LSA changed");
+      DeleteLSAs (removed);
+      return;
+    }
+
 //
-// (b) Otherwise, W is a transit vertex (router or transit network).  Look up
-// the vertex W's LSA (router-LSA or network-LSA) in Area A's link state
-// database. 
+// Find the roots whose tree may change.  Their trees are computed again for
+// every router which uses them, and their network routes are replaced.
 //
-          if (l->GetLinkType () == DSRRoutingLinkRecord::PointToPoint)
+  std::set<Ipv4Address> affected;
+  for (SPFTrees_t::const_iterator t = m_spfTrees.begin (); t != m_spfTrees.end (); t++)
+    {
+      for (uint32_t i = 0; i < changed.size (); i++)
+        {
+          if (SPFTreeAffected (t->first, t->second, changed[i].first, changed[i].second))
             {
+              affected.insert (t->first);
+              break;
+            }
+        }
+    }
+  for (std::set<Ipv4Address>::const_iterator r = changedRouters.begin (); r != changedRouters.end (); r++)
+    {
 //
-// Lookup the link state advertisement of the new link -- we call it <w> in
-// the link state database.
+// A router may have links to roots which had no tree yet.
 //
-              w_lsa = m_lsdb->GetLSA (l->GetLinkId ());
-              NS_ASSERT (w_lsa);
-              NS_LOG_LOGIC ("Found a P2P record from " << 
-                            v->GetVertexId () << " to " << w_lsa->GetLinkStateId ());
-            }
-          else if (l->GetLinkType () == 
-                   DSRRoutingLinkRecord::TransitNetwork)
+      DSRRoutingLSA *lsa = m_lsdb->GetLSA (*r);
+      for (uint32_t i = 0; lsa && i < lsa->GetNLinkRecords (); i++)
+        {
+          DSRRoutingLinkRecord *l = lsa->GetLinkRecord (i);
+          if (l->GetLinkType () == DSRRoutingLinkRecord::PointToPoint
+              && m_spfTrees.find (l->GetLinkId ()) == m_spfTrees.end ())
             {
-              w_lsa = m_lsdb->GetLSA (l->GetLinkId ());
-              NS_ASSERT (w_lsa);
-              NS_LOG_LOGIC ("Found a Transit record from " << 
-                            v->GetVertexId () << " to " << w_lsa->GetLinkStateId ());
+              affected.insert (l->GetLinkId ());
             }
-          else 
+        }
+    }
+  NS_LOG_LOGIC (changed.size () << " LSAs changed, " << affected.size () << " of " <<
+                m_spfTrees.size () << " SPF trees affected");
+  DeleteLSAs (removed);
+
+  for (std::set<Ipv4Address>::const_iterator r = affected.begin (); r != affected.end (); r++)
+    {
+      m_spfTrees.erase (*r);
+      const RouterEntry *n = LookupRouter (*r);
+      if (n)
+        {
+          n->routing->RemoveNetworkRoutes ();
+        }
+    }
+
+//
+// Replace the host routes of each router on the links to affected roots, or
+// on all of its links if its own LSA changed.
+//
+  uint32_t systemId = Simulator::GetSystemId ();
+  for (RouterIndex_t::const_iterator n = m_routers.begin (); n != m_routers.end (); n++)
+    {
+      Ptr<Node> node = n->second.node;
+      if (node->GetSystemId () != systemId)
+        {
+          continue;
+        }
+      DSRRoutingLSA *lsa = m_lsdb->GetLSA (n->first);
+      if (lsa == 0)
+        {
+          continue;
+        }
+      Ptr<Ipv4DSRRouting> gr = node->GetObject<DSRRouter> ()->GetRoutingProtocol ();
+      Ptr<Ipv4> ipv4 = node->GetObject<Ipv4> ();
+      bool changedRouter = changedRouters.count (n->first) != 0;
+      if (changedRouter)
+        {
+          for (uint32_t j = 0; j < ipv4->GetNInterfaces (); j++)
             {
-              NS_ASSERT_MSG (0, "illegal Link Type");
+              gr->RemoveHostRoutes (j);
             }
         }
-// Get w_lsa:  In case of V is Network-LSA
-      if (v->GetVertexType () == DSRVertex::VertexNetwork) 
+      DSRVertex vertex (lsa);
+      DSRVertex *v = &vertex;
+      for (uint32_t i = 0; i < lsa->GetNLinkRecords (); i++)
         {
-          w_lsa = m_lsdb->GetLSAByLinkData 
-              (v->GetLSA ()->GetAttachedRouter (i));
-          if (!w_lsa)
+          DSRRoutingLinkRecord *l = lsa->GetLinkRecord (i);
+          if (l->GetLinkType () != DSRRoutingLinkRecord::PointToPoint)
+            {
+              continue;
+            }
+          bool rootAffected = affected.count (l->GetLinkId ()) != 0;
+          if (!changedRouter && !rootAffected)
             {
               continue;
             }
-          NS_LOG_LOGIC ("Found a Network LSA from " << 
-                        v->GetVertexId () << " to " << w_lsa->GetLinkStateId ());
+          if (!changedRouter)
+            {
+              gr->RemoveHostRoutes (ipv4->GetInterfaceForAddress (l->GetLinkData ()));
+            }
+          m_writeNetworkRoutes = rootAffected;
+          InitializeRoutesOnLink (node, v, l);
         }
+      m_writeNetworkRoutes = true;
+    }
+}
+
+//
+// This method is derived from quagga ospf_spf_next ().  See RFC2328 Section 
+// 16.1 (2) for further details.
+//
+// We're passed a parameter <v> that is a vertex which is already in the SPF
+// tree.  A vertex represents a router node.  We also get a reference to the
+// SPF candidate queue, which is a priority queue containing the shortest paths
+// to the networks we know about.
+//
+// We examine the links in v's LSA and update the list of candidates with any
+// vertices not already on the list.  If a lower-cost path is found to a
+// vertex already on the candidate list, store the new (lower) cost.
+//
+void
+DSRRouteManagerImpl::SPFNext (SPFContext &ctx, DSRVertex* v, DsrCandidateQueue& candidate)
+{
+  NS_LOG_FUNCTION (this << v << &candidate);
+  DsrRouteProfileScope profile (DsrRouteProfile::SPF_NEXT);
+
+  DSRVertex* w = 0;
+  DSRRoutingLSA* w_lsa = 0;
+  uint32_t distance = 0;
+//
+// V points to a Router-LSA or Network-LSA
+// Loop over the links in router LSA or attached routers in Network LSA.
+// Links to stub networks are not among the edges of the graph; they will be
+// considered in the second stage of the shortest path calculation.
+//
+  const SPFGraph &g = m_graph;
+  uint32_t vi = v->GetLSA ()->GetIndex ();
+  for (uint32_t e = g.edgeStart[vi]; e < g.edgeStart[vi + 1]; e++)
+    {
+      const SPFGraph::Edge &edge = g.edges[e];
+//
+// W is a transit vertex (router or transit network).  Its LSA (router-LSA or
+// network-LSA) was looked up in Area A's link state database when the graph
+// was built.
+//
+      NS_ASSERT (edge.target != SPFGraph::NO_VERTEX);
+      w_lsa = g.lsas[edge.target];
+      NS_LOG_LOGIC ("Found a link from " << 
+                    v->GetVertexId () << " to " << w_lsa->GetLinkStateId ());
 
 // Note:  w_lsa at this point may be either RouterLSA or NetworkLSA
 //
@@ -1000,7 +1829,7 @@ DSRRouteManagerImpl::SPFNext (DSRVertex* v, DsrCandidateQueue& candidate)
 // If the link is to a router that is already in the shortest path first tree
 // then we have it covered -- ignore it.
 //
-      if (w_lsa->GetStatus () == DSRRoutingLSA::LSA_SPF_IN_SPFTREE) 
+      if (ctx.status[edge.target] == DSRRoutingLSA::LSA_SPF_IN_SPFTREE) 
         {
           NS_LOG_LOGIC ("Skipping ->  LSA "<< 
                         w_lsa->GetLinkStateId () << " already in SPF tree");
@@ -1010,22 +1839,14 @@ DSRRouteManagerImpl::SPFNext (DSRVertex* v, DsrCandidateQueue& candidate)
 // (d) Calculate the link state cost D of the resulting path from the root to 
 // vertex W.  D is equal to the sum of the link state cost of the (already 
 // calculated) shortest path to vertex V and the advertised cost of the link
-// between vertices V and W.
+// between vertices V and W.  Links from networks have no cost.
 //
-      if (v->GetLSA ()->GetLSType () == DSRRoutingLSA::RouterLSA)
-        {
-          NS_ASSERT (l != 0);
-          distance = v->GetDistanceFromRoot () + l->GetMetric ();
-        }
-      else
-        {
-          distance = v->GetDistanceFromRoot ();
-        }
+      distance = v->GetDistanceFromRoot () + edge.metric;
 
       NS_LOG_LOGIC ("Considering w_lsa " << w_lsa->GetLinkStateId ());
 
 // Is there already vertex w in candidate list?
-      if (w_lsa->GetStatus () == DSRRoutingLSA::LSA_SPF_NOT_EXPLORED)
+      if (ctx.status[edge.target] == DSRRoutingLSA::LSA_SPF_NOT_EXPLORED)
         {
 // Calculate nexthop to w
 // We need to figure out how to actually get to the new router represented
@@ -1034,15 +1855,16 @@ DSRRouteManagerImpl::SPFNext (DSRVertex* v, DsrCandidateQueue& candidate)
 // used to forward the packets.
 
 // prepare vertex w
-          w = new DSRVertex (w_lsa);
-          if (SPFNexthopCalculation (v, w, l, distance))
+          w = ctx.arena.Allocate (w_lsa);
+          if (SPFNexthopCalculation (ctx, v, w, edge, distance))
             {
-              w_lsa->SetStatus (DSRRoutingLSA::LSA_SPF_CANDIDATE);
+              ctx.status[edge.target] = DSRRoutingLSA::LSA_SPF_CANDIDATE;
 //
 // Push this new vertex onto the priority queue (ordered by distance from the
 // root node).
 //
               candidate.Push (w);
+              DsrRouteProfile::Count (DsrRouteProfile::VERTICES_PUSHED);
               NS_LOG_LOGIC ("Pushing " << 
                             w->GetVertexId () << ", parent vertexId: " <<
                             v->GetVertexId () << ", distance: " <<
@@ -1052,7 +1874,7 @@ DSRRouteManagerImpl::SPFNext (DSRVertex* v, DsrCandidateQueue& candidate)
             NS_ASSERT_MSG (0, "SPFNexthopCalculation never " 
                            << "return false, but it does now!");
         }
-      else if (w_lsa->GetStatus () == DSRRoutingLSA::LSA_SPF_CANDIDATE)
+      else if (ctx.status[edge.target] == DSRRoutingLSA::LSA_SPF_CANDIDATE)
         {
 //
 // We have already considered the link represented by <w>.  What wse have to
@@ -1068,7 +1890,7 @@ DSRRouteManagerImpl::SPFNext (DSRVertex* v, DsrCandidateQueue& candidate)
 * if we've found a shorter path.
 */
           DSRVertex* cw;
-          cw = candidate.Find (w_lsa->GetLinkStateId ());
+          cw = candidate.Find (w_lsa->GetIndex ());
           if (cw->GetDistanceFromRoot () < distance)
             {
 //
@@ -1097,16 +1919,13 @@ DSRRouteManagerImpl::SPFNext (DSRVertex* v, DsrCandidateQueue& candidate)
 // (ospf_spf.c::859), although the detail implementation
 // is very different from quagga (blame ns3::DSRRouteManagerImpl)
 
-// prepare vertex w
-              w = new DSRVertex (w_lsa);
-              SPFNexthopCalculation (v, w, l, distance);
+// prepare vertex w; it is only needed for the merge, and was the last
+// vertex allocated, so it goes back to the arena right away
+              w = ctx.arena.Allocate (w_lsa);
+              SPFNexthopCalculation (ctx, v, w, edge, distance);
               cw->MergeRootExitDirections (w);
               cw->MergeParent (w);
-// DSRVertexAddParent (w) is necessary as the destructor of 
-// DSRVertex checks if the vertex and its parent is linked
-// bidirectionally
-              DSRVertexAddParent (w);
-              delete w;
+              ctx.arena.Release (w);
             }
           else // cw->GetDistanceFromRoot () > w->GetDistanceFromRoot ()
             {
@@ -1118,13 +1937,13 @@ DSRRouteManagerImpl::SPFNext (DSRVertex* v, DsrCandidateQueue& candidate)
 // N.B. the nexthop_calculation is conditional, if it finds a valid nexthop
 // it will call spf_add_parents, which will flush the old parents
 //
-              if (SPFNexthopCalculation (v, cw, l, distance))
+              if (SPFNexthopCalculation (ctx, v, cw, edge, distance))
                 {
 //
 // If we've changed the cost to get to the vertex represented by <w>, we 
 // must reorder the priority queue keyed to that cost.
 //
-                  candidate.Reorder ();
+                  candidate.DecreaseKey (cw);
                 }
             } // new lower cost path found
         } // end W is already on the candidate list
@@ -1143,12 +1962,13 @@ DSRRouteManagerImpl::SPFNext (DSRVertex* v, DsrCandidateQueue& candidate)
 //
 int
 DSRRouteManagerImpl::SPFNexthopCalculation (
+  SPFContext &ctx,
   DSRVertex* v, 
   DSRVertex* w,
-  DSRRoutingLinkRecord* l,
+  const SPFGraph::Edge &edge,
   uint32_t distance)
 {
-  NS_LOG_FUNCTION (this << v << w << l << distance);
+  NS_LOG_FUNCTION (this << v << w << edge.record << distance);
 //
 // If w is a NetworkVertex, l should be null
 /*
@@ -1159,7 +1979,7 @@ DSRRouteManagerImpl::SPFNexthopCalculation (
 */
 
 //
-// The vertex m_spfroot is a distinguished vertex representing the node at
+// The vertex ctx.root is a distinguished vertex representing the node at
 // the root of the calculations.  That is, it is the node for which we are
 // calculating the routes.
 //
@@ -1181,7 +2001,7 @@ DSRRouteManagerImpl::SPFNexthopCalculation (
 // The point-to-point link information is only useful in this calculation when
 // we are examining the root node. 
 //
-  if (v == m_spfroot)
+  if (v == ctx.root)
     {
 //
 // In this case <v> is the root node, which means it is the starting point
@@ -1202,19 +2022,18 @@ DSRRouteManagerImpl::SPFNexthopCalculation (
 // address -- the next hop address to get from <v> to <w> and all networks 
 // accessed through that path.
 //
-// SPFGetNextLink () is a little odd.  used in this way it is just going to
-// return the link record describing the link from <w> to <v>.  Think of it as
-// SPFGetLink.
+// The graph keeps that record with the edge; it is the one SPFGetNextLink ()
+// would return first.
 //
-          NS_ASSERT (l);
-          DSRRoutingLinkRecord *linkRemote = 0;
-          linkRemote = SPFGetNextLink (w, v, linkRemote);
+          NS_ASSERT (edge.record);
+          DSRRoutingLinkRecord *linkRemote = edge.reverse;
+          NS_ASSERT (linkRemote);
 // 
-// At this point, <l> is the Global Router Link Record describing the point-
-// to point link from <v> to <w> from the perspective of <v>; and <linkRemote>
-// is the Global Router Link Record describing that same link from the 
-// perspective of <w> (back to <v>).  Now we can just copy the next hop 
-// address from the m_linkData member variable.
+// At this point, the record of the edge is the Global Router Link Record
+// describing the point-to point link from <v> to <w> from the perspective of
+// <v>; and <linkRemote> is the Global Router Link Record describing that same
+// link from the perspective of <w> (back to <v>).  Now we can just copy the
+// next hop address from the m_linkData member variable.
 // 
 // The next hop member variable we put in <w> has the sense "in order to get
 // from the root node to the host represented by vertex <w>, you have to send
@@ -1222,11 +2041,11 @@ DSRRouteManagerImpl::SPFNexthopCalculation (
 //
           Ipv4Address nextHop = linkRemote->GetLinkData ();
 // 
-// Now find the outgoing interface corresponding to the point to point link
-// from the perspective of <v> -- remember that <l> is the link "from"
-// <v> "to" <w>.
+// The outgoing interface corresponding to the point to point link from the
+// perspective of <v> -- the interface of the link data of the edge "from"
+// <v> "to" <w> -- was found when the graph was built.
 //
-          uint32_t outIf = FindOutgoingInterfaceId (l->GetLinkData ());
+          uint32_t outIf = edge.interface;
 
           w->SetRootExitDirection (nextHop, outIf);
           w->SetDistanceFromRoot (distance);
@@ -1241,11 +2060,9 @@ DSRRouteManagerImpl::SPFNexthopCalculation (
         {
           NS_ASSERT (w->GetVertexType () == DSRVertex::VertexNetwork);
 // W is a directly connected network; no next hop is required
-          DSRRoutingLSA* w_lsa = w->GetLSA ();
-          NS_ASSERT (w_lsa->GetLSType () == DSRRoutingLSA::NetworkLSA);
-// Find outgoing interface ID for this network
-          uint32_t outIf = FindOutgoingInterfaceId (w_lsa->GetLinkStateId (), 
-                                                    w_lsa->GetNetworkLSANetworkMask () );
+          NS_ASSERT (w->GetLSA ()->GetLSType () == DSRRoutingLSA::NetworkLSA);
+// The outgoing interface ID for this network was found with the graph
+          uint32_t outIf = edge.interface;
 // Set the next hop to 0.0.0.0 meaning "not exist"
           Ipv4Address nextHop = Ipv4Address::GetZero ();
           w->SetRootExitDirection (nextHop, outIf);
@@ -1261,7 +2078,7 @@ DSRRouteManagerImpl::SPFNexthopCalculation (
   else if (v->GetVertexType () == DSRVertex::VertexNetwork) 
     {
 // See if any of v's parents are the root
-      if (v->GetParent () == m_spfroot)
+      if (v->GetParent () == ctx.root)
         {
 // 16.1.1 para 5. ...the parent vertex is a network that
 // directly connects the calculating router to the destination
@@ -1421,7 +2238,7 @@ DSRRouteManagerImpl::DebugSPFCalculate (Ipv4Address root)
 // to be run
 //
 bool
-DSRRouteManagerImpl::CheckForStubNode (Ipv4Address root)
+DSRRouteManagerImpl::CheckForStubNode (SPFContext &ctx, Ipv4Address root)
 {
   NS_LOG_FUNCTION (this << root);
   DSRRoutingLSA *rlsa = m_lsdb->GetLSA (root);
@@ -1484,62 +2301,129 @@ DSRRouteManagerImpl::CheckForStubNode (Ipv4Address root)
               if (lr->GetLinkId () == myRouterId)
                 {
                   // Next hop is stored in the LinkID field of lr
-                  Ptr<DSRRouter> router = rlsa->GetNode ()->GetObject<DSRRouter> ();
-                  NS_ASSERT (router);
-                  Ptr<Ipv4DSRRouting> gr = router->GetRoutingProtocol ();
-                  NS_ASSERT (gr);
-                  gr->AddNetworkRouteTo (Ipv4Address ("0.0.0.0"), Ipv4Mask ("0.0.0.0"), lr->GetLinkData (), 
-                                         FindOutgoingInterfaceId (transitLink->GetLinkData ()));
+                  SPFAddNetworkRoute (ctx, Ipv4Address ("0.0.0.0"), Ipv4Mask ("0.0.0.0"), lr->GetLinkData (), 
+                                      FindOutgoingInterfaceId (ctx, transitLink->GetLinkData ()), false);
                   NS_LOG_LOGIC ("Inserting default route for node " << myRouterId << " to next hop " << 
                                 lr->GetLinkData () << " via interface " << 
-                                FindOutgoingInterfaceId (transitLink->GetLinkData ()));
+                                FindOutgoingInterfaceId (ctx, transitLink->GetLinkData ()));
                   return true;
                 }
             }
         }
     }
-  return false;
+  return false;
+}
+
+void
+DSRRouteManagerImpl::SPFCalculate (Ipv4Address root, Ipv4Address initroot, DSRRoutingLinkRecord* l, uint32_t Iface)
+{
+  NS_LOG_FUNCTION (this << root << initroot);
+  DsrRouteProfileScope profile (DsrRouteProfile::SPF_CALCULATE);
+//
+// The tree of the root does not depend on the router the routes are for, so
+// it is computed once for all the neighbors of the root.
+//
+  SPFResults_t::iterator result = m_spfResults.find (root);
+  if (result == m_spfResults.end ())
+    {
+      result = m_spfResults.insert (std::make_pair (root, SPFResult ())).first;
+      result->second.installed = false;
+      m_context.result = &result->second;
+      SPFCalculateTree (m_context, root);
+    }
+  else
+    {
+      NS_LOG_LOGIC ("Reusing SPF tree of " << root);
+    }
+//
+// The first time a tree is used, keep it for UpdateRoutes and install its
+// network routes on the root.
+//
+  if (!result->second.installed)
+    {
+      result->second.installed = true;
+      if (m_keepSPFTrees)
+        {
+          std::swap (m_spfTrees[root], result->second.tree);
+        }
+      const RouterEntry *rtr = LookupRouter (root);
+      const std::vector<SPFResult::NetworkRoute> &routes = result->second.networkRoutes;
+      for (uint32_t i = 0; rtr && m_writeNetworkRoutes && i < routes.size (); i++)
+        {
+          if (routes[i].external)
+            {
+              rtr->routing->AddASExternalRouteTo (routes[i].network, routes[i].mask, routes[i].nextHop, routes[i].interface);
+            }
+          else
+            {
+              rtr->routing->AddNetworkRouteTo (routes[i].network, routes[i].mask, routes[i].nextHop, routes[i].interface);
+            }
+          DsrRouteProfile::Count (DsrRouteProfile::ENTRIES_INSTALLED);
+        }
+      result->second.networkRoutes.clear ();
+    }
+//
+// The initial root reaches every router of the tree through the root, at
+// the distance of the router from the root plus the metric of the link.
+//
+  const std::vector<std::pair<DSRRoutingLSA *, uint32_t> > &routers = result->second.routers;
+  for (uint32_t i = 0; i < routers.size (); i++)
+    {
+      SPFIntraAddRouter (routers[i].first, routers[i].second + l->GetMetric (), initroot, l->GetLinkData (), Iface);
+    }
 }
 
 // quagga ospf_spf_calculate
 void
-DSRRouteManagerImpl::SPFCalculate (Ipv4Address root, Ipv4Address initroot, DSRRoutingLinkRecord* l, uint32_t Iface)
+DSRRouteManagerImpl::SPFCalculateTree (SPFContext &ctx, Ipv4Address root)
 {
   NS_LOG_FUNCTION (this << root);
-  // std::cout << "The interface = " << Iface << std::endl;
+  DsrRouteProfileScope profile (DsrRouteProfile::SPF_TREE);
   DSRVertex *v;
+  SPFResult &result = *ctx.result;
 //
-// Initialize the Link State Database.
+// Initialize the status of the LSAs.  It is kept in the context, not in the
+// LSAs, which other computations may be reading.
 //
-  m_lsdb->Initialize ();
+  ctx.status.assign (m_lsdb->GetNumLSAs (), DSRRoutingLSA::LSA_SPF_NOT_EXPLORED);
+  ctx.vertices.assign (m_lsdb->GetNumLSAs (), 0);
 //
 // The candidate queue is a priority queue of DSRVertex objects, with the top
 // of the queue being the closest vertex in terms of distance from the root
-// of the tree.  Initially, this queue is empty.
+// of the tree.  Initially, this queue is empty.  It is kept with the
+// context, like the arena, so that their memory serves every root.
 //
-  DsrCandidateQueue candidate;
-  NS_ASSERT (candidate.Size () == 0);
+  DsrCandidateQueue &candidate = ctx.candidate;
+  candidate.Clear ();
+  candidate.Reserve (m_lsdb->GetNumLSAs ());
+  ctx.arena.Reset ();
 //
 // Initialize the shortest-path tree to only contain the router doing the 
 // calculation.  Each router (and corresponding network) is a vertex in the
 // shortest path first (SPF) tree.
 //
-  v = new DSRVertex (m_lsdb->GetLSA (root));
-
-/**
- * @brief add the initroot for dsr
- * \author Pu Yang
- */
-  DSRVertex *v_init;
-  v_init = new DSRVertex (m_lsdb->GetLSA (initroot));
+  v = ctx.arena.Allocate (m_lsdb->GetLSA (root));
 // 
 // This vertex is the root of the SPF tree and it is distance 0 from the root.
 // We also mark this vertex as being in the SPF tree.
 //
-  m_spfroot= v;
-  v->SetDistanceFromRoot (l->GetMetric ());
-  v->GetLSA ()->SetStatus (DSRRoutingLSA::LSA_SPF_IN_SPFTREE);
+  ctx.root = v;
+  v->SetDistanceFromRoot (0);
+  ctx.status[v->GetLSA ()->GetIndex ()] = DSRRoutingLSA::LSA_SPF_IN_SPFTREE;
+  ctx.vertices[v->GetLSA ()->GetIndex ()] = v;
   NS_LOG_LOGIC ("Starting SPFCalculate for node " << root);
+//
+// Remember the distances of the tree for UpdateRoutes, if a router needs
+// them.
+//
+  SPFTree &tree = result.tree;
+  tree.distance.clear ();
+  if (m_keepSPFTrees)
+    {
+      tree.distance.assign (m_lsdb->GetNumLSAs (), DISTINFINITY);
+      tree.distance[v->GetLSA ()->GetIndex ()] = 0;
+    }
+  tree.truncated = false;
 
 //
 // Optimize SPF calculation, for ns-3.
@@ -1548,10 +2432,25 @@ DSRRouteManagerImpl::SPFCalculate (Ipv4Address root, Ipv4Address initroot, DSRRo
 // reached.  Instead, short-circuit this computation and just install
 // a default route in the CheckForStubNode() method.
 //
-  if (NodeList::GetNNodes () > 0 && CheckForStubNode (root))
+  if (!m_routers.empty () && CheckForStubNode (ctx, root))
     {
       NS_LOG_LOGIC ("SPFCalculate truncated for stub node " << root);
-      delete m_spfroot;
+      DSRRoutingLSA *rlsa = m_lsdb->GetLSA (root);
+      for (uint32_t i = 0; i < rlsa->GetNLinkRecords (); i++)
+        {
+          DSRRoutingLinkRecord *lr = rlsa->GetLinkRecord (i);
+          DSRRoutingLSA *w = 0;
+          if (m_keepSPFTrees && lr->GetLinkType () != DSRRoutingLinkRecord::StubNetwork)
+            {
+              w = m_lsdb->GetLSA (lr->GetLinkId ());
+            }
+          if (w)
+            {
+              tree.distance[w->GetIndex ()] = lr->GetMetric ();
+            }
+        }
+      tree.truncated = true;
+      ctx.root = 0;
       return;
     }
 
@@ -1571,7 +2470,7 @@ DSRRouteManagerImpl::SPFCalculate (Ipv4Address root, Ipv4Address initroot, DSRRo
 // shortest path).  If the new vertices represent shorter paths, we use them
 // and update the path cost.
 //
-      SPFNext (v, candidate);
+      SPFNext (ctx, v, candidate);
 //
 // RFC2328 16.1. (3). 
 //
@@ -1594,12 +2493,18 @@ DSRRouteManagerImpl::SPFCalculate (Ipv4Address root, Ipv4Address initroot, DSRRo
 //
       NS_LOG_LOGIC (candidate);
       v = candidate.Pop ();
+      DsrRouteProfile::Count (DsrRouteProfile::VERTICES_POPPED);
       NS_LOG_LOGIC ("Popped vertex " << v->GetVertexId ());
 //
 // Update the status field of the vertex to indicate that it is in the SPF
 // tree.
 //
-      v->GetLSA ()->SetStatus (DSRRoutingLSA::LSA_SPF_IN_SPFTREE);
+      ctx.status[v->GetLSA ()->GetIndex ()] = DSRRoutingLSA::LSA_SPF_IN_SPFTREE;
+      ctx.vertices[v->GetLSA ()->GetIndex ()] = v;
+      if (m_keepSPFTrees)
+        {
+          tree.distance[v->GetLSA ()->GetIndex ()] = v->GetDistanceFromRoot ();
+        }
 //
 // The current vertex has a parent pointer.  By calling this rather oddly 
 // named method (blame quagga) we add the current vertex to the list of 
@@ -1634,15 +2539,16 @@ DSRRouteManagerImpl::SPFCalculate (Ipv4Address root, Ipv4Address initroot, DSRRo
 //
 // To summarize, we're going to look at the node represented by <v> and loop
 // through its point-to-point links, adding a *host* route to the local IP
-// address (at the <v> side) for each of those links.
+// address (at the <v> side) for each of those links.  SPFCalculate does
+// this, for each neighbor of the root, from the routers recorded here.
 //
       if (v->GetVertexType () == DSRVertex::VertexRouter)
         {
-          SPFIntraAddRouter (v, v_init, l->GetLinkData (), Iface);
+          result.routers.push_back (std::make_pair (v->GetLSA (), v->GetDistanceFromRoot ()));
         }
       else if (v->GetVertexType () == DSRVertex::VertexNetwork)
         {
-          SPFIntraAddTransit (v);
+          SPFIntraAddTransit (ctx, v);
         }
       else
         {
@@ -1656,52 +2562,99 @@ DSRRouteManagerImpl::SPFCalculate (Ipv4Address root, Ipv4Address initroot, DSRRo
 
     }  // end for loop
 
-// Second stage of SPF calculation procedure
-  SPFProcessStubs (m_spfroot);
-  for (uint32_t i = 0; i < m_lsdb->GetNumExtLSAs (); i++)
+// Second stage of SPF calculation procedure.  It only finds network
+// routes of the root, which UpdateRoutes may keep.
+  if (m_writeNetworkRoutes)
     {
-      m_spfroot->ClearVertexProcessed ();
-      DSRRoutingLSA *extlsa = m_lsdb->GetExtLSA (i);
-      NS_LOG_LOGIC ("Processing External LSA with id " << extlsa->GetLinkStateId ());
-      ProcessASExternals (m_spfroot, extlsa);
+      SPFProcessStubs (ctx, ctx.root);
+      for (uint32_t i = 0; i < m_graph.externals.size (); i++)
+        {
+          DSRRoutingLSA *extlsa = m_graph.externals[i].first;
+          NS_LOG_LOGIC ("Processing External LSA with id " << extlsa->GetLinkStateId ());
+          ProcessASExternals (ctx, extlsa, m_graph.externals[i].second);
+        }
     }
 
 //
 // We're all done setting the routing information for the node at the root of
-// the SPF tree.  Delete all of the vertices and corresponding resources.  Go
-// possibly do it again for the next router.
+// the SPF tree.  The vertices stay in the arena until the next tree is
+// computed in this context.  Go possibly do it again for the next router.
 //
-  delete m_spfroot;
-  m_spfroot = 0;
+  ctx.root = 0;
 }
 
 void
-DSRRouteManagerImpl::ProcessASExternals (DSRVertex* v, DSRRoutingLSA* extlsa)
+DSRRouteManagerImpl::SPFCalculateTrees (const std::vector<Ipv4Address> &roots)
 {
-  NS_LOG_FUNCTION (this << v << extlsa);
-  NS_LOG_LOGIC ("Processing external for destination " << 
-                extlsa->GetLinkStateId () <<
-                ", for router "  << v->GetVertexId () <<
-                ", advertised by " << extlsa->GetAdvertisingRouter ());
-  if (v->GetVertexType () == DSRVertex::VertexRouter)
+  NS_LOG_FUNCTION (this << roots.size ());
+  std::vector<std::pair<Ipv4Address, SPFResult *> > jobs;
+  for (uint32_t i = 0; i < roots.size (); i++)
     {
-      DSRRoutingLSA *rlsa = v->GetLSA ();
-      NS_LOG_LOGIC ("Processing router LSA with id " << rlsa->GetLinkStateId ());
-      if ((rlsa->GetLinkStateId ()) == (extlsa->GetAdvertisingRouter ()))
+      if (m_lsdb->GetLSA (roots[i]) == 0 || m_spfResults.find (roots[i]) != m_spfResults.end ())
         {
-          NS_LOG_LOGIC ("Found advertising router to destination");
-          SPFAddASExternal (extlsa,v);
+          continue;
         }
+      SPFResult &result = m_spfResults[roots[i]];
+      result.installed = false;
+      jobs.push_back (std::make_pair (roots[i], &result));
     }
-  for (uint32_t i = 0; i < v->GetNChildren (); i++)
+
+  UintegerValue value;
+  g_dsrSpfThreads.GetValue (value);
+  uint32_t nThreads = value.Get ();
+  if (nThreads == 0)
     {
-      if (!v->GetChild (i)->IsVertexProcessed ())
-        {
-          NS_LOG_LOGIC ("Vertex's child " << i << " not yet processed, processing...");
-          ProcessASExternals (v->GetChild (i), extlsa);
-          v->GetChild (i)->SetVertexProcessed (true);
-        }
+      nThreads = std::max<uint32_t> (std::thread::hardware_concurrency (), 1);
+    }
+  nThreads = std::min<uint32_t> (nThreads, jobs.size ());
+  NS_LOG_INFO ("Computing " << jobs.size () << " SPF trees with " << nThreads << " threads");
+
+//
+// Each thread takes the next root nobody took yet, so that a few large trees
+// do not hold up the threads which were given small ones.  The results are
+// only read once all the threads are done.
+//
+  std::atomic<uint32_t> next (0);
+  std::vector<std::thread> threads;
+  for (uint32_t t = 1; t < nThreads; t++)
+    {
+      threads.push_back (std::thread (&DSRRouteManagerImpl::SPFCalculateJobs, this,
+                                      std::cref (jobs), std::ref (next)));
+    }
+  SPFCalculateJobs (jobs, next);
+  for (uint32_t t = 0; t < threads.size (); t++)
+    {
+      threads[t].join ();
+    }
+}
+
+void
+DSRRouteManagerImpl::SPFCalculateJobs (const std::vector<std::pair<Ipv4Address, SPFResult *> > &jobs,
+                                       std::atomic<uint32_t> &next)
+{
+  SPFContext ctx;
+  for (uint32_t i = next++; i < jobs.size (); i = next++)
+    {
+      ctx.result = jobs[i].second;
+      SPFCalculateTree (ctx, jobs[i].first);
+    }
+}
+
+void
+DSRRouteManagerImpl::ProcessASExternals (SPFContext &ctx, DSRRoutingLSA* extlsa, uint32_t advertiser)
+{
+  NS_LOG_FUNCTION (this << extlsa << advertiser);
+  NS_LOG_LOGIC ("Processing external for destination " << 
+                extlsa->GetLinkStateId () <<
+                ", for router "  << ctx.root->GetVertexId () <<
+                ", advertised by " << extlsa->GetAdvertisingRouter ());
+  if (advertiser == SPFGraph::NO_VERTEX || ctx.vertices[advertiser] == 0)
+    {
+      NS_LOG_LOGIC ("Advertising router not in the SPF tree");
+      return;
     }
+  NS_LOG_LOGIC ("Found advertising router to destination");
+  SPFAddASExternal (ctx, extlsa, ctx.vertices[advertiser]);
 }
 
 //
@@ -1710,15 +2663,15 @@ DSRRouteManagerImpl::ProcessASExternals (DSRVertex* v, DSRRoutingLSA* extlsa)
 //
 
 void
-DSRRouteManagerImpl::SPFAddASExternal (DSRRoutingLSA *extlsa, DSRVertex *v)
+DSRRouteManagerImpl::SPFAddASExternal (SPFContext &ctx, DSRRoutingLSA *extlsa, DSRVertex *v)
 {
   NS_LOG_FUNCTION (this << extlsa << v);
 
-  NS_ASSERT_MSG (m_spfroot, "DSRRouteManagerImpl::SPFAddASExternal (): Root pointer not set");
+  NS_ASSERT_MSG (ctx.root, "DSRRouteManagerImpl::SPFAddASExternal (): Root pointer not set");
 // Two cases to consider: We are advertising the external ourselves
 // => No need to add anything
 // OR find best path to the advertising router
-  if (v->GetVertexId () == m_spfroot->GetVertexId ())
+  if (v->GetVertexId () == ctx.root->GetVertexId ())
     {
       NS_LOG_LOGIC ("External is on local host: " 
                     << v->GetVertexId () << "; returning");
@@ -1727,116 +2680,53 @@ DSRRouteManagerImpl::SPFAddASExternal (DSRRoutingLSA *extlsa, DSRVertex *v)
   NS_LOG_LOGIC ("External is on remote host: " 
                 << extlsa->GetAdvertisingRouter () << "; installing");
 
-  Ipv4Address routerId = m_spfroot->GetVertexId ();
+  Ipv4Address routerId = ctx.root->GetVertexId ();
 
   NS_LOG_LOGIC ("Vertex ID = " << routerId);
 //
-// We need to walk the list of nodes looking for the one that has the router
-// ID corresponding to the root vertex.  This is the one we're going to write
-// the routing information to.
+// Look up the node that has the router ID corresponding to the root vertex.
+// This is the one we're going to write the routing information to.
 //
-  NodeList::Iterator i = NodeList::Begin (); 
-  NodeList::Iterator listEnd = NodeList::End ();
-  for (; i != listEnd; i++)
+  const RouterEntry *rtr = LookupRouter (routerId);
+  if (rtr == 0)
     {
-      Ptr<Node> node = *i;
-//
-// The router ID is accessible through the DSRRouter interface, so we need
-// to QI for that interface.  If there's no DSRRouter interface, the node
-// in question cannot be the router we want, so we continue.
-// 
-      Ptr<DSRRouter> rtr = node->GetObject<DSRRouter> ();
-
-      if (rtr == 0)
+      return;
+    }
+  const Ptr<Node> &node = rtr->node;
+  NS_LOG_LOGIC ("Setting routes for node " << node->GetId ());
+  NS_ASSERT_MSG (rtr->ipv4, 
+                 "DSRRouteManagerImpl::SPFAddASExternal (): "
+                 "QI for <Ipv4> interface failed");
+  NS_ASSERT_MSG (v->GetLSA (), 
+                 "DSRRouteManagerImpl::SPFAddASExternal (): "
+                 "Expected valid LSA in DSRVertex* v");
+  Ipv4Mask tempmask = extlsa->GetNetworkLSANetworkMask ();
+  Ipv4Address tempip = extlsa->GetLinkStateId ();
+  tempip = tempip.CombineMask (tempmask);
+
+  // walk through all next-hop-IPs and out-going-interfaces for reaching
+  // the stub network gateway 'v' from the root node
+  for (uint32_t i = 0; i < v->GetNRootExitDirections (); i++)
+    {
+      DSRVertex::NodeExit_t exit = v->GetRootExitDirection (i);
+      Ipv4Address nextHop = exit.first;
+      int32_t outIf = exit.second;
+      if (outIf >= 0)
         {
-          NS_LOG_LOGIC ("No DSRRouter interface on node " << node->GetId ());
-          continue;
+          SPFAddNetworkRoute (ctx, tempip, tempmask, nextHop, outIf, true);
+          NS_LOG_LOGIC ("(Route " << i << ") Node " << node->GetId () <<
+                        " add external network route to " << tempip <<
+                        " using next hop " << nextHop <<
+                        " via interface " << outIf);
         }
-//
-// If the router ID of the current node is equal to the router ID of the 
-// root of the SPF tree, then this node is the one for which we need to 
-// write the routing tables.
-//
-      NS_LOG_LOGIC ("Considering router " << rtr->GetRouterId ());
-
-      if (rtr->GetRouterId () == routerId)
+      else
         {
-          NS_LOG_LOGIC ("Setting routes for node " << node->GetId ());
-//
-// Routing information is updated using the Ipv4 interface.  We need to QI
-// for that interface.  If the node is acting as an IP version 4 router, it
-// should absolutely have an Ipv4 interface.
-//
-          Ptr<Ipv4> ipv4 = node->GetObject<Ipv4> ();
-          NS_ASSERT_MSG (ipv4, 
-                         "DSRRouteManagerImpl::SPFIntraAddRouter (): "
-                         "QI for <Ipv4> interface failed");
-//
-// Get the Global Router Link State Advertisement from the vertex we're
-// adding the routes to.  The LSA will have a number of attached Global Router
-// Link Records corresponding to links off of that vertex / node.  We're going
-// to be interested in the records corresponding to point-to-point links.
-//
-          NS_ASSERT_MSG (v->GetLSA (), 
-                         "DSRRouteManagerImpl::SPFIntraAddRouter (): "
-                         "Expected valid LSA in DSRVertex* v");
-          Ipv4Mask tempmask = extlsa->GetNetworkLSANetworkMask ();
-          Ipv4Address tempip = extlsa->GetLinkStateId ();
-          tempip = tempip.CombineMask (tempmask);
-
-//
-// Here's why we did all of that work.  We're going to add a host route to the
-// host address found in the m_linkData field of the point-to-point link
-// record.  In the case of a point-to-point link, this is the local IP address
-// of the node connected to the link.  Each of these point-to-point links
-// will correspond to a local interface that has an IP address to which
-// the node at the root of the SPF tree can send packets.  The vertex <v> 
-// (corresponding to the node that has these links and interfaces) has 
-// an m_nextHop address precalculated for us that is the address to which the
-// root node should send packets to be forwarded to these IP addresses.
-// Similarly, the vertex <v> has an m_rootOif (outbound interface index) to
-// which the packets should be send for forwarding.
-//
-          Ptr<DSRRouter> router = node->GetObject<DSRRouter> ();
-          if (router == 0)
-            {
-              continue;
-            }
-          Ptr<Ipv4DSRRouting> gr = router->GetRoutingProtocol ();
-          NS_ASSERT (gr);
-          // walk through all next-hop-IPs and out-going-interfaces for reaching
-          // the stub network gateway 'v' from the root node
-          for (uint32_t i = 0; i < v->GetNRootExitDirections (); i++)
-            {
-              DSRVertex::NodeExit_t exit = v->GetRootExitDirection (i);
-              Ipv4Address nextHop = exit.first;
-              int32_t outIf = exit.second;
-              /**
-               * \author Pu Yang
-               * \brief get the distance
-              */
-              // uint32_t distance = v->GetDistanceFromRoot ();
-              // std::cout << "the SPF distance = " << distance;
-
-              if (outIf >= 0)
-                {
-                  gr->AddASExternalRouteTo (tempip, tempmask, nextHop, outIf);
-                  NS_LOG_LOGIC ("(Route " << i << ") Node " << node->GetId () <<
-                                " add external network route to " << tempip <<
-                                " using next hop " << nextHop <<
-                                " via interface " << outIf);
-                }
-              else
-                {
-                  NS_LOG_LOGIC ("(Route " << i << ") Node " << node->GetId () <<
-                                " NOT able to add network route to " << tempip <<
-                                " using next hop " << nextHop <<
-                                " since outgoing interface id is negative");
-                }
-            }
-          return;
-        } // if
-    } // for
+          NS_LOG_LOGIC ("(Route " << i << ") Node " << node->GetId () <<
+                        " NOT able to add network route to " << tempip <<
+                        " using next hop " << nextHop <<
+                        " since outgoing interface id is negative");
+        }
+    }
 }
 
 
@@ -1844,33 +2734,26 @@ DSRRouteManagerImpl::SPFAddASExternal (DSRRoutingLSA *extlsa, DSRVertex *v)
 // stub link records will exist for point-to-point interfaces and for
 // broadcast interfaces for which no neighboring router can be found
 void
-DSRRouteManagerImpl::SPFProcessStubs (DSRVertex* v)
+DSRRouteManagerImpl::SPFProcessStubs (SPFContext &ctx, DSRVertex* v)
 {
   NS_LOG_FUNCTION (this << v);
   NS_LOG_LOGIC ("Processing stubs for " << v->GetVertexId ());
   if (v->GetVertexType () == DSRVertex::VertexRouter)
     {
-      DSRRoutingLSA *rlsa = v->GetLSA ();
-      NS_LOG_LOGIC ("Processing router LSA with id " << rlsa->GetLinkStateId ());
-      for (uint32_t i = 0; i < rlsa->GetNLinkRecords (); i++)
+      uint32_t vi = v->GetLSA ()->GetIndex ();
+      NS_LOG_LOGIC ("Processing router LSA with id " << v->GetLSA ()->GetLinkStateId ());
+      for (uint32_t i = m_graph.stubStart[vi]; i < m_graph.stubStart[vi + 1]; i++)
         {
-          NS_LOG_LOGIC ("Examining link " << i << " of " << 
-                        v->GetVertexId () << "'s " <<
-                        v->GetLSA ()->GetNLinkRecords () << " link records");
-          DSRRoutingLinkRecord *l = v->GetLSA ()->GetLinkRecord (i);
-          if (l->GetLinkType () == DSRRoutingLinkRecord::StubNetwork)
-            {
-              NS_LOG_LOGIC ("Found a Stub record to " << l->GetLinkId ());
-              SPFIntraAddStub (l, v);
-              continue;
-            }
+          DSRRoutingLinkRecord *l = m_graph.stubs[i];
+          NS_LOG_LOGIC ("Found a Stub record to " << l->GetLinkId ());
+          SPFIntraAddStub (ctx, l, v);
         }
     }
   for (uint32_t i = 0; i < v->GetNChildren (); i++)
     {
       if (!v->GetChild (i)->IsVertexProcessed ())
         {
-          SPFProcessStubs (v->GetChild (i));
+          SPFProcessStubs (ctx, v->GetChild (i));
           v->GetChild (i)->SetVertexProcessed (true);
         }
     }
@@ -1878,11 +2761,11 @@ DSRRouteManagerImpl::SPFProcessStubs (DSRVertex* v)
 
 // RFC2328 16.1. second stage. 
 void
-DSRRouteManagerImpl::SPFIntraAddStub (DSRRoutingLinkRecord *l, DSRVertex* v)
+DSRRouteManagerImpl::SPFIntraAddStub (SPFContext &ctx, DSRRoutingLinkRecord *l, DSRVertex* v)
 {
   NS_LOG_FUNCTION (this << l << v);
 
-  NS_ASSERT_MSG (m_spfroot, 
+  NS_ASSERT_MSG (ctx.root, 
                  "DSRRouteManagerImpl::SPFIntraAddStub (): Root pointer not set");
 
   // XXX simplifed logic for the moment.  There are two cases to consider:
@@ -1890,7 +2773,7 @@ DSRRouteManagerImpl::SPFIntraAddStub (DSRRoutingLinkRecord *l, DSRVertex* v)
   //    (already handled above)
   // 2) the stub network is on a remote router, so I should use the
   // same next hop that I use to get to vertex v
-  if (v->GetVertexId () == m_spfroot->GetVertexId ())
+  if (v->GetVertexId () == ctx.root->GetVertexId ())
     {
       NS_LOG_LOGIC ("Stub is on local host: " << v->GetVertexId () << "; returning");
       return;
@@ -1903,111 +2786,70 @@ DSRRouteManagerImpl::SPFIntraAddStub (DSRRoutingLinkRecord *l, DSRVertex* v)
 // going to use this ID to discover which node it is that we're actually going
 // to update.
 //
-  Ipv4Address routerId = m_spfroot->GetVertexId ();
+  Ipv4Address routerId = ctx.root->GetVertexId ();
 
   NS_LOG_LOGIC ("Vertex ID = " << routerId);
 //
-// We need to walk the list of nodes looking for the one that has the router
-// ID corresponding to the root vertex.  This is the one we're going to write
-// the routing information to.
+// Look up the node that has the router ID corresponding to the root vertex.
+// This is the one we're going to write the routing information to.
 //
-  NodeList::Iterator i = NodeList::Begin (); 
-  NodeList::Iterator listEnd = NodeList::End ();
-  for (; i != listEnd; i++)
+  const RouterEntry *rtr = LookupRouter (routerId);
+  if (rtr == 0)
     {
-      Ptr<Node> node = *i;
-//
-// The router ID is accessible through the DSRRouter interface, so we need
-// to QI for that interface.  If there's no DSRRouter interface, the node
-// in question cannot be the router we want, so we continue.
-// 
-      Ptr<DSRRouter> rtr = 
-        node->GetObject<DSRRouter> ();
-
-      if (rtr == 0)
+      return;
+    }
+  const Ptr<Node> &node = rtr->node;
+  NS_LOG_LOGIC ("Setting routes for node " << node->GetId ());
+  NS_ASSERT_MSG (rtr->ipv4, 
+                 "DSRRouteManagerImpl::SPFIntraAddStub (): "
+                 "QI for <Ipv4> interface failed");
+  NS_ASSERT_MSG (v->GetLSA (), 
+                 "DSRRouteManagerImpl::SPFIntraAddStub (): "
+                 "Expected valid LSA in DSRVertex* v");
+  Ipv4Mask tempmask (l->GetLinkData ().Get ());
+  Ipv4Address tempip = l->GetLinkId ();
+  tempip = tempip.CombineMask (tempmask);
+//
+// The vertex <v> has the next hops and outbound interfaces through which
+// the root reaches it; the stub network is reached the same way.
+//
+  // walk through all next-hop-IPs and out-going-interfaces for reaching
+  // the stub network gateway 'v' from the root node
+  for (uint32_t i = 0; i < v->GetNRootExitDirections (); i++)
+    {
+      DSRVertex::NodeExit_t exit = v->GetRootExitDirection (i);
+      Ipv4Address nextHop = exit.first;
+      int32_t outIf = exit.second;
+      if (outIf >= 0)
         {
-          NS_LOG_LOGIC ("No DSRRouter interface on node " << 
-                        node->GetId ());
-          continue;
+          SPFAddNetworkRoute (ctx, tempip, tempmask, nextHop, outIf, false);
+          NS_LOG_LOGIC ("(Route " << i << ") Node " << node->GetId () <<
+                        " add network route to " << tempip <<
+                        " using next hop " << nextHop <<
+                        " via interface " << outIf);
         }
-//
-// If the router ID of the current node is equal to the router ID of the 
-// root of the SPF tree, then this node is the one for which we need to 
-// write the routing tables.
-//
-      NS_LOG_LOGIC ("Considering router " << rtr->GetRouterId ());
-
-      if (rtr->GetRouterId () == routerId)
+      else
         {
-          NS_LOG_LOGIC ("Setting routes for node " << node->GetId ());
-//
-// Routing information is updated using the Ipv4 interface.  We need to QI
-// for that interface.  If the node is acting as an IP version 4 router, it
-// should absolutely have an Ipv4 interface.
-//
-          Ptr<Ipv4> ipv4 = node->GetObject<Ipv4> ();
-          NS_ASSERT_MSG (ipv4, 
-                         "DSRRouteManagerImpl::SPFIntraAddRouter (): "
-                         "QI for <Ipv4> interface failed");
-//
-// Get the Global Router Link State Advertisement from the vertex we're
-// adding the routes to.  The LSA will have a number of attached Global Router
-// Link Records corresponding to links off of that vertex / node.  We're going
-// to be interested in the records corresponding to point-to-point links.
-//
-          NS_ASSERT_MSG (v->GetLSA (), 
-                         "DSRRouteManagerImpl::SPFIntraAddRouter (): "
-                         "Expected valid LSA in DSRVertex* v");
-          Ipv4Mask tempmask (l->GetLinkData ().Get ());
-          Ipv4Address tempip = l->GetLinkId ();
-          tempip = tempip.CombineMask (tempmask);
-//
-// Here's why we did all of that work.  We're going to add a host route to the
-// host address found in the m_linkData field of the point-to-point link
-// record.  In the case of a point-to-point link, this is the local IP address
-// of the node connected to the link.  Each of these point-to-point links
-// will correspond to a local interface that has an IP address to which
-// the node at the root of the SPF tree can send packets.  The vertex <v> 
-// (corresponding to the node that has these links and interfaces) has 
-// an m_nextHop address precalculated for us that is the address to which the
-// root node should send packets to be forwarded to these IP addresses.
-// Similarly, the vertex <v> has an m_rootOif (outbound interface index) to
-// which the packets should be send for forwarding.
-//
-
-          Ptr<DSRRouter> router = node->GetObject<DSRRouter> ();
-          if (router == 0)
-            {
-              continue;
-            }
-          Ptr<Ipv4DSRRouting> gr = router->GetRoutingProtocol ();
-          NS_ASSERT (gr);
-          // walk through all next-hop-IPs and out-going-interfaces for reaching
-          // the stub network gateway 'v' from the root node
-          for (uint32_t i = 0; i < v->GetNRootExitDirections (); i++)
-            {
-              DSRVertex::NodeExit_t exit = v->GetRootExitDirection (i);
-              Ipv4Address nextHop = exit.first;
-              int32_t outIf = exit.second;
-              if (outIf >= 0)
-                {
-                  gr->AddNetworkRouteTo (tempip, tempmask, nextHop, outIf);
-                  NS_LOG_LOGIC ("(Route " << i << ") Node " << node->GetId () <<
-                                " add network route to " << tempip <<
-                                " using next hop " << nextHop <<
-                                " via interface " << outIf);
-                }
-              else
-                {
-                  NS_LOG_LOGIC ("(Route " << i << ") Node " << node->GetId () <<
-                                " NOT able to add network route to " << tempip <<
-                                " using next hop " << nextHop <<
-                                " since outgoing interface id is negative");
-                }
-            }
-          return;
-        } // if
-    } // for
+          NS_LOG_LOGIC ("(Route " << i << ") Node " << node->GetId () <<
+                        " NOT able to add network route to " << tempip <<
+                        " using next hop " << nextHop <<
+                        " since outgoing interface id is negative");
+        }
+    }
+}
+
+void
+DSRRouteManagerImpl::SPFAddNetworkRoute (SPFContext &ctx, Ipv4Address network, Ipv4Mask mask,
+                                         Ipv4Address nextHop, uint32_t interface, bool external)
+{
+  NS_LOG_FUNCTION (this << network << mask << nextHop << interface << external);
+  SPFResult::NetworkRoute route;
+  route.network = network;
+  route.mask = mask;
+  route.nextHop = nextHop;
+  route.interface = interface;
+  route.external = external;
+  ctx.result->networkRoutes.push_back (route);
 }
 
 //
@@ -2018,7 +2860,7 @@ DSRRouteManagerImpl::SPFIntraAddStub (DSRRoutingLinkRecord *l, DSRVertex* v)
 // for routing assumes -1 to be a legal return value)
 //
 int32_t
-DSRRouteManagerImpl::FindOutgoingInterfaceId (Ipv4Address a, Ipv4Mask amask)
+DSRRouteManagerImpl::FindOutgoingInterfaceId (const SPFContext &ctx, Ipv4Address a, Ipv4Mask amask)
 {
   NS_LOG_FUNCTION (this << a << amask);
 //
@@ -2029,62 +2871,42 @@ DSRRouteManagerImpl::FindOutgoingInterfaceId (Ipv4Address a, Ipv4Mask amask)
 // node in order to iterate the interfaces and find the one corresponding to
 // the address in question.
 //
-  Ipv4Address routerId = m_spfroot->GetVertexId ();
+  Ipv4Address routerId = ctx.root->GetVertexId ();
 //
-// Walk the list of nodes in the system looking for the one corresponding to
-// the node at the root of the SPF tree.  This is the node for which we are
-// building the routing table.
+// Look up the node at the root of the SPF tree.  This is the node for which
+// we are building the routing table.
 //
-  NodeList::Iterator i = NodeList::Begin (); 
-  NodeList::Iterator listEnd = NodeList::End ();
-  for (; i != listEnd; i++)
+  const RouterEntry *rtr = LookupRouter (routerId);
+  if (rtr == 0)
     {
-      Ptr<Node> node = *i;
-
-      Ptr<DSRRouter> rtr = 
-        node->GetObject<DSRRouter> ();
-//
-// If the node doesn't have a DSRRouter interface it can't be the one
-// we're interested in.
-//
-      if (rtr == 0)
-        {
-          continue;
-        }
+      NS_LOG_LOGIC ("FindOutgoingInterfaceId():Can't find root node " << routerId);
+      return -1;
+    }
+  NS_ASSERT_MSG (rtr->ipv4, 
+                 "DSRRouteManagerImpl::FindOutgoingInterfaceId (): "
+                 "GetObject for <Ipv4> interface failed");
+  return FindInterfaceForPrefix (rtr, a, amask);
+}
 
-      if (rtr->GetRouterId () == routerId)
-        {
-//
-// This is the node we're building the routing table for.  We're going to need
-// the Ipv4 interface to look for the ipv4 interface index.  Since this node
-// is participating in routing IP version 4 packets, it certainly must have 
-// an Ipv4 interface.
-//
-          Ptr<Ipv4> ipv4 = node->GetObject<Ipv4> ();
-          NS_ASSERT_MSG (ipv4, 
-                         "DSRRouteManagerImpl::FindOutgoingInterfaceId (): "
-                         "GetObject for <Ipv4> interface failed");
+int32_t
+DSRRouteManagerImpl::FindInterfaceForPrefix (const RouterEntry *rtr, Ipv4Address a, Ipv4Mask amask) const
+{
+  if (rtr == 0)
+    {
+      return -1;
+    }
 //
 // Look through the interfaces on this node for one that has the IP address
 // we're looking for.  If we find one, return the corresponding interface
 // index, or -1 if not found.
 //
-          int32_t interface = ipv4->GetInterfaceForPrefix (a, amask);
-
-#if 0
-          if (interface < 0)
-            {
-              NS_FATAL_ERROR ("DSRRouteManagerImpl::FindOutgoingInterfaceId(): "
-                              "Expected an interface associated with address a:" << a);
-            }
-#endif 
-          return interface;
+  for (uint32_t i = 0; i < rtr->addresses.size (); i++)
+    {
+      if (rtr->addresses[i].second.CombineMask (amask) == a.CombineMask (amask))
+        {
+          return rtr->addresses[i].first;
         }
     }
-//
-// Couldn't find it.
-//
-  NS_LOG_LOGIC ("FindOutgoingInterfaceId():Can't find root node " << routerId);
   return -1;
 }
 
@@ -2105,86 +2927,36 @@ DSRRouteManagerImpl::FindOutgoingInterfaceId (Ipv4Address a, Ipv4Mask amask)
 // route.
 //
 void
-DSRRouteManagerImpl::SPFIntraAddRouter (DSRVertex* v, DSRVertex* v_init, Ipv4Address nextHop, uint32_t Iface)
+DSRRouteManagerImpl::SPFIntraAddRouter (DSRRoutingLSA* lsa, uint32_t distance, Ipv4Address initroot, Ipv4Address nextHop, uint32_t Iface)
 {
-  NS_LOG_FUNCTION (this << v);
-
-  NS_ASSERT_MSG (m_spfroot, 
-                 "DSRRouteManagerImpl::SPFIntraAddRouter (): Root pointer not set");
-//
-// The root of the Shortest Path First tree is the router to which we are 
-// going to write the actual routing table entries.  The vertex corresponding
-// to this router has a vertex ID which is the router ID of that node.  We're
-// going to use this ID to discover which node it is that we're actually going
-// to update.
-//
-  Ipv4Address routerId = m_spfroot->GetVertexId ();
-
-/**
- * @brief the router Ipv4 Address to write the routing table
- * \author Pu Yang
- */
-  Ipv4Address routerId_init = v_init->GetVertexId ();
-  NS_LOG_LOGIC ("Vertex ID = " << routerId);
+  NS_LOG_FUNCTION (this << lsa << distance << initroot);
+  DsrRouteProfileScope profile (DsrRouteProfile::SPF_INTRA_ADD_ROUTER);
 
 //
-// We need to walk the list of nodes looking for the one that has the router
-// ID corresponding to the root vertex.  This is the one we're going to write
-// the routing information to.
+// Look up the node that has the router ID of the initial root.  This is the
+// one we're going to write the routing information to.
 //
-
-  NodeList::Iterator listEnd = NodeList::End ();
-  NodeList::Iterator i = NodeList::Begin (); 
-  
-  for (; i != listEnd; i++)
+  const RouterEntry *rtr = LookupRouter (initroot);
+  if (rtr == 0)
     {
-      Ptr<Node> node = *i;
-//
-// The router ID is accessible through the GlobalRouter interface, so we need
-// to GetObject for that interface.  If there's no GlobalRouter interface, 
-// the node in question cannot be the router we want, so we continue.
-// 
-      Ptr<DSRRouter> rtr = 
-        node->GetObject<DSRRouter> ();
-
-      if (rtr == 0)
-        {
-          NS_LOG_LOGIC ("No GlobalRouter interface on node " << 
-                        node->GetId ());
-          continue;
-        }
-        // std::cout << "The neighbour node " << node->GetId () << std::endl;
-//
-// If the router ID of the current node is equal to the router ID of the 
-// root of the SPF tree, then this node is the one for which we need to 
-// write the routing tables.
-//
-      NS_LOG_LOGIC ("Considering router " << rtr->GetRouterId ());
-
-      if (rtr->GetRouterId () == routerId_init)
-        {
-          NS_LOG_LOGIC ("Setting routes for node " << node->GetId ());
-//
-// Routing information is updated using the Ipv4 interface.  We need to 
-// GetObject for that interface.  If the node is acting as an IP version 4 
-// router, it should absolutely have an Ipv4 interface.
-//
-          Ptr<Ipv4> ipv4 = node->GetObject<Ipv4> ();
-          NS_ASSERT_MSG (ipv4, 
-                         "DSRRouteManagerImpl::SPFIntraAddRouter (): "
-                         "GetObject for <Ipv4> interface failed");
+      return;
+    }
+  Ptr<Node> node = rtr->node;
+  NS_LOG_LOGIC ("Setting routes for node " << node->GetId ());
+  NS_ASSERT_MSG (rtr->ipv4, 
+                 "DSRRouteManagerImpl::SPFIntraAddRouter (): "
+                 "GetObject for <Ipv4> interface failed");
 //
-// Get the Global Router Link State Advertisement from the vertex we're
-// adding the routes to.  The LSA will have a number of attached Global Router
-// Link Records corresponding to links off of that vertex / node.  We're going
-// to be interested in the records corresponding to point-to-point links.
+// The Global Router Link State Advertisement of the vertex we're adding the
+// routes to will have a number of attached Global Router Link Records
+// corresponding to links off of that vertex / node.  We're going to be
+// interested in the records corresponding to point-to-point links.
 //
-          DSRRoutingLSA *lsa = v->GetLSA ();
-          NS_ASSERT_MSG (lsa, 
-                         "DSRRouteManagerImpl::SPFIntraAddRouter (): "
-                         "Expected valid LSA in DSRVertex* v");
+  NS_ASSERT_MSG (lsa, 
+                 "DSRRouteManagerImpl::SPFIntraAddRouter (): "
+                 "Expected valid LSA");
 
-          uint32_t nLinkRecords = lsa->GetNLinkRecords ();
+  uint32_t nLinkRecords = lsa->GetNLinkRecords ();
 //
 // Iterate through the link records on the vertex to which we're going to add
 // routes.  To make sure we're being clear, we're going to add routing table
@@ -2193,42 +2965,35 @@ DSRRouteManagerImpl::SPFIntraAddRouter (DSRVertex* v, DSRVertex* v_init, Ipv4Add
 // the local side of the point-to-point links found on the node described by
 // the vertex <v>.
 //
-          NS_LOG_LOGIC (" Node " << node->GetId () <<
-                        " found " << nLinkRecords << " link records in LSA " << lsa << "with LinkStateId "<< lsa->GetLinkStateId ());
-          for (uint32_t j = 0; j < nLinkRecords; ++j)
-            {
+  NS_LOG_LOGIC (" Node " << node->GetId () <<
+                " found " << nLinkRecords << " link records in LSA " << lsa << "with LinkStateId "<< lsa->GetLinkStateId ());
+  Ptr<Ipv4DSRRouting> gr = rtr->routing;
+  NS_ASSERT (gr);
+  for (uint32_t j = 0; j < nLinkRecords; ++j)
+    {
 //
 // We are only concerned about point-to-point links
 //
-              DSRRoutingLinkRecord *lr = lsa->GetLinkRecord (j);
-              if (lr->GetLinkType () != DSRRoutingLinkRecord::PointToPoint)
-                {
-                  continue;
-                }
-              Ptr<DSRRouter> router = node->GetObject<DSRRouter> ();
-              if (router == 0)
-                {
-                  continue;
-                }
-              Ptr<Ipv4DSRRouting> gr = router->GetRoutingProtocol ();
-              NS_ASSERT (gr);
-              uint32_t distance = v->GetDistanceFromRoot ();
-              gr->AddHostRouteTo (lr->GetLinkData (), nextHop, Iface, distance);
-            }
-//
-// Done adding the routes for the selected node.
-//
-          return;
+      DSRRoutingLinkRecord *lr = lsa->GetLinkRecord (j);
+      if (lr->GetLinkType () != DSRRoutingLinkRecord::PointToPoint)
+        {
+          continue;
         }
+      gr->AddHostRouteTo (lr->GetLinkData (), nextHop, Iface, distance);
+      DsrRouteProfile::Count (DsrRouteProfile::ENTRIES_INSTALLED);
     }
 }
 void
-DSRRouteManagerImpl::SPFIntraAddTransit (DSRVertex* v)
+DSRRouteManagerImpl::SPFIntraAddTransit (SPFContext &ctx, DSRVertex* v)
 {
   NS_LOG_FUNCTION (this << v);
 
-  NS_ASSERT_MSG (m_spfroot, 
+  NS_ASSERT_MSG (ctx.root, 
                  "DSRRouteManagerImpl::SPFIntraAddTransit (): Root pointer not set");
+  if (!m_writeNetworkRoutes)
+    {
+      return;
+    }
 //
 // The root of the Shortest Path First tree is the router to which we are 
 // going to write the actual routing table entries.  The vertex corresponding
@@ -2236,99 +3001,61 @@ DSRRouteManagerImpl::SPFIntraAddTransit (DSRVertex* v)
 // going to use this ID to discover which node it is that we're actually going
 // to update.
 //
-  Ipv4Address routerId = m_spfroot->GetVertexId ();
+  Ipv4Address routerId = ctx.root->GetVertexId ();
 
   NS_LOG_LOGIC ("Vertex ID = " << routerId);
 //
-// We need to walk the list of nodes looking for the one that has the router
-// ID corresponding to the root vertex.  This is the one we're going to write
-// the routing information to.
+// Look up the node that has the router ID corresponding to the root vertex.
+// This is the one we're going to write the routing information to.
 //
-  NodeList::Iterator i = NodeList::Begin (); 
-  NodeList::Iterator listEnd = NodeList::End ();
-  for (; i != listEnd; i++)
+  const RouterEntry *rtr = LookupRouter (routerId);
+  if (rtr == 0)
     {
-      Ptr<Node> node = *i;
-//
-// The router ID is accessible through the DSRRouter interface, so we need
-// to GetObject for that interface.  If there's no DSRRouter interface, 
-// the node in question cannot be the router we want, so we continue.
-// 
-      Ptr<DSRRouter> rtr = 
-        node->GetObject<DSRRouter> ();
-
-      if (rtr == 0)
-        {
-          NS_LOG_LOGIC ("No DSRRouter interface on node " << 
-                        node->GetId ());
-          continue;
-        }
-//
-// If the router ID of the current node is equal to the router ID of the 
-// root of the SPF tree, then this node is the one for which we need to 
-// write the routing tables.
-//
-      NS_LOG_LOGIC ("Considering router " << rtr->GetRouterId ());
-
-      if (rtr->GetRouterId () == routerId)
-        {
-          NS_LOG_LOGIC ("setting routes for node " << node->GetId ());
-//
-// Routing information is updated using the Ipv4 interface.  We need to 
-// GetObject for that interface.  If the node is acting as an IP version 4 
-// router, it should absolutely have an Ipv4 interface.
-//
-          Ptr<Ipv4> ipv4 = node->GetObject<Ipv4> ();
-          NS_ASSERT_MSG (ipv4, 
-                         "DSRRouteManagerImpl::SPFIntraAddTransit (): "
-                         "GetObject for <Ipv4> interface failed");
+      return;
+    }
+  const Ptr<Node> &node = rtr->node;
+  NS_LOG_LOGIC ("setting routes for node " << node->GetId ());
+  NS_ASSERT_MSG (rtr->ipv4, 
+                 "DSRRouteManagerImpl::SPFIntraAddTransit (): "
+                 "GetObject for <Ipv4> interface failed");
 //
 // Get the Global Router Link State Advertisement from the vertex we're
 // adding the routes to.  The LSA will have a number of attached Global Router
 // Link Records corresponding to links off of that vertex / node.  We're going
 // to be interested in the records corresponding to point-to-point links.
 //
-          DSRRoutingLSA *lsa = v->GetLSA ();
-          NS_ASSERT_MSG (lsa, 
-                         "DSRRouteManagerImpl::SPFIntraAddTransit (): "
-                         "Expected valid LSA in DSRVertex* v");
-          Ipv4Mask tempmask = lsa->GetNetworkLSANetworkMask ();
-          Ipv4Address tempip = lsa->GetLinkStateId ();
-          tempip = tempip.CombineMask (tempmask);
-          Ptr<DSRRouter> router = node->GetObject<DSRRouter> ();
-          if (router == 0)
-            {
-              continue;
-            }
-          Ptr<Ipv4DSRRouting> gr = router->GetRoutingProtocol ();
-          NS_ASSERT (gr);
-          // walk through all available exit directions due to ECMP,
-          // and add host route for each of the exit direction toward
-          // the vertex 'v'
-          for (uint32_t i = 0; i < v->GetNRootExitDirections (); i++)
-            {
-              DSRVertex::NodeExit_t exit = v->GetRootExitDirection (i);
-              Ipv4Address nextHop = exit.first;
-              int32_t outIf = exit.second;
+  DSRRoutingLSA *lsa = v->GetLSA ();
+  NS_ASSERT_MSG (lsa, 
+                 "DSRRouteManagerImpl::SPFIntraAddTransit (): "
+                 "Expected valid LSA in DSRVertex* v");
+  Ipv4Mask tempmask = lsa->GetNetworkLSANetworkMask ();
+  Ipv4Address tempip = lsa->GetLinkStateId ();
+  tempip = tempip.CombineMask (tempmask);
+  // walk through all available exit directions due to ECMP,
+  // and add host route for each of the exit direction toward
+  // the vertex 'v'
+  for (uint32_t i = 0; i < v->GetNRootExitDirections (); i++)
+    {
+      DSRVertex::NodeExit_t exit = v->GetRootExitDirection (i);
+      Ipv4Address nextHop = exit.first;
+      int32_t outIf = exit.second;
 
-              if (outIf >= 0)
-                {
-                  gr->AddNetworkRouteTo (tempip, tempmask, nextHop, outIf);
-                  NS_LOG_LOGIC ("(Route " << i << ") Node " << node->GetId () <<
-                                " add network route to " << tempip <<
-                                " using next hop " << nextHop <<
-                                " via interface " << outIf);
-                }
-              else
-                {
-                  NS_LOG_LOGIC ("(Route " << i << ") Node " << node->GetId () <<
-                                " NOT able to add network route to " << tempip <<
-                                " using next hop " << nextHop <<
-                                " since outgoing interface id is negative " << outIf);
-                }
-            }
+      if (outIf >= 0)
+        {
+          SPFAddNetworkRoute (ctx, tempip, tempmask, nextHop, outIf, false);
+          NS_LOG_LOGIC ("(Route " << i << ") Node " << node->GetId () <<
+                        " add network route to " << tempip <<
+                        " using next hop " << nextHop <<
+                        " via interface " << outIf);
         }
-    } 
+      else
+        {
+          NS_LOG_LOGIC ("(Route " << i << ") Node " << node->GetId () <<
+                        " NOT able to add network route to " << tempip <<
+                        " using next hop " << nextHop <<
+                        " since outgoing interface id is negative " << outIf);
+        }
+    }
 }
 
 // Derived from quagga ospf_vertex_add_parents ()
@@ -26,18 +26,25 @@
 #include <list>
 #include <queue>
 #include <map>
+#include <set>
+#include <unordered_map>
 #include <vector>
+#include <atomic>
 #include "ns3/object.h"
 #include "ns3/ptr.h"
 #include "ns3/ipv4-address.h"
+#include "ns3/nstime.h"
+#include "ns3/event-id.h"
 #include "dsr-router-interface.h"
+#include "dsr-candidate-queue.h"
 
 namespace ns3 {
 
 const uint32_t DISTINFINITY = 0xffffffff; //!< "infinite" distance between nodes
 
-class DsrCandidateQueue;
+class DSRVertexArena;
 class Ipv4DSRRouting;
+class Ipv4;
 
 /**
  * \ingroup globalrouting
@@ -116,9 +123,12 @@ public:
 /**
  * @brief Destroy an DSRVertex (Shortest Path First Vertex).
  *
- * The children vertices of the DSRVertex are recursively deleted.
+ * The vertices of an SPF tree belong to the DSRVertexArena they were
+ * allocated from, which destroys them all at once; the children are not
+ * deleted with their parent.
  *
  * @see DSRVertex::DSRVertex ()
+ * @see DSRVertexArena
  */
   ~DSRVertex();
 
@@ -398,6 +408,9 @@ public:
  * @brief Set the pointer to the SPFVector that is the parent of "this" 
  * DSRVertex.
  *
+ * Both vertices must have been allocated from the same DSRVertexArena, 
+ * which links them by index.
+ *
  * Each router node in the simulation is associated with an DSRVertex object.
  * When calculating routes, each of these routers is, in turn, chosen as the 
  * "root" of the calculation and routes to all of the other routers are
@@ -489,9 +502,9 @@ public:
  * the SPF tree.
  *
  * @see DSRVertex::GetNChildren
- * @warning Ownership of the pointer added to the children of "this" 
- * DSRVertex is transferred to the "this" DSRVertex.  You must not delete the
- * (now) child DSRVertex after calling this method.
+ * @warning Both vertices must have been allocated from the same
+ * DSRVertexArena, which owns them.  You must not delete the (now) child
+ * DSRVertex after calling this method.
  * @param child A pointer to the DSRVertex (which resides in the SPF tree) to
  * be added to the list of children of "this" DSRVertex.
  * @returns The number of children of "this" DSRVertex after the addition of
@@ -526,18 +539,30 @@ public:
   void ClearVertexProcessed (void);
 
 private:
+  friend class DSRVertexArena;
+
+/**
+ * @brief Initialize the vertex from a Link State Advertisement, as the
+ * constructor does, keeping the memory of its lists.
+ *
+ * @param lsa The Link State Advertisement used for finding initial values.
+ */
+  void Init (DSRRoutingLSA* lsa);
+
   VertexType m_vertexType; //!< Vertex type
   Ipv4Address m_vertexId; //!< Vertex ID
   DSRRoutingLSA* m_lsa; //!< Link State Advertisement
   uint32_t m_distanceFromRoot; //!< Distance from root node
   int32_t m_rootOif; //!< root Output Interface
   Ipv4Address m_nextHop; //!< next hop
-  typedef std::list< NodeExit_t > ListOfNodeExit_t; //!< container of Exit nodes
+  typedef std::vector< NodeExit_t > ListOfNodeExit_t; //!< container of Exit nodes
   ListOfNodeExit_t m_ecmpRootExits; //!< store the multiple root's exits for supporting ECMP
-  typedef std::list<DSRVertex*> ListOfDSRVertex_t; //!< container of DSRVertexes
+  typedef std::vector<uint32_t> ListOfDSRVertex_t; //!< container of DSRVertexes, by index in m_arena
   ListOfDSRVertex_t m_parents; //!< parent list
   ListOfDSRVertex_t m_children; //!< Children list
   bool m_vertexProcessed; //!< Flag to note whether vertex has been processed in stage two of SPF computation
+  DSRVertexArena* m_arena; //!< arena the vertex was allocated from, 0 if none
+  uint32_t m_index; //!< index of the vertex in m_arena
 
 /**
  * @brief The DSRVertex copy construction is disallowed.  There's no need for
@@ -553,15 +578,82 @@ private:
  * @returns the copied object
  */
   DSRVertex& operator= (DSRVertex& v);
+};
 
-  /**
-   * \brief Stream insertion operator.
-   *
-   * \param os the reference to the output stream
-   * \param vs a list of DSRVertexes
-   * \returns the reference to the output stream
-   */
-  friend std::ostream& operator<< (std::ostream& os, const DSRVertex::ListOfDSRVertex_t& vs);
+/**
+ * @brief Bump allocator of the vertices of SPF trees.
+ *
+ * An SPF computation allocates a vertex for every router and network it
+ * reaches, and links them by index into the arena.  Reset () makes all of
+ * them available again for the next computation without freeing anything,
+ * and the vertices keep the memory of their lists, so that computing the
+ * trees of many roots in a row does not go through the heap once the arena
+ * has grown to the size of the largest tree.
+ *
+ * The vertices are kept in fixed size blocks, so that their addresses stay
+ * valid while the arena grows.
+ */
+class DSRVertexArena
+{
+public:
+  DSRVertexArena ();
+  ~DSRVertexArena ();
+
+/**
+ * @brief Allocate a vertex for a Link State Advertisement.
+ *
+ * @param lsa The Link State Advertisement of the vertex.
+ * @returns A vertex initialized as by DSRVertex::DSRVertex (lsa), valid until
+ * the next Reset ().
+ */
+  DSRVertex* Allocate (DSRRoutingLSA* lsa);
+
+/**
+ * @brief Give back the vertex allocated last.
+ *
+ * @param v The vertex, which must be the last one allocated and must not be
+ * linked to other vertices.
+ */
+  void Release (DSRVertex* v);
+
+/**
+ * @brief Give back all of the vertices.
+ */
+  void Reset (void);
+
+/**
+ * @brief Get a vertex by index.
+ *
+ * @param index The index of the vertex, less than GetNVertices ().
+ * @returns The vertex.
+ */
+  DSRVertex* Get (uint32_t index) const;
+
+/**
+ * @brief Get the number of vertices allocated since the last Reset ().
+ *
+ * @returns The number of vertices.
+ */
+  uint32_t GetNVertices (void) const;
+
+private:
+  static const uint32_t BLOCK_SIZE = 256; //!< number of vertices in a block
+
+  std::vector<DSRVertex*> m_blocks; //!< arrays of BLOCK_SIZE vertices
+  uint32_t m_size; //!< number of vertices allocated
+
+/**
+ * @brief DSRVertexArena copy construction is disallowed.
+ * @param arena object to copy from
+ */
+  DSRVertexArena (DSRVertexArena& arena);
+
+/**
+ * @brief DSRVertexArena copy assignment operator is disallowed.
+ * @param arena object to copy from
+ * @returns the copied object
+ */
+  DSRVertexArena& operator= (DSRVertexArena& arena);
 };
 
 /**
@@ -612,6 +704,31 @@ public:
  */
   void Insert (Ipv4Address addr, DSRRoutingLSA* lsa);
 
+/**
+ * @brief Take the Link State Advertisements of some routers out of the Link
+ * State Database.
+ *
+ * The router, network and AS external LSAs advertised by the given routers
+ * are removed.  The other LSAs keep their index, and a new LSA inserted
+ * with the link state ID of a removed one takes its index back, so that
+ * data indexed by LSA stays valid across an update; call Compact once the
+ * new LSAs of these routers are inserted.
+ *
+ * @param routers the advertising routers, by router ID
+ * @param removed receives the removed LSAs; the caller must delete them
+ */
+  void Remove (const std::set<Ipv4Address> &routers, std::vector<DSRRoutingLSA*> &removed);
+
+/**
+ * @brief Index the LSAs again after Remove and Insert.
+ *
+ * The indices left free by removed LSAs which were not inserted again are
+ * given to the LSAs which follow them.
+ *
+ * @returns true if the index of an LSA changed
+ */
+  bool Compact ();
+
 /**
  * @brief Look up the Link State Advertisement associated with the given
  * link state ID (address).
@@ -641,6 +758,23 @@ public:
  */
   DSRRoutingLSA* GetLSAByLinkData (Ipv4Address addr) const;
 
+/**
+ * @brief Get the number of router and network Link State Advertisements.
+ *
+ * The LSAs are indexed from 0 to this number, see DSRRoutingLSA::GetIndex.
+ *
+ * @returns the number of Link State Advertisements, without the external ones.
+ */
+  uint32_t GetNumLSAs () const;
+
+/**
+ * @brief Look up a router or network Link State Advertisement by its index.
+ *
+ * @param index the index of the LSA, less than GetNumLSAs ().
+ * @returns A pointer to the Link State Advertisement.
+ */
+  DSRRoutingLSA* GetLSAByIndex (uint32_t index) const;
+
 /**
  * @brief Set all LSA flags to an initialized state, for SPF computation
  *
@@ -679,8 +813,13 @@ private:
   typedef std::map<Ipv4Address, DSRRoutingLSA*> LSDBMap_t; //!< container of IPv4 addresses / Link State Advertisements
   typedef std::pair<Ipv4Address, DSRRoutingLSA*> LSDBPair_t; //!< pair of IPv4 addresses / Link State Advertisements
 
+  typedef std::unordered_map<Ipv4Address, DSRRoutingLSA*, Ipv4AddressHash> LinkDataMap_t; //!< container of transit link data / Link State Advertisements
+
   LSDBMap_t m_database; //!< database of IPv4 addresses / Link State Advertisements
+  std::vector<DSRRoutingLSA*> m_lsas; //!< the LSAs of m_database, by index
   std::vector<DSRRoutingLSA*> m_extdatabase; //!< database of External Link State Advertisements
+  LinkDataMap_t m_linkData; //!< LSA of the first transit network link record with each link data, see GetLSAByLinkData
+  std::map<Ipv4Address, uint32_t> m_vacant; //!< indices left by removed LSAs, by link state ID, see Remove
 
 /**
  * @brief DSRRouteManagerLSDB copy construction is disallowed.  There's no 
@@ -827,6 +966,52 @@ public:
  */
   virtual void InitializeRoutes ();
 
+/**
+ * @brief Recompute routes after a topology change.
+ *
+ * The LSAs of the nodes with pending interface events and of their
+ * neighbors are discovered again, replaced in place in the routing database
+ * and compared with the ones the routes were computed from; the LSAs of the
+ * other routers are kept as they are.  All the LSAs are discovered again
+ * when no change is pending or bridges are involved.
+ *
+ * Only the SPF trees which may route through a changed LSA are computed
+ * again, and only the routes those trees installed are replaced: host
+ * routes on the interface leading to the tree root and the network routes
+ * of the tree root.  Falls back to DeleteDSRRoutes (),
+ * BuildDSRRoutingDatabase () and InitializeRoutes () when no SPF trees were
+ * kept, or when transit networks or AS external LSAs are involved.
+ */
+  virtual void UpdateRoutes ();
+
+/**
+ * @brief Record a topology change and schedule a single route
+ * recomputation for all the changes received until it runs.
+ *
+ * Interface events come in bursts: bringing a node down notifies every
+ * interface on both sides of each of its links.  Like OSPF SPF throttling,
+ * the first change schedules the recomputation and the following ones are
+ * only recorded.
+ *
+ * @param nodeId the node on which the interface event happened
+ * @param holdDown delay of the recomputation after the first pending
+ * change; zero recomputes at the end of the current time step
+ * @param incremental true to use UpdateRoutes (); a full recomputation is
+ * done if any of the pending changes asks for one
+ */
+  void ScheduleRoutesUpdate (uint32_t nodeId, Time holdDown, bool incremental);
+
+/**
+ * @brief Hash the routing database built by BuildDSRRoutingDatabase ().
+ *
+ * The hash covers the LSAs and the interface addresses of the routers,
+ * everything InitializeRoutes () computes the routes from, so that two
+ * databases with the same hash give the same routes.
+ *
+ * @returns a 64 bit FNV-1a hash of the routing database
+ */
+  uint64_t GetLsdbHash (void) const;
+
 /**
  * @brief Debugging routine; allow client code to supply a pre-built LSDB
  */
@@ -858,9 +1043,212 @@ private:
  */
   DSRRouteManagerImpl& operator= (DSRRouteManagerImpl& srmi);
 
-  DSRVertex* m_spfroot; //!< the root node
   DSRRouteManagerLSDB* m_lsdb; //!< the Link State DataBase (LSDB) of the Global Route Manager
 
+  /**
+   * \brief What UpdateRoutes needs to know about the SPF tree of a root.
+   *
+   * The tree only depends on its root, not on the router it is computed
+   * for, so it is kept once per root.  Trees are only kept when a router
+   * recomputes its routes incrementally, see m_keepSPFTrees.
+   */
+  struct SPFTree
+  {
+    std::vector<uint32_t> distance; //!< distance from the root of the vertices in the tree, by LSA index; DISTINFINITY if not in the tree
+    bool truncated;                 //!< the root is a stub node, see CheckForStubNode
+  };
+  typedef std::map<Ipv4Address, SPFTree> SPFTrees_t; //!< SPF trees, by root
+
+  /**
+   * \brief The routers of the SPF tree of a root, for the current LSDB.
+   *
+   * Every neighbor of the root installs its host routes from the same tree,
+   * only offset by the metric of its own link to the root, so the tree is
+   * computed for the first neighbor and replayed for the others.
+   */
+  struct SPFResult
+  {
+    /// A network route of the root
+    struct NetworkRoute
+    {
+      Ipv4Address network; //!< destination network
+      Ipv4Mask mask;       //!< destination network mask
+      Ipv4Address nextHop; //!< next hop, 0.0.0.0 if the network is attached
+      uint32_t interface;  //!< outgoing interface
+      bool external;       //!< true for an AS external route
+    };
+
+    std::vector<std::pair<DSRRoutingLSA *, uint32_t> > routers; //!< router LSAs in the order they joined the tree, and their distance from the root
+    std::vector<NetworkRoute> networkRoutes; //!< network routes of the root, in the order they were found
+    SPFTree tree;   //!< the tree, moved to m_spfTrees when the result is first used
+    bool installed; //!< true once the result was first used
+  };
+  typedef std::map<Ipv4Address, SPFResult> SPFResults_t; //!< SPF results, by root
+
+  /**
+   * \brief Immutable adjacency of the LSDB, in compressed sparse row form.
+   *
+   * Vertices are the router and network LSAs, by LSA index.  The transit
+   * edges of vertex i are edges[edgeStart[i]] to edges[edgeStart[i + 1] - 1],
+   * in link record (or attached router) order, and its stub network link
+   * records are stubs[stubStart[i]] to stubs[stubStart[i + 1] - 1].  SPF
+   * walks these arrays instead of looking every link up in the LSDB.
+   */
+  struct SPFGraph
+  {
+    static const uint32_t NO_VERTEX = 0xffffffff; //!< target of a link to an LSA missing from the LSDB
+
+    /// A transit link, from a router to a router or network, or from a network to a router
+    struct Edge
+    {
+      uint32_t target;                  //!< LSA index of the far end
+      uint16_t metric;                  //!< metric of the link, 0 from a network
+      int32_t interface;                //!< interface of the link data on the router, -1 if unknown or from a network
+      DSRRoutingLinkRecord *record;     //!< the link record, 0 from a network
+      DSRRoutingLinkRecord *reverse;    //!< first link record of the far end back to this vertex, see SPFGetNextLink
+    };
+
+    std::vector<DSRRoutingLSA *> lsas;         //!< LSAs, by index
+    std::vector<uint32_t> edgeStart;           //!< first edge of each vertex, then the number of edges
+    std::vector<Edge> edges;                   //!< transit links
+    std::vector<uint32_t> stubStart;           //!< first stub of each vertex, then the number of stubs
+    std::vector<DSRRoutingLinkRecord *> stubs; //!< stub network link records
+    std::vector<std::pair<DSRRoutingLSA *, uint32_t> > externals; //!< AS external LSAs and the LSA index of their advertising router
+  };
+
+  SPFGraph m_graph; //!< adjacency of m_lsdb
+
+  /**
+   * \brief Build m_graph from m_lsdb.
+   */
+  void BuildSPFGraph (void);
+
+  /**
+   * \brief Scratch state of one SPF computation.
+   *
+   * The LSDB is only read during SPF, so several trees can be computed at
+   * once, each with its own context.
+   */
+  struct SPFContext
+  {
+    DSRVertex *root;                             //!< the root of the tree
+    std::vector<DSRRoutingLSA::SPFStatus> status; //!< status of each LSA, by LSA index
+    std::vector<DSRVertex *> vertices;           //!< vertex of each LSA in the tree, by LSA index
+    SPFResult *result;                           //!< where the tree is written
+    DSRVertexArena arena;                        //!< vertices of the tree, reset for each root
+    DsrCandidateQueue candidate;                 //!< candidate vertices, empty between roots
+  };
+
+  SPFContext m_context; //!< context of the SPF computations of SPFCalculate
+
+  EventId m_updateEvent;               //!< pending recomputation, see ScheduleRoutesUpdate
+  bool m_updateIncremental;            //!< false if a pending change asked for a full recomputation
+  std::set<uint32_t> m_dirtyNodes;     //!< nodes with pending interface events, see CollectDirtyNodes
+
+  /**
+   * \brief Recompute the routes for the pending changes.
+   */
+  void DoRoutesUpdate (void);
+
+  /**
+   * \brief Index the addresses of a node and, if it is a router, discover
+   * its LSAs and insert them in the LSDB.
+   * \param node the node
+   */
+  void AddNodeToDatabase (Ptr<Node> node);
+
+  /**
+   * \brief Find the nodes whose LSAs the pending changes may have changed:
+   * the nodes of m_dirtyNodes and the nodes they share a channel with.
+   * \param nodes receives the node IDs
+   * \return false if there is no pending change or a bridge is involved,
+   * in which case the LSAs of all the nodes must be discovered again
+   */
+  bool CollectDirtyNodes (std::set<uint32_t> &nodes) const;
+
+  /**
+   * \brief Discover the LSAs of some nodes again and replace theirs in the
+   * routing database, leaving those of the other nodes in place.
+   * \param nodes the node IDs
+   * \param removed receives the previous LSAs of the nodes; the caller must
+   * delete them
+   * \return true if the other LSAs kept their index, so that the SPF trees
+   * still apply
+   */
+  bool UpdateDSRRoutingDatabase (const std::set<uint32_t> &nodes,
+                                 std::vector<DSRRoutingLSA *> &removed);
+
+  SPFTrees_t m_spfTrees;     //!< trees of the last route computation
+  bool m_keepSPFTrees;       //!< true if a router recomputes its routes incrementally, so m_spfTrees is needed
+  SPFResults_t m_spfResults; //!< trees computed with the current LSDB
+  bool m_writeNetworkRoutes; //!< false to only install the host routes of the initial root
+
+  /// Objects of a router that routes are installed through
+  struct RouterEntry
+  {
+    Ptr<Node> node;              //!< the node
+    Ptr<Ipv4DSRRouting> routing; //!< routing protocol of the node
+    Ptr<Ipv4> ipv4;              //!< Ipv4 stack of the node
+    std::vector<std::pair<uint32_t, Ipv4Address> > addresses; //!< interface addresses of the node, in interface order, see FindOutgoingInterfaceId
+  };
+  typedef std::map<Ipv4Address, RouterEntry> RouterIndex_t; //!< routers, by router ID
+
+  RouterIndex_t m_routers;   //!< routers found by the last BuildDSRRoutingDatabase
+
+  /// Node and interface index that an address is assigned to
+  struct AddressEntry
+  {
+    Ptr<Node> node;      //!< the node
+    uint32_t interface;  //!< the interface index
+  };
+  typedef std::unordered_map<Ipv4Address, AddressEntry, Ipv4AddressHash> AddressIndex_t; //!< interfaces, by address
+
+  AddressIndex_t m_addresses; //!< interface addresses found by the last BuildDSRRoutingDatabase
+
+  /**
+   * \brief Find a router by router ID.
+   * \param routerId the router ID
+   * \return the router, or 0 if it does not take part in routing
+   */
+  const RouterEntry *LookupRouter (Ipv4Address routerId) const;
+
+  /**
+   * \brief Install the routes of a router through one of its point-to-point
+   * links: host routes to the addresses of the neighbor, then the routes
+   * of the SPF tree rooted at the neighbor.
+   *
+   * \param node the router's node
+   * \param v the router's vertex
+   * \param l the link record of the point-to-point link
+   */
+  void InitializeRoutesOnLink (Ptr<Node> node, DSRVertex *v, DSRRoutingLinkRecord *l);
+
+  /**
+   * \brief Test if the SPF tree of a root may change with an LSA.
+   *
+   * A tree is affected when a link of one of its vertices appears or
+   * disappears, since the initial roots have host routes to the address of
+   * every point-to-point link of the routers in the tree and the root has
+   * network routes to their stub links, or when a new link reaches one of
+   * its vertices from outside the tree.
+   *
+   * \param root the root of the tree
+   * \param tree the tree
+   * \param oldLsa the LSA the tree was computed with, or 0
+   * \param newLsa the LSA in the current LSDB, or 0
+   * \returns true if the tree must be computed again
+   */
+  bool SPFTreeAffected (Ipv4Address root, const SPFTree &tree,
+                        DSRRoutingLSA *oldLsa, DSRRoutingLSA *newLsa) const;
+
+  /**
+   * \brief Get the distance of a vertex from the root of an SPF tree.
+   * \param tree the tree
+   * \param id the vertex ID
+   * \returns the distance, or DISTINFINITY if the vertex is not in the tree
+   */
+  uint32_t TreeDistance (const SPFTree &tree, Ipv4Address id) const;
+
   /**
    * \brief Test if a node is a stub, from an OSPF sense.
    *
@@ -868,19 +1256,59 @@ private:
    * can safely be added to the next-hop router and SPF does not need
    * to be run
    *
+   * \param ctx the SPF computation
    * \param root the root node
    * \returns true if the node is a stub
    */
-  bool CheckForStubNode (Ipv4Address root);
+  bool CheckForStubNode (SPFContext &ctx, Ipv4Address root);
 
   /**
-   * \brief Calculate the shortest path first (SPF) tree
+   * \brief Install the routes of the shortest path first (SPF) tree of a
+   * root on a neighbor of the root
+   *
+   * The tree is computed by SPFCalculateTree the first time the root is
+   * seen with the current LSDB, unless SPFCalculateTrees already did.  The
+   * network routes of the tree are installed on the root then.
    *
-   * Equivalent to quagga ospf_spf_calculate
    * \param root the root node
+   * \param initroot the neighbor the host routes are installed on
+   * \param l the link record of the link from the root to the neighbor
+   * \param Iface the interface of the neighbor on that link
    */
   void SPFCalculate (Ipv4Address root, Ipv4Address initroot, DSRRoutingLinkRecord *l, uint32_t Iface);
 
+  /**
+   * \brief Calculate the shortest path first (SPF) tree
+   *
+   * Equivalent to quagga ospf_spf_calculate.  Nothing is installed: the
+   * routers and the network routes of the tree go to the result of the
+   * context, so trees of different roots can be computed concurrently.
+   *
+   * \param ctx the SPF computation; its result is filled
+   * \param root the root node
+   */
+  void SPFCalculateTree (SPFContext &ctx, Ipv4Address root);
+
+  /**
+   * \brief Calculate the SPF trees of several roots ahead of SPFCalculate.
+   *
+   * The roots are shared among DsrSpfThreads threads; each thread takes the
+   * next root not computed yet.  Routes are still installed by
+   * SPFCalculate, in the same order as with a single thread.
+   *
+   * \param roots the roots
+   */
+  void SPFCalculateTrees (const std::vector<Ipv4Address> &roots);
+
+  /**
+   * \brief Calculate SPF trees until none is left, for SPFCalculateTrees.
+   *
+   * \param jobs the roots and where their trees go
+   * \param next index of the next job to take
+   */
+  void SPFCalculateJobs (const std::vector<std::pair<Ipv4Address, SPFResult *> > &jobs,
+                         std::atomic<uint32_t> &next);
+
   /**
    * \brief Process Stub nodes
    *
@@ -888,17 +1316,22 @@ private:
    * stub link records will exist for point-to-point interfaces and for
    * broadcast interfaces for which no neighboring router can be found
    *
+   * \param ctx the SPF computation
    * \param v vertex to be processed
    */
-  void SPFProcessStubs (DSRVertex* v);
+  void SPFProcessStubs (SPFContext &ctx, DSRVertex* v);
 
   /**
    * \brief Process Autonomous Systems (AS) External LSA
    *
-   * \param v vertex to be processed
+   * The routes go through the vertex of the advertising router, if it is
+   * in the tree.
+   *
+   * \param ctx the SPF computation
    * \param extlsa external LSA
+   * \param advertiser LSA index of the advertising router
    */
-  void ProcessASExternals (DSRVertex* v, DSRRoutingLSA* extlsa);
+  void ProcessASExternals (SPFContext &ctx, DSRRoutingLSA* extlsa, uint32_t advertiser);
 
   /**
    * \brief Examine the links in v's LSA and update the list of candidates with any
@@ -918,10 +1351,11 @@ private:
    * vertices not already on the list.  If a lower-cost path is found to a
    * vertex already on the candidate list, store the new (lower) cost.
    *
+   * \param ctx the SPF computation
    * \param v the vertex
    * \param candidate the SPF candidate queue
    */
-  void SPFNext (DSRVertex* v, DsrCandidateQueue& candidate);
+  void SPFNext (SPFContext &ctx, DSRVertex* v, DsrCandidateQueue& candidate);
 
   /**
    * \brief Calculate nexthop from root through V (parent) to vertex W (destination)
@@ -930,14 +1364,15 @@ private:
    * This method is derived from quagga ospf_nexthop_calculation() 16.1.1.
    * For now, this is greatly simplified from the quagga code
    *
+   * \param ctx the SPF computation
    * \param v the parent
    * \param w the destination
-   * \param l the link record
+   * \param edge the link from v to w
    * \param distance the target distance
    * \returns 1 on success
    */
-  int SPFNexthopCalculation (DSRVertex* v, DSRVertex* w, 
-                             DSRRoutingLinkRecord* l, uint32_t distance);
+  int SPFNexthopCalculation (SPFContext &ctx, DSRVertex* v, DSRVertex* w, 
+                             const SPFGraph::Edge &edge, uint32_t distance);
 
   /**
    * \brief Adds a vertex to the list of children *in* each of its parents
@@ -996,48 +1431,90 @@ private:
    * a destination IP address, reachable from the root, to which we add a host
    * route.
    *
-   * \param v the vertex
+   * \param lsa the LSA of the vertex
+   * \param distance the distance of the vertex from the initial root
+   * \param initroot the router to install the routes on
+   * \param nextHop the next hop of the routes
+   * \param Iface the outgoing interface of the routes
    *
    */
-  void SPFIntraAddRouter (DSRVertex* v, DSRVertex* v_init, Ipv4Address nextHop,  uint32_t Iface);
+  void SPFIntraAddRouter (DSRRoutingLSA* lsa, uint32_t distance, Ipv4Address initroot, Ipv4Address nextHop,  uint32_t Iface);
 
   /**
    * \brief Add a transit to the routing tables
    *
+   * \param ctx the SPF computation
    * \param v the vertex
    */
-  void SPFIntraAddTransit (DSRVertex* v);
+  void SPFIntraAddTransit (SPFContext &ctx, DSRVertex* v);
 
   /**
    * \brief Add a stub to the routing tables
    *
+   * \param ctx the SPF computation
    * \param l the global routing link record
    * \param v the vertex
    */
-  void SPFIntraAddStub (DSRRoutingLinkRecord *l, DSRVertex* v);
+  void SPFIntraAddStub (SPFContext &ctx, DSRRoutingLinkRecord *l, DSRVertex* v);
 
   /**
    * \brief Add an external route to the routing tables
    *
+   * \param ctx the SPF computation
    * \param extlsa the external LSA
    * \param v the vertex
    */
-  void SPFAddASExternal (DSRRoutingLSA *extlsa, DSRVertex *v);
+  void SPFAddASExternal (SPFContext &ctx, DSRRoutingLSA *extlsa, DSRVertex *v);
+
+  /**
+   * \brief Record a network route of the root of an SPF computation
+   *
+   * \param ctx the SPF computation
+   * \param network the destination network
+   * \param mask the destination network mask
+   * \param nextHop the next hop
+   * \param interface the outgoing interface
+   * \param external true for an AS external route
+   */
+  void SPFAddNetworkRoute (SPFContext &ctx, Ipv4Address network, Ipv4Mask mask,
+                           Ipv4Address nextHop, uint32_t interface, bool external);
 
   /**
    * \brief Return the interface number corresponding to a given IP address and mask
    *
-   * This is a wrapper around GetInterfaceForPrefix(), but we first
-   * have to find the right node pointer to pass to that function.
+   * This does what GetInterfaceForPrefix() does on the root of the SPF
+   * computation, from the addresses recorded by BuildDSRRoutingDatabase so
+   * that the Ipv4 stack is not used during SPF.
    * If no such interface is found, return -1 (note:  unit test framework
    * for routing assumes -1 to be a legal return value)
    *
+   * \param ctx the SPF computation
    * \param a the target IP address
    * \param amask the target subnet mask
    * \return the outgoing interface number
    */
-  int32_t FindOutgoingInterfaceId (Ipv4Address a, 
+  int32_t FindOutgoingInterfaceId (const SPFContext &ctx, Ipv4Address a, 
                                    Ipv4Mask amask = Ipv4Mask ("255.255.255.255"));
+
+  /**
+   * \brief Return the interface number of a router corresponding to a given
+   * IP address and mask
+   *
+   * \param rtr the router, may be null
+   * \param a the target IP address
+   * \param amask the target subnet mask
+   * \return the interface number, or -1 if there is none
+   */
+  int32_t FindInterfaceForPrefix (const RouterEntry *rtr, Ipv4Address a, Ipv4Mask amask) const;
+
+  /**
+   * \brief Return the first link record of an LSA with a given link ID
+   *
+   * \param lsa the LSA
+   * \param linkId the link ID
+   * \return the link record, or 0 if there is none
+   */
+  DSRRoutingLinkRecord* FindLinkRecord (DSRRoutingLSA *lsa, Ipv4Address linkId) const;
 };
 
 } // namespace ns3
@@ -23,6 +23,7 @@
 #include "ns3/simulation-singleton.h"
 #include "dsr-route-manager.h"
 #include "dsr-route-manager-impl.h"
+#include "dsr-route-profile.h"
 
 namespace ns3 {
 
@@ -46,6 +47,8 @@ void
 DSRRouteManager::BuildDSRRoutingDatabase (void) 
 {
   NS_LOG_FUNCTION_NOARGS ();
+  DsrRouteProfile::Update ();
+  DsrRouteProfile::Reset ();
   SimulationSingleton<DSRRouteManagerImpl>::Get ()->
   BuildDSRRoutingDatabase ();
 }
@@ -54,8 +57,37 @@ void
 DSRRouteManager::InitializeRoutes (void)
 {
   NS_LOG_FUNCTION_NOARGS ();
+  DsrRouteProfile::Update ();
   SimulationSingleton<DSRRouteManagerImpl>::Get ()->
   InitializeRoutes ();
+  DsrRouteProfile::Write ();
+}
+
+void
+DSRRouteManager::UpdateRoutes (void)
+{
+  NS_LOG_FUNCTION_NOARGS ();
+  DsrRouteProfile::Update ();
+  DsrRouteProfile::Reset ();
+  SimulationSingleton<DSRRouteManagerImpl>::Get ()->
+  UpdateRoutes ();
+  DsrRouteProfile::Write ();
+}
+
+void
+DSRRouteManager::ScheduleRoutesUpdate (uint32_t nodeId, Time holdDown, bool incremental)
+{
+  NS_LOG_FUNCTION (nodeId << holdDown << incremental);
+  SimulationSingleton<DSRRouteManagerImpl>::Get ()->
+  ScheduleRoutesUpdate (nodeId, holdDown, incremental);
+}
+
+uint64_t
+DSRRouteManager::GetLsdbHash (void)
+{
+  NS_LOG_FUNCTION_NOARGS ();
+  return SimulationSingleton<DSRRouteManagerImpl>::Get ()->
+         GetLsdbHash ();
 }
 
 uint32_t
@@ -22,6 +22,9 @@
 #ifndef DSR_ROUTE_MANAGER_H
 #define DSR_ROUTE_MANAGER_H
 
+#include <stdint.h>
+#include "ns3/nstime.h"
+
 namespace ns3 {
 
 /**
@@ -65,6 +68,31 @@ public:
  */
   static void InitializeRoutes ();
 
+/**
+ * @brief Recompute routes after a topology change, replacing only the
+ * routes of the SPF trees affected by the LSAs which changed
+ */
+  static void UpdateRoutes ();
+
+/**
+ * @brief Record a topology change and schedule a single route
+ * recomputation for all the changes received until it runs
+ *
+ * @param nodeId the node on which the interface event happened
+ * @param holdDown delay of the recomputation after the first pending
+ * change; zero recomputes at the end of the current time step
+ * @param incremental true to use UpdateRoutes (); a full recomputation is
+ * done if any of the pending changes asks for one
+ */
+  static void ScheduleRoutesUpdate (uint32_t nodeId, Time holdDown, bool incremental);
+
+/**
+ * @brief Hash the routing database built by BuildDSRRoutingDatabase ()
+ *
+ * @returns a hash which only changes with the routes the database gives
+ */
+  static uint64_t GetLsdbHash ();
+
 private:
 /**
  * @brief Global Route Manager copy construction is disallowed.  There's no 
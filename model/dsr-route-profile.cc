@@ -0,0 +1,202 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+
+#include <atomic>
+#include <fstream>
+#include "ns3/fatal-error.h"
+#include "ns3/global-value.h"
+#include "ns3/log.h"
+#include "ns3/string.h"
+#include "dsr-route-profile.h"
+
+namespace ns3 {
+
+NS_LOG_COMPONENT_DEFINE ("DsrRouteProfile");
+
+/**
+ * \brief File the route computation profile is written to; empty to
+ * disable profiling.
+ *
+ * Can be set with NS_GLOBAL_VALUE="DsrRouteProfile=<file>" or --DsrRouteProfile.
+ */
+static GlobalValue g_dsrRouteProfile ("DsrRouteProfile",
+                                      "JSON file the DSR route computation profile is written to; "
+                                      "empty to disable profiling",
+                                      StringValue (""),
+                                      MakeStringChecker ());
+
+/// Number of buckets of the SPF tree time histogram
+static const uint32_t N_BUCKETS = 32;
+
+static std::atomic<bool> g_enabled (false);                               //!< true if profiling is enabled
+static std::atomic<uint64_t> g_calls[DsrRouteProfile::N_PHASES];          //!< calls of each phase
+static std::atomic<uint64_t> g_ns[DsrRouteProfile::N_PHASES];             //!< time spent in each phase, in nanoseconds
+static std::atomic<uint64_t> g_counters[DsrRouteProfile::N_COUNTERS];     //!< value of each counter
+static std::atomic<uint64_t> g_treeBuckets[N_BUCKETS];                    //!< SPF trees by time, see AddTime
+
+/// Names of the phases in the JSON object
+static const char *g_phaseNames[DsrRouteProfile::N_PHASES] =
+{
+  "BuildDSRRoutingDatabase",
+  "InitializeRoutes",
+  "UpdateRoutes",
+  "SPFCalculate",
+  "SPFCalculateTree",
+  "SPFNext",
+  "SPFIntraAddRouter"
+};
+
+/// Names of the counters in the JSON object
+static const char *g_counterNames[DsrRouteProfile::N_COUNTERS] =
+{
+  "verticesPushed",
+  "verticesPopped",
+  "lsaLookups",
+  "entriesInstalled"
+};
+
+void
+DsrRouteProfile::Update (void)
+{
+  StringValue value;
+  g_dsrRouteProfile.GetValue (value);
+  g_enabled.store (!value.Get ().empty (), std::memory_order_relaxed);
+}
+
+bool
+DsrRouteProfile::IsEnabled (void)
+{
+  return g_enabled.load (std::memory_order_relaxed);
+}
+
+void
+DsrRouteProfile::Count (Counter counter, uint64_t n)
+{
+  if (g_enabled.load (std::memory_order_relaxed))
+    {
+      g_counters[counter].fetch_add (n, std::memory_order_relaxed);
+    }
+}
+
+//
+// The SPF trees are also sorted by time: bucket 0 counts the trees computed
+// in less than a microsecond, and bucket k > 0 those computed in 2^(k-1) to
+// 2^k microseconds, the last bucket counting all the longer ones.
+//
+void
+DsrRouteProfile::AddTime (Phase phase, uint64_t ns)
+{
+  g_calls[phase].fetch_add (1, std::memory_order_relaxed);
+  g_ns[phase].fetch_add (ns, std::memory_order_relaxed);
+  if (phase == SPF_TREE)
+    {
+      uint32_t bucket = 0;
+      for (uint64_t us = ns / 1000; us != 0 && bucket < N_BUCKETS - 1; us >>= 1)
+        {
+          bucket++;
+        }
+      g_treeBuckets[bucket].fetch_add (1, std::memory_order_relaxed);
+    }
+}
+
+void
+DsrRouteProfile::Reset (void)
+{
+  NS_LOG_FUNCTION_NOARGS ();
+  for (uint32_t i = 0; i < N_PHASES; i++)
+    {
+      g_calls[i].store (0, std::memory_order_relaxed);
+      g_ns[i].store (0, std::memory_order_relaxed);
+    }
+  for (uint32_t i = 0; i < N_COUNTERS; i++)
+    {
+      g_counters[i].store (0, std::memory_order_relaxed);
+    }
+  for (uint32_t i = 0; i < N_BUCKETS; i++)
+    {
+      g_treeBuckets[i].store (0, std::memory_order_relaxed);
+    }
+}
+
+void
+DsrRouteProfile::WriteJson (std::ostream &os)
+{
+  os << "{\n  \"phases\": {";
+  for (uint32_t i = 0; i < N_PHASES; i++)
+    {
+      os << (i ? ",\n" : "\n") << "    \"" << g_phaseNames[i] << "\": { \"calls\": "
+         << g_calls[i].load (std::memory_order_relaxed) << ", \"ns\": "
+         << g_ns[i].load (std::memory_order_relaxed) << " }";
+    }
+  os << "\n  },\n  \"counters\": {";
+  for (uint32_t i = 0; i < N_COUNTERS; i++)
+    {
+      os << (i ? ",\n" : "\n") << "    \"" << g_counterNames[i] << "\": "
+         << g_counters[i].load (std::memory_order_relaxed);
+    }
+//
+// Only the buckets which counted trees are written, each with the upper
+// bound of its times in microseconds; the last one has no bound.
+//
+  os << "\n  },\n  \"spfTreeHistogram\": [";
+  bool first = true;
+  for (uint32_t i = 0; i < N_BUCKETS; i++)
+    {
+      uint64_t count = g_treeBuckets[i].load (std::memory_order_relaxed);
+      if (count == 0)
+        {
+          continue;
+        }
+      os << (first ? "\n" : ",\n") << "    { \"maxUs\": ";
+      if (i < N_BUCKETS - 1)
+        {
+          os << (uint64_t (1) << i);
+        }
+      else
+        {
+          os << "null";
+        }
+      os << ", \"trees\": " << count << " }";
+      first = false;
+    }
+  os << "\n  ]\n}\n";
+}
+
+void
+DsrRouteProfile::Write (void)
+{
+  NS_LOG_FUNCTION_NOARGS ();
+  StringValue value;
+  g_dsrRouteProfile.GetValue (value);
+  std::string filename = value.Get ();
+  if (filename.empty ())
+    {
+      return;
+    }
+  std::ofstream file (filename.c_str (), std::ios::out | std::ios::trunc);
+  if (!file.is_open ())
+    {
+      NS_FATAL_ERROR ("Can not open route profile file " << filename);
+    }
+  WriteJson (file);
+}
+
+DsrRouteProfileScope::DsrRouteProfileScope (DsrRouteProfile::Phase phase)
+  : m_phase (phase),
+    m_enabled (DsrRouteProfile::IsEnabled ())
+{
+  if (m_enabled)
+    {
+      m_start = std::chrono::steady_clock::now ();
+    }
+}
+
+DsrRouteProfileScope::~DsrRouteProfileScope ()
+{
+  if (m_enabled)
+    {
+      std::chrono::steady_clock::duration d = std::chrono::steady_clock::now () - m_start;
+      DsrRouteProfile::AddTime (m_phase, std::chrono::duration_cast<std::chrono::nanoseconds> (d).count ());
+    }
+}
+
+} // namespace ns3
@@ -0,0 +1,155 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+#ifndef DSR_ROUTE_PROFILE_H
+#define DSR_ROUTE_PROFILE_H
+
+#include <stdint.h>
+#include <chrono>
+#include <ostream>
+#include <string>
+
+namespace ns3 {
+
+/**
+ * \ingroup dsr-routing
+ *
+ * \brief Time spent in the phases of the DSR route computation, and counts
+ * of its basic operations.
+ *
+ * Profiling is enabled by naming a file with the DsrRouteProfile global
+ * value, e.g. NS_GLOBAL_VALUE="DsrRouteProfile=routes.json".  The totals
+ * of the last route computation are then written to that file as JSON at
+ * its end: for each phase, the number of calls and the time spent, for
+ * each counter its value, and a histogram of the time taken by the SPF
+ * tree of each root.  The totals are reset when a computation starts,
+ * that is by DSRRouteManager::BuildDSRRoutingDatabase, by
+ * DSRRouteManager::UpdateRoutes and by the recomputation after interface
+ * events.  When profiling is disabled, the scopes and counters cost one
+ * relaxed atomic load.
+ *
+ * The phases are nested, so the time of a phase includes the time of the
+ * phases it calls.  SPF trees are computed by several threads when
+ * DsrSpfThreads is not 1; the time of the phases they run is then summed
+ * over the threads.
+ */
+class DsrRouteProfile
+{
+public:
+  /// Profiled phases of the route computation
+  enum Phase
+  {
+    BUILD_DATABASE = 0,   //!< DSRRouteManagerImpl::BuildDSRRoutingDatabase
+    INITIALIZE_ROUTES,    //!< DSRRouteManagerImpl::InitializeRoutes
+    UPDATE_ROUTES,        //!< DSRRouteManagerImpl::UpdateRoutes
+    SPF_CALCULATE,        //!< DSRRouteManagerImpl::SPFCalculate
+    SPF_TREE,             //!< DSRRouteManagerImpl::SPFCalculateTree
+    SPF_NEXT,             //!< DSRRouteManagerImpl::SPFNext
+    SPF_INTRA_ADD_ROUTER, //!< DSRRouteManagerImpl::SPFIntraAddRouter
+    N_PHASES              //!< number of phases
+  };
+
+  /// Counted operations of the route computation
+  enum Counter
+  {
+    VERTICES_PUSHED = 0,  //!< vertices pushed on the SPF candidate queue
+    VERTICES_POPPED,      //!< vertices popped from the SPF candidate queue
+    LSA_LOOKUPS,          //!< LSAs looked up by address in the LSDB
+    ENTRIES_INSTALLED,    //!< routing table entries installed
+    N_COUNTERS            //!< number of counters
+  };
+
+  /**
+   * \brief Read the DsrRouteProfile global value, which enables profiling
+   * when it names a file.  Called when a route computation starts.
+   */
+  static void Update (void);
+
+  /**
+   * \return true if profiling is enabled
+   */
+  static bool IsEnabled (void);
+
+  /**
+   * \brief Add to a counter, if profiling is enabled.
+   * \param counter the counter
+   * \param n the amount to add
+   */
+  static void Count (Counter counter, uint64_t n = 1);
+
+  /**
+   * \brief Account for one call of a phase.
+   * \param phase the phase
+   * \param ns the time spent in the call, in nanoseconds
+   */
+  static void AddTime (Phase phase, uint64_t ns);
+
+  /**
+   * \brief Reset all the totals, counters and the histogram.  Called when
+   * a route computation starts.
+   */
+  static void Reset (void);
+
+  /**
+   * \brief Write the totals, counters and histogram as a JSON object.
+   * \param os the output stream
+   */
+  static void WriteJson (std::ostream &os);
+
+  /**
+   * \brief Write the JSON object to the file named by the DsrRouteProfile
+   * global value, if profiling is enabled.
+   */
+  static void Write (void);
+
+private:
+  /**
+   * \brief Copy construction is disallowed.
+   * \param o object to copy from
+   */
+  DsrRouteProfile (DsrRouteProfile &o);
+
+  /**
+   * \brief Copy assignment operator is disallowed.
+   * \param o object to copy from
+   * \returns the copied object
+   */
+  DsrRouteProfile& operator= (DsrRouteProfile &o);
+};
+
+/**
+ * \ingroup dsr-routing
+ *
+ * \brief Account for the time until the end of the enclosing block in a
+ * phase of the route computation.
+ */
+class DsrRouteProfileScope
+{
+public:
+  /**
+   * \brief Start timing a phase, if profiling is enabled.
+   * \param phase the phase
+   */
+  DsrRouteProfileScope (DsrRouteProfile::Phase phase);
+  ~DsrRouteProfileScope ();
+
+private:
+  /**
+   * \brief Copy construction is disallowed.
+   * \param o object to copy from
+   */
+  DsrRouteProfileScope (DsrRouteProfileScope &o);
+
+  /**
+   * \brief Copy assignment operator is disallowed.
+   * \param o object to copy from
+   * \returns the copied object
+   */
+  DsrRouteProfileScope& operator= (DsrRouteProfileScope &o);
+
+  DsrRouteProfile::Phase m_phase;                 //!< the phase
+  bool m_enabled;                                 //!< true if profiling was enabled at the start
+  std::chrono::steady_clock::time_point m_start;  //!< start of the scope
+};
+
+} // namespace ns3
+
+#endif /* DSR_ROUTE_PROFILE_H */
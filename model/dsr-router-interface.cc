@@ -143,7 +143,8 @@ DSRRoutingLSA::DSRRoutingLSA()
     m_networkLSANetworkMask ("0.0.0.0"),
     m_attachedRouters (),
     m_status (DSRRoutingLSA::LSA_SPF_NOT_EXPLORED),
-    m_node_id (0)
+    m_node_id (0),
+    m_index (0)
 {
   NS_LOG_FUNCTION (this);
 }
@@ -160,7 +161,8 @@ DSRRoutingLSA::DSRRoutingLSA (
     m_networkLSANetworkMask ("0.0.0.0"),
     m_attachedRouters (),
     m_status (status),
-    m_node_id (0)
+    m_node_id (0),
+    m_index (0)
 {
   NS_LOG_FUNCTION (this << status << linkStateId << advertisingRtr);
 }
@@ -170,7 +172,8 @@ DSRRoutingLSA::DSRRoutingLSA (DSRRoutingLSA& lsa)
     m_advertisingRtr (lsa.m_advertisingRtr),
     m_networkLSANetworkMask (lsa.m_networkLSANetworkMask),
     m_status (lsa.m_status),
-    m_node_id (lsa.m_node_id)
+    m_node_id (lsa.m_node_id),
+    m_index (lsa.m_index)
 {
   NS_LOG_FUNCTION (this << &lsa);
   NS_ASSERT_MSG (IsEmpty (),
@@ -188,6 +191,7 @@ DSRRoutingLSA::operator= (const DSRRoutingLSA& lsa)
   m_networkLSANetworkMask = lsa.m_networkLSANetworkMask, 
   m_status = lsa.m_status;
   m_node_id = lsa.m_node_id;
+  m_index = lsa.m_index;
 
   ClearLinkRecords ();
   CopyLinkRecords (lsa);
@@ -198,21 +202,7 @@ void
 DSRRoutingLSA::CopyLinkRecords (const DSRRoutingLSA& lsa)
 {
   NS_LOG_FUNCTION (this << &lsa);
-  for (ListOfLinkRecords_t::const_iterator i = lsa.m_linkRecords.begin ();
-       i != lsa.m_linkRecords.end (); 
-       i++)
-    {
-      DSRRoutingLinkRecord *pSrc = *i;
-      DSRRoutingLinkRecord *pDst = new DSRRoutingLinkRecord;
-
-      pDst->SetLinkType (pSrc->GetLinkType ());
-      pDst->SetLinkId (pSrc->GetLinkId ());
-      pDst->SetLinkData (pSrc->GetLinkData ());
-      pDst->SetMetric (pSrc->GetMetric ());
-
-      m_linkRecords.push_back (pDst);
-      pDst = 0;
-    }
+  m_linkRecords.insert (m_linkRecords.end (), lsa.m_linkRecords.begin (), lsa.m_linkRecords.end ());
 
   m_attachedRouters = lsa.m_attachedRouters;
 }
@@ -227,18 +217,6 @@ void
 DSRRoutingLSA::ClearLinkRecords (void)
 {
   NS_LOG_FUNCTION (this);
-  for ( ListOfLinkRecords_t::iterator i = m_linkRecords.begin ();
-        i != m_linkRecords.end (); 
-        i++)
-    {
-      NS_LOG_LOGIC ("Free link record");
-
-      DSRRoutingLinkRecord *p = *i;
-      delete p;
-      p = 0;
-
-      *i = 0;
-    }
   NS_LOG_LOGIC ("Clear list");
   m_linkRecords.clear ();
 }
@@ -247,7 +225,8 @@ uint32_t
 DSRRoutingLSA::AddLinkRecord (DSRRoutingLinkRecord* lr)
 {
   NS_LOG_FUNCTION (this << lr);
-  m_linkRecords.push_back (lr);
+  m_linkRecords.push_back (*lr);
+  delete lr;
   return m_linkRecords.size ();
 }
 
@@ -262,18 +241,14 @@ DSRRoutingLinkRecord *
 DSRRoutingLSA::GetLinkRecord (uint32_t n) const
 {
   NS_LOG_FUNCTION (this << n);
-  uint32_t j = 0;
-  for ( ListOfLinkRecords_t::const_iterator i = m_linkRecords.begin ();
-        i != m_linkRecords.end (); 
-        i++, j++)
-    {
-      if (j == n) 
-        {
-          return *i;
-        }
-    }
-  NS_ASSERT_MSG (false, "DSRRoutingLSA::GetLinkRecord (): invalid index");
-  return 0;
+  NS_ASSERT_MSG (n < m_linkRecords.size (), "DSRRoutingLSA::GetLinkRecord (): invalid index");
+  return const_cast<DSRRoutingLinkRecord *> (&m_linkRecords[n]);
+}
+
+const DSRRoutingLSA::ListOfLinkRecords_t&
+DSRRoutingLSA::GetLinkRecords (void) const
+{
+  return m_linkRecords;
 }
 
 bool
@@ -386,6 +361,20 @@ DSRRoutingLSA::SetStatus (DSRRoutingLSA::SPFStatus status)
   m_status = status;
 }
 
+uint32_t
+DSRRoutingLSA::GetIndex (void) const
+{
+  NS_LOG_FUNCTION (this);
+  return m_index;
+}
+
+void
+DSRRoutingLSA::SetIndex (uint32_t index)
+{
+  NS_LOG_FUNCTION (this << index);
+  m_index = index;
+}
+
 Ptr<Node>
 DSRRoutingLSA::GetNode (void) const
 {
@@ -434,7 +423,7 @@ DSRRoutingLSA::Print (std::ostream &os) const
             i != m_linkRecords.end (); 
             i++)
         {
-          DSRRoutingLinkRecord *p = *i;
+          const DSRRoutingLinkRecord *p = &*i;
 
           os << "---------- RouterLSA Link Record ----------" << std::endl;
           os << "m_linkType = " << p->m_linkType;
@@ -24,6 +24,7 @@
 
 #include <stdint.h>
 #include <list>
+#include <vector>
 #include "ns3/object.h"
 #include "ns3/ptr.h"
 #include "ns3/node.h"
@@ -347,6 +348,9 @@ public:
 /**
  * @brief Add a given Global Routing Link Record to the LSA.
  *
+ * The record is copied into the LSA, which takes ownership of it and frees
+ * it.
+ *
  * @param lr The Global Routing Link Record to be added.
  * @returns The number of link records in the list.
  */
@@ -362,11 +366,27 @@ public:
 /**
  * @brief Return a pointer to the specified Global Routing Link Record.
  *
+ * The pointer is valid until link records are added to or removed from the
+ * LSA.
+ *
  * @param n The LSA number desired.
  * @returns The number of link records in the list.
  */
   DSRRoutingLinkRecord* GetLinkRecord (uint32_t n) const;
 
+/**
+ * A convenience typedef to avoid too much writers cramp.
+ */
+  typedef std::vector<DSRRoutingLinkRecord> ListOfLinkRecords_t;
+
+/**
+ * @brief Return the Global Routing Link Records of the LSA, for range
+ * iteration.
+ *
+ * @returns The link records, in the order they were added.
+ */
+  const ListOfLinkRecords_t& GetLinkRecords (void) const;
+
 /**
  * @brief Release all of the Global Routing Link Records present in the Global
  * Routing Link State Advertisement and make the list of link records empty.
@@ -491,6 +511,22 @@ public:
  */
   void SetStatus (SPFStatus status);
 
+/**
+ * @brief Get the index of the advertisement in the Link State Database.
+ *
+ * The indexes of the LSAs of a database are dense, so that SPF computations
+ * can keep per-LSA state in arrays instead of in the shared LSAs.
+ *
+ * @returns The index of the LSA.
+ */
+  uint32_t GetIndex (void) const;
+
+/**
+ * @brief Set the index of the advertisement in the Link State Database.
+ * @param index the index
+ */
+  void SetIndex (uint32_t index);
+
 /**
  * @brief Get the Node pointer of the node that originated this LSA
  * @returns Node pointer
@@ -527,18 +563,13 @@ private:
  */
   Ipv4Address  m_advertisingRtr;
 
-/**
- * A convenience typedef to avoid too much writers cramp.
- */
-  typedef std::list<DSRRoutingLinkRecord*> ListOfLinkRecords_t;
-
 /**
  * Each Link State Advertisement contains a number of Link Records that
  * describe the kinds of links that are attached to a given node.  We 
  * consider PointToPoint and StubNetwork links.
  *
- * m_linkRecords is an STL list container to hold the Link Records that have
- * been discovered and prepared for the advertisement.
+ * m_linkRecords is an STL vector holding, by value, the Link Records that
+ * have been discovered and prepared for the advertisement.
  *
  * @see GlobalRouting::DiscoverLSAs ()
  */
@@ -572,6 +603,7 @@ private:
  */
   SPFStatus m_status;
   uint32_t m_node_id; //!< node ID
+  uint32_t m_index;   //!< index in the Link State Database
 };
 
 /**
@@ -0,0 +1,361 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "ns3/assert.h"
+#include "ns3/fatal-error.h"
+#include "ns3/log.h"
+#include "ns3/node.h"
+#include "ns3/node-list.h"
+#include "dsr-router-interface.h"
+#include "ipv4-dsr-routing.h"
+#include "ipv4-dsr-routing-table-entry.h"
+#include "dsr-routing-snapshot.h"
+
+namespace ns3 {
+
+NS_LOG_COMPONENT_DEFINE ("DsrRoutingSnapshot");
+
+/**
+ * \brief Get the DSR routing protocol of a node.
+ * \param node the node
+ * \return the routing protocol, 0 if the node is not a DSR router
+ */
+static Ptr<Ipv4DSRRouting>
+GetDsrRouting (Ptr<Node> node)
+{
+  Ptr<DSRRouter> router = node->GetObject<DSRRouter> ();
+  if (router == 0)
+    {
+      return 0;
+    }
+  return router->GetRoutingProtocol ();
+}
+
+/**
+ * \brief Bounds-checked reader of a mapped snapshot.
+ */
+class DsrSnapshotReader
+{
+public:
+  /**
+   * \param data start of the snapshot
+   * \param size size of the snapshot, in bytes
+   */
+  DsrSnapshotReader (const uint8_t *data, uint64_t size)
+    : m_data (data),
+      m_left (size)
+  {
+  }
+  /**
+   * \brief Skip a number of bytes.
+   * \param size the number of bytes
+   * \return the skipped bytes, or 0 if the snapshot is too short
+   */
+  const uint8_t *Take (uint64_t size)
+  {
+    if (size > m_left)
+      {
+        return 0;
+      }
+    const uint8_t *data = m_data;
+    m_data += size;
+    m_left -= size;
+    return data;
+  }
+  /**
+   * \brief Read a uint32_t.
+   * \param value where the value is stored
+   * \return false if the snapshot is too short
+   */
+  bool Read (uint32_t &value)
+  {
+    const uint8_t *data = Take (sizeof (value));
+    if (data == 0)
+      {
+        return false;
+      }
+    std::memcpy (&value, data, sizeof (value));
+    return true;
+  }
+  /**
+   * \return true if the whole snapshot was read
+   */
+  bool AtEnd (void) const
+  {
+    return m_left == 0;
+  }
+private:
+  const uint8_t *m_data; //!< next byte to read
+  uint64_t m_left;       //!< number of bytes left
+};
+
+void
+DsrRoutingSnapshot::Save (std::string filename, uint64_t lsdbHash)
+{
+  NS_LOG_FUNCTION (filename << lsdbHash);
+  std::vector<std::pair<uint32_t, Ptr<Ipv4DSRRouting> > > routers;
+  for (NodeList::Iterator i = NodeList::Begin (); i != NodeList::End (); i++)
+    {
+      Ptr<Ipv4DSRRouting> routing = GetDsrRouting (*i);
+      if (routing)
+        {
+          routers.push_back (std::make_pair ((*i)->GetId (), routing));
+        }
+    }
+
+  std::ostringstream tmp;
+  tmp << filename << ".tmp." << getpid ();
+  std::ofstream file (tmp.str ().c_str (), std::ios::out | std::ios::binary | std::ios::trunc);
+  if (!file.is_open ())
+    {
+      NS_FATAL_ERROR ("Can not open routing snapshot file " << tmp.str ());
+    }
+  uint32_t fileHeader[4] = { DSR_ROUTING_SNAPSHOT_MAGIC, DSR_ROUTING_SNAPSHOT_VERSION,
+                             sizeof (Ipv4DSRRouting::HostRoute), (uint32_t)routers.size () };
+  file.write ((const char *)fileHeader, sizeof (fileHeader));
+  file.write ((const char *)&lsdbHash, sizeof (lsdbHash));
+
+  std::vector<uint32_t> words;
+  for (uint32_t r = 0; r < routers.size (); r++)
+    {
+      const Ipv4DSRRouting &routing = *routers[r].second;
+      routing.SortHostRoutes ();
+      uint32_t nodeHeader[5] = { routers[r].first,
+                                 (uint32_t)routing.m_nextHops.size (),
+                                 (uint32_t)routing.m_hostRoutes.size (),
+                                 (uint32_t)routing.m_networkRoutes.size (),
+                                 (uint32_t)routing.m_ASexternalRoutes.size () };
+      file.write ((const char *)nodeHeader, sizeof (nodeHeader));
+
+      words.clear ();
+      for (uint32_t h = 0; h < routing.m_nextHops.size (); h++)
+        {
+          words.push_back (routing.m_nextHops[h].gateway.Get ());
+          words.push_back (routing.m_nextHops[h].interface);
+        }
+      if (!words.empty ())
+        {
+          file.write ((const char *)&words[0], words.size () * sizeof (uint32_t));
+        }
+      if (!routing.m_hostRoutes.empty ())
+        {
+          file.write ((const char *)&routing.m_hostRoutes[0],
+                      routing.m_hostRoutes.size () * sizeof (Ipv4DSRRouting::HostRoute));
+        }
+
+      words.clear ();
+      for (uint32_t n = 0; n < routing.m_networkRoutes.size (); n++)
+        {
+          const Ipv4DSRRoutingTableEntry &route = routing.m_networkRoutes[n];
+          words.push_back (route.GetDestNetwork ().Get ());
+          words.push_back (route.GetDestNetworkMask ().Get ());
+          words.push_back (route.GetGateway ().Get ());
+          words.push_back (route.GetInterface ());
+        }
+      for (uint32_t n = 0; n < routing.m_ASexternalRoutes.size (); n++)
+        {
+          const Ipv4DSRRoutingTableEntry &route = routing.m_ASexternalRoutes[n];
+          words.push_back (route.GetDestNetwork ().Get ());
+          words.push_back (route.GetDestNetworkMask ().Get ());
+          words.push_back (route.GetGateway ().Get ());
+          words.push_back (route.GetInterface ());
+        }
+      if (!words.empty ())
+        {
+          file.write ((const char *)&words[0], words.size () * sizeof (uint32_t));
+        }
+    }
+  file.close ();
+  if (!file)
+    {
+      std::remove (tmp.str ().c_str ());
+      NS_FATAL_ERROR ("Can not write routing snapshot file " << tmp.str ());
+    }
+  if (std::rename (tmp.str ().c_str (), filename.c_str ()) != 0)
+    {
+      std::remove (tmp.str ().c_str ());
+      NS_FATAL_ERROR ("Can not rename routing snapshot file " << tmp.str () << " to " << filename);
+    }
+  NS_LOG_INFO ("Saved the routing tables of " << routers.size () << " routers to " << filename);
+}
+
+bool
+DsrRoutingSnapshot::Load (std::string filename, uint64_t lsdbHash)
+{
+  NS_LOG_FUNCTION (filename << lsdbHash);
+  int fd = open (filename.c_str (), O_RDONLY);
+  if (fd < 0)
+    {
+      NS_LOG_LOGIC ("No routing snapshot " << filename);
+      return false;
+    }
+  struct stat st;
+  if (fstat (fd, &st) != 0 || st.st_size == 0)
+    {
+      close (fd);
+      return false;
+    }
+  void *map = mmap (0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close (fd);
+  if (map == MAP_FAILED)
+    {
+      NS_LOG_WARN ("Can not map routing snapshot " << filename);
+      return false;
+    }
+  bool installed = Install ((const uint8_t *)map, st.st_size, lsdbHash);
+  munmap (map, st.st_size);
+  if (installed)
+    {
+      NS_LOG_INFO ("Installed the routing tables of " << filename);
+    }
+  return installed;
+}
+
+bool
+DsrRoutingSnapshot::Install (const uint8_t *data, uint64_t size, uint64_t lsdbHash)
+{
+  NS_LOG_FUNCTION (size << lsdbHash);
+  DsrSnapshotReader reader (data, size);
+  uint32_t magic, version, hostRouteSize, nRouters;
+  uint64_t hash;
+  if (!reader.Read (magic) || magic != DSR_ROUTING_SNAPSHOT_MAGIC
+      || !reader.Read (version) || version != DSR_ROUTING_SNAPSHOT_VERSION
+      || !reader.Read (hostRouteSize) || hostRouteSize != sizeof (Ipv4DSRRouting::HostRoute)
+      || !reader.Read (nRouters))
+    {
+      NS_LOG_WARN ("Routing snapshot of another format, ignored");
+      return false;
+    }
+  const uint8_t *hashData = reader.Take (sizeof (hash));
+  if (hashData == 0)
+    {
+      return false;
+    }
+  std::memcpy (&hash, hashData, sizeof (hash));
+  if (hash != lsdbHash)
+    {
+      NS_LOG_INFO ("Routing snapshot of another topology, ignored");
+      return false;
+    }
+
+//
+// Check the whole file before touching any routing table, so that a bad
+// snapshot leaves the routes to be computed as usual.
+//
+  struct Tables
+  {
+    Ptr<Ipv4DSRRouting> routing;
+    uint32_t counts[4];
+    const uint8_t *nextHops;
+    const uint8_t *hostRoutes;
+    const uint8_t *networkRoutes;
+  };
+  std::vector<Tables> tables (nRouters);
+  for (uint32_t r = 0; r < nRouters; r++)
+    {
+      Tables &t = tables[r];
+      uint32_t nodeId;
+      if (!reader.Read (nodeId) || !reader.Read (t.counts[0]) || !reader.Read (t.counts[1])
+          || !reader.Read (t.counts[2]) || !reader.Read (t.counts[3]))
+        {
+          return false;
+        }
+      if (nodeId >= NodeList::GetNNodes ()
+          || (t.routing = GetDsrRouting (NodeList::GetNode (nodeId))) == 0)
+        {
+          NS_LOG_WARN ("Routing snapshot names node " << nodeId << ", which is no DSR router");
+          return false;
+        }
+      t.nextHops = reader.Take ((uint64_t)t.counts[0] * 2 * sizeof (uint32_t));
+      t.hostRoutes = reader.Take ((uint64_t)t.counts[1] * sizeof (Ipv4DSRRouting::HostRoute));
+      t.networkRoutes = reader.Take (((uint64_t)t.counts[2] + t.counts[3]) * 4 * sizeof (uint32_t));
+      if (t.nextHops == 0 || t.hostRoutes == 0 || t.networkRoutes == 0)
+        {
+          return false;
+        }
+      for (uint32_t i = 0; i < t.counts[1]; i++)
+        {
+          Ipv4DSRRouting::HostRoute route;
+          std::memcpy (&route, t.hostRoutes + i * sizeof (route), sizeof (route));
+          if (route.nextHop >= t.counts[0])
+            {
+              return false;
+            }
+        }
+    }
+  if (!reader.AtEnd ())
+    {
+      return false;
+    }
+
+  for (uint32_t r = 0; r < nRouters; r++)
+    {
+      const Tables &t = tables[r];
+      Ipv4DSRRouting &routing = *t.routing;
+      routing.RemoveAllRoutes ();
+
+      std::vector<uint32_t> words (2 * t.counts[0]);
+      if (!words.empty ())
+        {
+          std::memcpy (&words[0], t.nextHops, words.size () * sizeof (uint32_t));
+        }
+      routing.m_nextHops.resize (t.counts[0]);
+      for (uint32_t h = 0; h < t.counts[0]; h++)
+        {
+          routing.m_nextHops[h].gateway = Ipv4Address (words[2 * h]);
+          routing.m_nextHops[h].interface = words[2 * h + 1];
+          routing.m_nextHopIds.insert (std::make_pair (std::make_pair (words[2 * h], words[2 * h + 1]),
+                                                       (uint16_t)h));
+        }
+
+      routing.m_hostRoutes.resize (t.counts[1]);
+      if (t.counts[1] > 0)
+        {
+          std::memcpy (&routing.m_hostRoutes[0], t.hostRoutes,
+                       t.counts[1] * sizeof (Ipv4DSRRouting::HostRoute));
+        }
+
+      words.resize (4 * (t.counts[2] + t.counts[3]));
+      if (!words.empty ())
+        {
+          std::memcpy (&words[0], t.networkRoutes, words.size () * sizeof (uint32_t));
+        }
+      routing.m_networkRoutes.reserve (t.counts[2]);
+      routing.m_ASexternalRoutes.reserve (t.counts[3]);
+      for (uint32_t n = 0; n < t.counts[2] + t.counts[3]; n++)
+        {
+          const uint32_t *w = &words[4 * n];
+          Ipv4DSRRoutingTableEntry route;
+          if (Ipv4Address (w[2]) == Ipv4Address::GetZero ())
+            {
+              // directly attached network, not a route through a gateway
+              route = Ipv4DSRRoutingTableEntry::CreateNetworkRouteTo (Ipv4Address (w[0]), Ipv4Mask (w[1]), w[3]);
+            }
+          else
+            {
+              route = Ipv4DSRRoutingTableEntry::CreateNetworkRouteTo (Ipv4Address (w[0]), Ipv4Mask (w[1]),
+                                                                      Ipv4Address (w[2]), w[3]);
+            }
+          if (n < t.counts[2])
+            {
+              routing.m_networkRoutes.push_back (route);
+            }
+          else
+            {
+              routing.m_ASexternalRoutes.push_back (route);
+            }
+        }
+      routing.RoutesChanged ();
+    }
+  return true;
+}
+
+} // namespace ns3
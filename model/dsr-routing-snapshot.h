@@ -0,0 +1,88 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+#ifndef DSR_ROUTING_SNAPSHOT_H
+#define DSR_ROUTING_SNAPSHOT_H
+
+#include <stdint.h>
+#include <string>
+
+namespace ns3 {
+
+/// Magic number at the start of a routing table snapshot file ("DSRS")
+#define DSR_ROUTING_SNAPSHOT_MAGIC 0x53525344
+/// Version of the routing table snapshot file format
+#define DSR_ROUTING_SNAPSHOT_VERSION 1
+
+/**
+ * \ingroup dsr-routing
+ *
+ * \brief Binary snapshot of the DSR routing tables of all the nodes.
+ *
+ * Computing the routes of a large topology takes long, and parameter
+ * sweeps compute the same routes run after run.  A snapshot saves the
+ * routing tables once they are populated, with the hash of the routing
+ * database they were computed from (DSRRouteManager::GetLsdbHash), so that
+ * later runs on the same topology install them instead.
+ *
+ * The file starts with the magic number, the format version, the size of
+ * a packed host route, the number of nodes, all as uint32_t, and the hash
+ * as a uint64_t.  Then, for each node, come the node id and the numbers of
+ * next hops, host routes, network routes and AS external routes as
+ * uint32_t, followed by the next hops (gateway, interface), the packed host
+ * routes and the network then AS external routes (network, mask, gateway,
+ * interface).  Everything is in host byte order; a file written on a host
+ * of another byte order does not match the magic number.
+ */
+class DsrRoutingSnapshot
+{
+public:
+  /**
+   * \brief Write the routing tables of all the nodes to a file.
+   *
+   * The file is written under a temporary name and renamed, so that
+   * concurrent runs never read a partial snapshot.
+   *
+   * \param filename the snapshot file
+   * \param lsdbHash the hash of the routing database of the routes
+   */
+  static void Save (std::string filename, uint64_t lsdbHash);
+
+  /**
+   * \brief Install the routing tables of a file on the nodes.
+   *
+   * Nothing is installed unless the file exists, is of the current format
+   * version, was saved for the same routing database, and names existing
+   * DSR routers.
+   *
+   * \param filename the snapshot file
+   * \param lsdbHash the hash of the current routing database
+   * \return true if the routes were installed
+   */
+  static bool Load (std::string filename, uint64_t lsdbHash);
+
+private:
+  /**
+   * \brief Install the routing tables of a mapped snapshot on the nodes.
+   * \param data the snapshot
+   * \param size the size of the snapshot, in bytes
+   * \param lsdbHash the hash of the current routing database
+   * \return true if the routes were installed
+   */
+  static bool Install (const uint8_t *data, uint64_t size, uint64_t lsdbHash);
+
+  /**
+   * \brief Copy construction is disallowed.
+   * \param o object to copy from
+   */
+  DsrRoutingSnapshot (DsrRoutingSnapshot &o);
+
+  /**
+   * \brief Copy assignment operator is disallowed.
+   * \param o object to copy from
+   * \returns the copied object
+   */
+  DsrRoutingSnapshot& operator= (DsrRoutingSnapshot &o);
+};
+
+} // namespace ns3
+
+#endif /* DSR_ROUTING_SNAPSHOT_H */
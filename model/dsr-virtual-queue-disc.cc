@@ -6,6 +6,7 @@
 #include "ns3/socket.h"
 #include "ns3/packet.h"
 #include "ns3/simulator.h"
+#include "ns3/uinteger.h"
 #include "dsr-header.h"
 #include "dsr-virtual-queue-disc.h"
 
@@ -32,6 +33,22 @@ TypeId DsrVirtualQueueDisc::GetTypeId (void)
                    MakeQueueSizeAccessor (&QueueDisc::SetMaxSize,
                                           &QueueDisc::GetMaxSize),
                    MakeQueueSizeChecker ())
+    .AddAttribute ("FastLaneSize",
+                   "The number of packets the fast lane holds.",
+                   TypeId::ATTR_GET,
+                   UintegerValue (12),
+                   MakeUintegerAccessor (&DsrVirtualQueueDisc::GetFastLaneSize),
+                   MakeUintegerChecker<uint32_t> ())
+    .AddAttribute ("SlowLaneSize",
+                   "The number of packets the slow lane holds.",
+                   TypeId::ATTR_GET,
+                   UintegerValue (36),
+                   MakeUintegerAccessor (&DsrVirtualQueueDisc::GetSlowLaneSize),
+                   MakeUintegerChecker<uint32_t> ())
+    .AddTraceSource ("LaneOccupancy",
+                     "The number of packets in a lane changed",
+                     MakeTraceSourceAccessor (&DsrVirtualQueueDisc::m_laneOccupancyTrace),
+                     "ns3::DsrVirtualQueueDisc::LaneOccupancyTracedCallback")
   ;
   return tid;
 }
@@ -47,6 +64,18 @@ DsrVirtualQueueDisc::~DsrVirtualQueueDisc ()
   NS_LOG_FUNCTION (this);
 }
 
+uint32_t
+DsrVirtualQueueDisc::GetFastLaneSize (void) const
+{
+  return LinesSize[FAST_LANE];
+}
+
+uint32_t
+DsrVirtualQueueDisc::GetSlowLaneSize (void) const
+{
+  return LinesSize[SLOW_LANE];
+}
+
 
 bool
 DsrVirtualQueueDisc::DoEnqueue (Ptr<QueueDiscItem> item)
@@ -92,6 +121,7 @@ DsrVirtualQueueDisc::DoEnqueue (Ptr<QueueDiscItem> item)
   {
     bool retval = GetInternalQueue (lane)->Enqueue (item);
     m_arrivals[lane] += 1;
+    NotifyLaneOccupancy (lane);
     return retval;
   }
   
@@ -124,9 +154,16 @@ DsrVirtualQueueDisc::DoEnqueue (Ptr<QueueDiscItem> item)
 
   bool retval = GetInternalQueue (lane)->Enqueue (item);
   m_arrivals[lane] += 1;
+  NotifyLaneOccupancy (lane);
   return retval;
 }
 
+void
+DsrVirtualQueueDisc::NotifyLaneOccupancy (uint32_t lane)
+{
+  m_laneOccupancyTrace (lane, GetInternalQueue (lane)->GetNPackets ());
+}
+
 Ptr<QueueDiscItem>
 DsrVirtualQueueDisc::DoDequeue (void)
 {
@@ -144,6 +181,7 @@ DsrVirtualQueueDisc::DoDequeue (void)
   if (item = GetInternalQueue (prio)->Dequeue ())
     {
       NS_LOG_LOGIC ("Popped from band " << prio << ": " << item);
+      NotifyLaneOccupancy (prio);
       NS_LOG_LOGIC ("Number packets band " << prio << ": " << GetInternalQueue (prio)->GetNPackets ());
       // std::cout << "++++++ Current Queue length: " << GetInternalQueue (prio)->GetNPackets () << " at band: " << item <<  std::endl;
       /**
@@ -5,6 +5,7 @@
 
 
 #include "ns3/queue-disc.h"
+#include "ns3/traced-callback.h"
 
 namespace ns3 {
 
@@ -30,6 +31,26 @@ public:
   static constexpr const char* TIMEOUT_DROP = "time out !!!!!!!!";
   static constexpr const char* BUFFERBLOAT_DROP = "Buffer bloat !!!!!!!!";
 
+  /**
+   * TracedCallback signature for a change of the length of a lane.
+   *
+   * \param [in] lane the internal queue index
+   * \param [in] nPackets the number of packets in the lane
+   */
+  typedef void (* LaneOccupancyTracedCallback) (uint32_t lane, uint32_t nPackets);
+
+  /**
+   * \brief Get the buffer size of the fast lane.
+   * \return the number of packets the fast lane holds
+   */
+  uint32_t GetFastLaneSize (void) const;
+
+  /**
+   * \brief Get the buffer size of the slow lane.
+   * \return the number of packets the slow lane holds
+   */
+  uint32_t GetSlowLaneSize (void) const;
+
 private:
   // packet size = 1kB
   // packet size for test = 52B
@@ -64,6 +85,11 @@ private:
   uint32_t currentFastWeight = 0;
   uint32_t currentSlowWeight = 0;
   uint32_t currentNormalWeight = 0;
+  /// Fire the LaneOccupancy trace with the current length of a lane
+  void NotifyLaneOccupancy (uint32_t lane);
+  /// Traced callback: fired when the length of a lane changes
+  TracedCallback<uint32_t, uint32_t> m_laneOccupancyTrace;
+
   virtual bool DoEnqueue (Ptr<QueueDiscItem> item);
   virtual Ptr<QueueDiscItem> DoDequeue (void);
   // virtual void DoPrioDequeue (void);
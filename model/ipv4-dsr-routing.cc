@@ -17,8 +17,10 @@
 //
 
 #include <vector>
+#include <algorithm>
 #include <iomanip>
 #include "ns3/names.h"
+#include "ns3/abort.h"
 #include "ns3/log.h"
 #include "ns3/simulator.h"
 #include "ns3/object.h"
@@ -29,10 +31,13 @@
 #include "ns3/ipv4-route.h"
 #include "ns3/ipv4-routing-table-entry.h"
 #include "ns3/boolean.h"
+#include "ns3/uinteger.h"
 #include "ns3/node.h"
 #include "ipv4-dsr-routing.h"
 #include "dsr-route-manager.h"
 #include "dsr-header.h"
+#include "dsr-decision-trace.h"
+#include "dsr-flow-tag.h"
 
 namespace ns3 {
 
@@ -57,13 +62,81 @@ Ipv4DSRRouting::GetTypeId (void)
                    BooleanValue (false),
                    MakeBooleanAccessor (&Ipv4DSRRouting::m_respondToInterfaceEvents),
                    MakeBooleanChecker ())
+    .AddAttribute ("IncrementalRecompute",
+                   "Set to true to only recompute the routes whose shortest path trees are affected by an interface event; "
+                   "set to false to recompute all routes",
+                   BooleanValue (false),
+                   MakeBooleanAccessor (&Ipv4DSRRouting::m_incrementalRecompute),
+                   MakeBooleanChecker ())
+    .AddAttribute ("RecomputeHoldDown",
+                   "Delay between an interface event and the route recomputation; the events of all nodes "
+                   "received meanwhile are coalesced into it.  Zero recomputes at the end of the current time step",
+                   TimeValue (Seconds (0)),
+                   MakeTimeAccessor (&Ipv4DSRRouting::m_recomputeHoldDown),
+                   MakeTimeChecker ())
+    .AddAttribute ("DecisionCache",
+                   "Set to true to reuse the lane weights computed for an earlier packet with the same destination, "
+                   "remaining budget bucket, size and next-hop lane occupancy",
+                   BooleanValue (false),
+                   MakeBooleanAccessor (&Ipv4DSRRouting::m_decisionCache),
+                   MakeBooleanChecker ())
+    .AddAttribute ("DecisionBudgetQuantum",
+                   "Width of the remaining budget buckets of the decision cache",
+                   TimeValue (MicroSeconds (100)),
+                   MakeTimeAccessor (&Ipv4DSRRouting::m_decisionBudgetQuantum),
+                   MakeTimeChecker ())
+    .AddAttribute ("DecisionOccupancyQuantum",
+                   "Width of the lane occupancy buckets of the decision cache, in packets",
+                   UintegerValue (1),
+                   MakeUintegerAccessor (&Ipv4DSRRouting::m_decisionOccupancyQuantum),
+                   MakeUintegerChecker<uint32_t> (1))
+    .AddAttribute ("DecisionCacheSize",
+                   "Maximum number of entries of the decision cache, and of flows pinned to a route by "
+                   "FlowHashRouting; each is flushed when full",
+                   UintegerValue (4096),
+                   MakeUintegerAccessor (&Ipv4DSRRouting::m_decisionCacheSize),
+                   MakeUintegerChecker<uint32_t> (1))
+    .AddAttribute ("FlowHashRouting",
+                   "Set to true to spread unflagged DSR packets over the good routes and lanes in proportion to "
+                   "their weights, by a hash of their addresses, protocol and DsrFlowTag, and keep each flow on its "
+                   "route and lane while that lane is usable; set to false to send them all on the heaviest lane",
+                   BooleanValue (false),
+                   MakeBooleanAccessor (&Ipv4DSRRouting::m_flowHashRouting),
+                   MakeBooleanChecker ())
+    .AddAttribute ("LoopFreeRoutes",
+                   "Set to true to only forward DSR packets to next hops that are closer to the destination than "
+                   "this node, which rules out loops; set to false to filter the routes by their average cost",
+                   BooleanValue (false),
+                   MakeBooleanAccessor (&Ipv4DSRRouting::m_loopFreeRoutes),
+                   MakeBooleanChecker ())
+    .AddAttribute ("LaneStatePush",
+                   "Set to true to take the lane lengths from a table updated by the LaneOccupancy trace of "
+                   "DsrVirtualQueueDisc; set to false to read the queues on each lookup",
+                   BooleanValue (false),
+                   MakeBooleanAccessor (&Ipv4DSRRouting::m_laneStatePush),
+                   MakeBooleanChecker ())
+    .AddAttribute ("LaneStateDelay",
+                   "Delay before a lane length change reaches the table, modelling the dissemination of "
+                   "queue state; only used with LaneStatePush",
+                   TimeValue (Seconds (0)),
+                   MakeTimeAccessor (&Ipv4DSRRouting::m_laneStateDelay),
+                   MakeTimeChecker ())
   ;
   return tid;
 }
 
 Ipv4DSRRouting::Ipv4DSRRouting () 
   : m_randomEcmpRouting (false),
-    m_respondToInterfaceEvents (false)
+    m_respondToInterfaceEvents (false),
+    m_incrementalRecompute (false),
+    m_decisionCache (false),
+    m_decisionOccupancyQuantum (1),
+    m_decisionCacheSize (4096),
+    m_flowHashRouting (false),
+    m_loopFreeRoutes (false),
+    m_laneStatePush (false),
+    m_nodeId (0),
+    m_hostRoutesDirty (false)
 {
   NS_LOG_FUNCTION (this);
 
@@ -81,9 +154,7 @@ Ipv4DSRRouting::AddHostRouteTo (Ipv4Address dest,
                                    uint32_t interface)
 {
   NS_LOG_FUNCTION (this << dest << nextHop << interface);
-  Ipv4DSRRoutingTableEntry *route = new Ipv4DSRRoutingTableEntry ();
-  *route = Ipv4DSRRoutingTableEntry::CreateHostRouteTo (dest, nextHop, interface);
-  m_hostRoutes.push_back (route);
+  AddHostRoute (dest, nextHop, interface, Ipv4DSRRoutingTableEntry ().GetDistance ());
 }
 
 void 
@@ -91,9 +162,7 @@ Ipv4DSRRouting::AddHostRouteTo (Ipv4Address dest,
                                    uint32_t interface)
 {
   NS_LOG_FUNCTION (this << dest << interface);
-  Ipv4DSRRoutingTableEntry *route = new Ipv4DSRRoutingTableEntry ();
-  *route = Ipv4DSRRoutingTableEntry::CreateHostRouteTo (dest, interface);
-  m_hostRoutes.push_back (route);
+  AddHostRoute (dest, Ipv4Address::GetZero (), interface, Ipv4DSRRoutingTableEntry ().GetDistance ());
 }
 
 void
@@ -103,10 +172,45 @@ Ipv4DSRRouting::AddHostRouteTo (Ipv4Address dest,
                        uint32_t distance)
 {
   NS_LOG_FUNCTION (this << dest << nextHop << interface << distance);
-  Ipv4DSRRoutingTableEntry *route = new Ipv4DSRRoutingTableEntry ();
-  // std::cout << "add host route with the distance = " << distance;
-  *route = Ipv4DSRRoutingTableEntry::CreateHostRouteTo(dest, nextHop, interface, distance);
+  AddHostRoute (dest, nextHop, interface, distance);
+}
+
+void
+Ipv4DSRRouting::AddHostRoute (Ipv4Address dest, Ipv4Address gateway, uint32_t interface, uint32_t distance)
+{
+  HostRoute route;
+  route.dest = dest.Get ();
+  route.distance = distance;
+  route.nextHop = InternNextHop (gateway, interface);
+  route.loopFree = 0;
   m_hostRoutes.push_back (route);
+  RoutesChanged ();
+}
+
+uint16_t
+Ipv4DSRRouting::InternNextHop (Ipv4Address gateway, uint32_t interface)
+{
+  std::pair<std::map<std::pair<uint32_t, uint32_t>, uint16_t>::iterator, bool> ins =
+    m_nextHopIds.insert (std::make_pair (std::make_pair (gateway.Get (), interface),
+                                         (uint16_t)m_nextHops.size ()));
+  if (ins.second)
+    {
+      NS_ABORT_MSG_IF (m_nextHops.size () > 0xffff, "Too many next hops on node "
+                       << m_ipv4->GetObject<Node> ()->GetId ());
+      NextHop nextHop;
+      nextHop.gateway = gateway;
+      nextHop.interface = interface;
+      m_nextHops.push_back (nextHop);
+    }
+  return ins.first->second;
+}
+
+Ipv4DSRRoutingTableEntry
+Ipv4DSRRouting::MakeEntry (const HostRoute &route) const
+{
+  const NextHop &nextHop = m_nextHops[route.nextHop];
+  return Ipv4DSRRoutingTableEntry::CreateHostRouteTo (Ipv4Address (route.dest), nextHop.gateway,
+                                                      nextHop.interface, route.distance);
 }
 
 void 
@@ -116,12 +220,11 @@ Ipv4DSRRouting::AddNetworkRouteTo (Ipv4Address network,
                                       uint32_t interface)
 {
   NS_LOG_FUNCTION (this << network << networkMask << nextHop << interface);
-  Ipv4DSRRoutingTableEntry *route = new Ipv4DSRRoutingTableEntry ();
-  *route = Ipv4DSRRoutingTableEntry::CreateNetworkRouteTo (network,
-                                                        networkMask,
-                                                        nextHop,
-                                                        interface);
-  m_networkRoutes.push_back (route);
+  m_networkRoutes.push_back (Ipv4DSRRoutingTableEntry::CreateNetworkRouteTo (network,
+                                                                             networkMask,
+                                                                             nextHop,
+                                                                             interface));
+  RoutesChanged ();
 }
 
 void 
@@ -130,11 +233,10 @@ Ipv4DSRRouting::AddNetworkRouteTo (Ipv4Address network,
                                       uint32_t interface)
 {
   NS_LOG_FUNCTION (this << network << networkMask << interface);
-  Ipv4DSRRoutingTableEntry *route = new Ipv4DSRRoutingTableEntry ();
-  *route = Ipv4DSRRoutingTableEntry::CreateNetworkRouteTo (network,
-                                                        networkMask,
-                                                        interface);
-  m_networkRoutes.push_back (route);
+  m_networkRoutes.push_back (Ipv4DSRRoutingTableEntry::CreateNetworkRouteTo (network,
+                                                                             networkMask,
+                                                                             interface));
+  RoutesChanged ();
 }
 
 void 
@@ -144,224 +246,512 @@ Ipv4DSRRouting::AddASExternalRouteTo (Ipv4Address network,
                                          uint32_t interface)
 {
   NS_LOG_FUNCTION (this << network << networkMask << nextHop << interface);
-  Ipv4DSRRoutingTableEntry *route = new Ipv4DSRRoutingTableEntry ();
-  *route = Ipv4DSRRoutingTableEntry::CreateNetworkRouteTo (network,
-                                                        networkMask,
-                                                        nextHop,
-                                                        interface);
-  m_ASexternalRoutes.push_back (route);
+  m_ASexternalRoutes.push_back (Ipv4DSRRoutingTableEntry::CreateNetworkRouteTo (network,
+                                                                                networkMask,
+                                                                                nextHop,
+                                                                                interface));
+  RoutesChanged ();
 }
 
 
-Ptr<Ipv4Route>
-Ipv4DSRRouting::LookupDSRRoute (Ipv4Address dest, Ptr<NetDevice> oif)
+void
+Ipv4DSRRouting::CollectRoutes (Ipv4Address dest, Ptr<NetDevice> oif, std::vector<HostRoute> &routes)
 {
-  /**
-   * \author Pu Yang
-   * \todo to rewrite the lookup functions to find the best route from the routing table.
-   * the routing table in DSR routing is a SPF forest instead of a routing tree in global routing
-  */
-
   NS_LOG_FUNCTION (this << dest << oif);
-  NS_LOG_LOGIC ("Looking for route for destination " << dest);
-  Ptr<Ipv4Route> rtentry = 0;
-  // store all available routes that bring packets to their destination
-  typedef std::vector<Ipv4DSRRoutingTableEntry*> RouteVec_t;
-  RouteVec_t allRoutes;
+  routes.clear ();
 
   NS_LOG_LOGIC ("Number of m_hostRoutes = " << m_hostRoutes.size ());
   for (HostRoutesCI i = m_hostRoutes.begin (); 
        i != m_hostRoutes.end (); 
        i++) 
     {
-      NS_ASSERT ((*i)->IsHost ());
-      if ((*i)->GetDest () == dest)
+      if (i->dest == dest.Get ())
         {
           if (oif != 0)
             {
-              if (oif != m_ipv4->GetNetDevice ((*i)->GetInterface ()))
+              if (oif != m_ipv4->GetNetDevice (m_nextHops[i->nextHop].interface))
                 {
                   NS_LOG_LOGIC ("Not on requested interface, skipping");
                   continue;
                 }
             }
-          allRoutes.push_back (*i);
-          NS_LOG_LOGIC (allRoutes.size () << "Found dsr host route" << *i); 
+          routes.push_back (*i);
+          NS_LOG_LOGIC (routes.size () << "Found dsr host route" << MakeEntry (*i) << " with Cost: " << i->distance); 
         }
     }
-  if (allRoutes.size () == 0) // if no host route is found
+  if (routes.size () == 0) // if no host route is found
     {
       NS_LOG_LOGIC ("Number of m_networkRoutes" << m_networkRoutes.size ());
-      for (NetworkRoutesI j = m_networkRoutes.begin (); 
+      for (NetworkRoutesCI j = m_networkRoutes.begin (); 
            j != m_networkRoutes.end (); 
            j++) 
         {
-          Ipv4Mask mask = (*j)->GetDestNetworkMask ();
-          Ipv4Address entry = (*j)->GetDestNetwork ();
+          Ipv4Mask mask = j->GetDestNetworkMask ();
+          Ipv4Address entry = j->GetDestNetwork ();
           if (mask.IsMatch (dest, entry)) 
             {
               if (oif != 0)
                 {
-                  if (oif != m_ipv4->GetNetDevice ((*j)->GetInterface ()))
+                  if (oif != m_ipv4->GetNetDevice (j->GetInterface ()))
                     {
                       NS_LOG_LOGIC ("Not on requested interface, skipping");
                       continue;
                     }
                 }
-              allRoutes.push_back (*j);
-              NS_LOG_LOGIC (allRoutes.size () << "Found DSR network route" << *j);
+              HostRoute route;
+              route.dest = j->GetDest ().Get ();
+              route.distance = j->GetDistance ();
+              route.nextHop = InternNextHop (j->GetGateway (), j->GetInterface ());
+              route.loopFree = 1;
+              routes.push_back (route);
+              NS_LOG_LOGIC (routes.size () << "Found DSR network route" << *j);
             }
         }
     }
-  if (allRoutes.size () == 0)  // consider external if no host/network found
+  if (routes.size () == 0)  // consider external if no host/network found
     {
-      for (ASExternalRoutesI k = m_ASexternalRoutes.begin ();
+      for (ASExternalRoutesCI k = m_ASexternalRoutes.begin ();
            k != m_ASexternalRoutes.end ();
            k++)
         {
-          Ipv4Mask mask = (*k)->GetDestNetworkMask ();
-          Ipv4Address entry = (*k)->GetDestNetwork ();
+          Ipv4Mask mask = k->GetDestNetworkMask ();
+          Ipv4Address entry = k->GetDestNetwork ();
           if (mask.IsMatch (dest, entry))
             {
               NS_LOG_LOGIC ("Found external route" << *k);
               if (oif != 0)
                 {
-                  if (oif != m_ipv4->GetNetDevice ((*k)->GetInterface ()))
+                  if (oif != m_ipv4->GetNetDevice (k->GetInterface ()))
                     {
                       NS_LOG_LOGIC ("Not on requested interface, skipping");
                       continue;
                     }
                 }
-              allRoutes.push_back (*k);
+              HostRoute route;
+              route.dest = k->GetDest ().Get ();
+              route.distance = k->GetDistance ();
+              route.nextHop = InternNextHop (k->GetGateway (), k->GetInterface ());
+              route.loopFree = 1;
+              routes.push_back (route);
               break;
             }
         }
     }
-  if (allRoutes.size () > 0 ) // if route(s) is found
-    {
-      /**
-       * \author Pu Yang
-       * \todo get all the possible route to the destination, and weight randomly
-       * select a possbile route  
-       * \todo select the shortest path only
-      */
-      // The optimal route
-      uint32_t flagNum = 0;
-      uint32_t flagCost = 0;
-      for (uint32_t i = 0; i < allRoutes.size (); i ++)
-      {
-        flagCost = allRoutes.at (flagNum)->GetDistance ();
-        if (allRoutes.at (i)->GetDistance () <  flagCost)
-        {
-          flagNum = i;
-        }
-      }
-      Ipv4DSRRoutingTableEntry* route = allRoutes.at (flagNum);
-
-      // create a Ipv4Route object from the selected routing table entry
-      rtentry = Create<Ipv4Route> ();
-      rtentry->SetDestination (route->GetDest ());
-      /// \todo handle multi-address case
-      rtentry->SetSource (m_ipv4->GetAddress (route->GetInterface (), 0).GetLocal ());
-      rtentry->SetGateway (route->GetGateway ());
-      uint32_t interfaceIdx = route->GetInterface ();
-      rtentry->SetOutputDevice (m_ipv4->GetNetDevice (interfaceIdx));
-      return rtentry;
-    }
-  else 
+}
+
+/// Strict weak ordering of host routes by destination, then increasing distance
+static bool
+RouteDestDistanceOrder (const Ipv4DSRRouting::HostRoute &a, const Ipv4DSRRouting::HostRoute &b)
+{
+  return a.dest < b.dest || (a.dest == b.dest && a.distance < b.distance);
+}
+
+/// Strict weak ordering of host routes by increasing distance
+static bool
+RouteDistanceOrder (const Ipv4DSRRouting::HostRoute &a, const Ipv4DSRRouting::HostRoute &b)
+{
+  return a.distance < b.distance;
+}
+
+/// Whether a host route leads to a lower destination, for std::lower_bound
+static bool
+RouteDestLess (const Ipv4DSRRouting::HostRoute &route, uint32_t dest)
+{
+  return route.dest < dest;
+}
+
+/// Whether a destination is lower than the one of a host route, for std::upper_bound
+static bool
+DestBelowRouteDest (uint32_t dest, const Ipv4DSRRouting::HostRoute &route)
+{
+  return dest < route.dest;
+}
+
+/// Whether a host route is flagged loop-free, for std::stable_partition
+static bool
+RouteIsLoopFree (const Ipv4DSRRouting::HostRoute &route)
+{
+  return route.loopFree != 0;
+}
+
+/// Whether a route is shorter than a distance, for std::lower_bound
+static bool
+RouteDistanceLess (const Ipv4DSRRouting::HostRoute &route, uint32_t distance)
+{
+  return route.distance < distance;
+}
+
+/// Whether a cost is below the distance of a route, for std::upper_bound
+static bool
+CostBelowRouteDistance (double cost, const Ipv4DSRRouting::HostRoute &route)
+{
+  return cost < route.distance;
+}
+
+/// Capacity of an internal queue in packets, counting MTU-sized packets
+/// when its limit is in bytes
+static uint32_t
+QueueSizeInPackets (Ptr<QueueDisc::InternalQueue> queue, uint32_t mtu)
+{
+  QueueSize maxSize = queue->GetMaxSize ();
+  if (maxSize.GetUnit () == QueueSizeUnit::PACKETS || mtu == 0)
     {
-      return 0;
+      return maxSize.GetValue ();
     }
+  return maxSize.GetValue () / mtu;
 }
 
-Ptr<Ipv4Route>
-Ipv4DSRRouting::LookupDSRRoute (Ipv4Address dest, Ptr<Packet> p, Ptr<NetDevice> oif)
+/// Fold a value into a lane occupancy signature
+static uint64_t
+MixSignature (uint64_t signature, uint64_t value)
 {
-  /**
-   * \author Pu Yang
-   * \todo to rewrite the lookup functions to find the best route from the routing table.
-   * the routing table in DSR routing is a SPF forest instead of a routing tree in global routing
-  */
+  // FNV-1a style mixing, one 64-bit word at a time
+  return (signature ^ value) * 1099511628211ULL;
+}
 
-  NS_LOG_FUNCTION (this << dest << oif);
-  NS_LOG_LOGIC ("Looking for route for destination " << dest);
-  Ptr<Ipv4Route> rtentry = 0;
-  // store all available routes that bring packets to their destination
-  typedef std::vector<Ipv4DSRRoutingTableEntry*> RouteVec_t;
-  RouteVec_t allRoutes;
+std::size_t
+Ipv4DSRRouting::DecisionKeyHash::operator() (const DecisionKey &key) const
+{
+  uint64_t h = 14695981039346656037ULL;
+  h = MixSignature (h, key.dest);
+  h = MixSignature (h, key.budgetBucket);
+  h = MixSignature (h, key.packetSize);
+  h = MixSignature (h, key.signature);
+  return (std::size_t)h;
+}
 
-  NS_LOG_LOGIC ("Number of m_hostRoutes = " << m_hostRoutes.size ());
-  for (HostRoutesCI i = m_hostRoutes.begin (); 
-       i != m_hostRoutes.end (); 
-       i++) 
+bool
+Ipv4DSRRouting::DecisionKey::operator== (const DecisionKey &other) const
+{
+  return dest == other.dest && budgetBucket == other.budgetBucket
+         && packetSize == other.packetSize && signature == other.signature;
+}
+
+void
+Ipv4DSRRouting::SortHostRoutes (void) const
+{
+  if (!m_hostRoutesDirty)
+    {
+      return;
+    }
+  NS_LOG_FUNCTION (this);
+  // stable, so that equal-distance routes keep the order they were added in
+  std::stable_sort (m_hostRoutes.begin (), m_hostRoutes.end (), RouteDestDistanceOrder);
+  m_hostRoutesDirty = false;
+  if (!m_loopFreeRoutes)
     {
-      NS_ASSERT ((*i)->IsHost ());
-      if ((*i)->GetDest () == dest)
+      return;
+    }
+
+  // metric of the link to each next hop: the distance of the route to the
+  // gateway through itself
+  std::vector<uint64_t> linkMetric (m_nextHops.size (), 0);
+  std::vector<bool> linkMetricKnown (m_nextHops.size (), false);
+  for (uint32_t h = 0; h < m_nextHops.size (); h++)
+    {
+      uint32_t gateway = m_nextHops[h].gateway.Get ();
+      HostRoutesI first = std::lower_bound (m_hostRoutes.begin (), m_hostRoutes.end (), gateway, RouteDestLess);
+      for (HostRoutesI i = first; i != m_hostRoutes.end () && i->dest == gateway; i++)
         {
-          if (oif != 0)
+          if (i->nextHop == h)
             {
-              if (oif != m_ipv4->GetNetDevice ((*i)->GetInterface ()))
-                {
-                  NS_LOG_LOGIC ("Not on requested interface, skipping");
-                  continue;
-                }
+              // sorted by distance: the first one is the direct route
+              linkMetric[h] = i->distance;
+              linkMetricKnown[h] = true;
+              break;
             }
-          allRoutes.push_back (*i);
-          NS_LOG_LOGIC (allRoutes.size () << "Found dsr host route" << *i << " with Cost: " << (*i)->GetDistance ()); 
         }
     }
-  if (allRoutes.size () == 0) // if no host route is found
+
+  HostRoutesI first = m_hostRoutes.begin ();
+  while (first != m_hostRoutes.end ())
     {
-      NS_LOG_LOGIC ("Number of m_networkRoutes" << m_networkRoutes.size ());
-      for (NetworkRoutesI j = m_networkRoutes.begin (); 
-           j != m_networkRoutes.end (); 
-           j++) 
+      HostRoutesI last = first;
+      // the first route is the shortest, its distance is the one of this node
+      uint64_t distance = first->distance;
+      for (; last != m_hostRoutes.end () && last->dest == first->dest; last++)
         {
-          Ipv4Mask mask = (*j)->GetDestNetworkMask ();
-          Ipv4Address entry = (*j)->GetDestNetwork ();
-          if (mask.IsMatch (dest, entry)) 
-            {
-              if (oif != 0)
-                {
-                  if (oif != m_ipv4->GetNetDevice ((*j)->GetInterface ()))
-                    {
-                      NS_LOG_LOGIC ("Not on requested interface, skipping");
-                      continue;
-                    }
-                }
-              allRoutes.push_back (*j);
-              NS_LOG_LOGIC (allRoutes.size () << "Found DSR network route" << *j);
-            }
+          // unknown link metrics count as zero: only the shortest routes pass
+          uint64_t nextHopDistance = last->distance - linkMetric[last->nextHop];
+          last->loopFree = last->distance == distance
+            || (linkMetricKnown[last->nextHop] && nextHopDistance < distance);
         }
+      std::stable_partition (first, last, RouteIsLoopFree);
+      first = last;
     }
-  if (allRoutes.size () == 0)  // consider external if no host/network found
+}
+
+Ipv4DSRRouting::CandidateSet
+Ipv4DSRRouting::GetCandidates (Ipv4Address dest, Ptr<NetDevice> oif)
+{
+  NS_LOG_FUNCTION (this << dest << oif);
+  CandidateSet candidates;
+  if (oif == 0)
     {
-      for (ASExternalRoutesI k = m_ASexternalRoutes.begin ();
-           k != m_ASexternalRoutes.end ();
-           k++)
+      SortHostRoutes ();
+      HostRoutesCI begin = m_hostRoutes.begin ();
+      HostRoutesCI end = m_hostRoutes.end ();
+      HostRoutesCI first = std::lower_bound (begin, end, dest.Get (), RouteDestLess);
+      HostRoutesCI last = std::upper_bound (first, end, dest.Get (), DestBelowRouteDest);
+      if (first != last)
         {
-          Ipv4Mask mask = (*k)->GetDestNetworkMask ();
-          Ipv4Address entry = (*k)->GetDestNetwork ();
-          if (mask.IsMatch (dest, entry))
+          candidates.routes = &*first;
+          candidates.nRoutes = last - first;
+          if (m_loopFreeRoutes)
             {
-              NS_LOG_LOGIC ("Found external route" << *k);
-              if (oif != 0)
+              // partitioned by SortHostRoutes: the loop-free routes come first
+              candidates.nRoutes = 0;
+              while (first != last && first->loopFree)
                 {
-                  if (oif != m_ipv4->GetNetDevice ((*k)->GetInterface ()))
-                    {
-                      NS_LOG_LOGIC ("Not on requested interface, skipping");
-                      continue;
-                    }
+                  candidates.nRoutes++;
+                  first++;
                 }
-              allRoutes.push_back (*k);
-              break;
             }
+          return candidates;
         }
     }
-  if (allRoutes.size () > 0 ) // if route(s) is found
+  // restricted to an interface, or no host route: fall back to a table scan
+  CollectRoutes (dest, oif, m_scratchRoutes);
+  std::stable_sort (m_scratchRoutes.begin (), m_scratchRoutes.end (), RouteDistanceOrder);
+  candidates.routes = m_scratchRoutes.empty () ? 0 : &m_scratchRoutes[0];
+  candidates.nRoutes = m_scratchRoutes.size ();
+  return candidates;
+}
+
+Ptr<Ipv4Route>
+Ipv4DSRRouting::GetCachedRoute (const HostRoute *route)
+{
+  NS_LOG_FUNCTION (this << route);
+  std::pair<uint32_t, uint16_t> key (route->dest, route->nextHop);
+  RouteCache_t::const_iterator it = m_routeCache.find (key);
+  if (it != m_routeCache.end ())
+    {
+      return it->second;
+    }
+  // create a Ipv4Route object from the selected route
+  const NextHop &nextHop = m_nextHops[route->nextHop];
+  Ptr<Ipv4Route> rtentry = Create<Ipv4Route> ();
+  rtentry->SetDestination (Ipv4Address (route->dest));
+  /// \todo handle multi-address case
+  rtentry->SetSource (m_ipv4->GetAddress (nextHop.interface, 0).GetLocal ());
+  rtentry->SetGateway (nextHop.gateway);
+  rtentry->SetOutputDevice (m_ipv4->GetNetDevice (nextHop.interface));
+  m_routeCache.insert (std::make_pair (key, rtentry));
+  return rtentry;
+}
+
+Ptr<Ipv4Route>
+Ipv4DSRRouting::LookupDSRRoute (Ipv4Address dest, Ptr<NetDevice> oif)
+{
+  /**
+   * \author Pu Yang
+   * \todo to rewrite the lookup functions to find the best route from the routing table.
+   * the routing table in DSR routing is a SPF forest instead of a routing tree in global routing
+  */
+
+  NS_LOG_FUNCTION (this << dest << oif);
+  NS_LOG_LOGIC ("Looking for route for destination " << dest);
+  // all available routes that bring packets to their destination, by increasing distance
+  CandidateSet candidates = GetCandidates (dest, oif);
+
+  if (candidates.nRoutes > 0 ) // if route(s) is found
+    {
+      /**
+       * \author Pu Yang
+       * \todo get all the possible route to the destination, and weight randomly
+       * select a possbile route  
+       * \todo select the shortest path only
+      */
+      // The optimal route is the first candidate
+      return GetCachedRoute (&candidates.routes[0]);
+    }
+  else 
+    {
+      return 0;
+    }
+}
+
+void
+Ipv4DSRRouting::TraceDecision (DsrDecisionRecord &record, uint8_t type, Ipv4Address dest, uint32_t budget)
+{
+  record.time = Simulator::Now ().GetNanoSeconds ();
+  record.node = m_nodeId;
+  record.dest = dest.Get ();
+  record.budget = budget;
+  record.type = type;
+  DsrDecisionTrace::Record (record);
+}
+
+uint32_t
+Ipv4DSRRouting::FlowHash (const Ipv4Header &header, Ptr<const Packet> p) const
+{
+  if (!m_flowHashRouting)
+    {
+      return 0;
+    }
+  uint8_t protocol = header.GetProtocol ();
+  DsrFlowTag flowTag;
+  uint32_t flowId = p->PeekPacketTag (flowTag) ? flowTag.GetFlowId () : 0;
+  uint64_t h = 14695981039346656037ULL;
+  h = MixSignature (h, m_nodeId);
+  h = MixSignature (h, header.GetSource ().Get ());
+  h = MixSignature (h, header.GetDestination ().Get ());
+  h = MixSignature (h, protocol);
+  h = MixSignature (h, flowId);
+  return (uint32_t)(h ^ (h >> 32));
+}
+
+bool
+Ipv4DSRRouting::ComputeLaneDecision (Ipv4Address dest, const DsrHeader &dsrHeader, uint32_t budget, uint32_t packetSize,
+                                     const HostRoute *goodRoutes, uint32_t numGoodRoute,
+                                     LaneDecision &decision)
+{
+  NS_LOG_FUNCTION (this << dest << budget << packetSize << numGoodRoute);
+  bool trace = dsrHeader.GetFlag () && DsrDecisionTrace::IsEnabled ();
+  uint32_t internalNqueue = GetInterfaceState (m_nextHops[goodRoutes[0].nextHop].interface).nInternalQueues;
+
+  if (internalNqueue < 3)
+    {
+      NS_LOG_ERROR ("Lane weights need fast, slow and best-effort lanes, found " << internalNqueue << " queues");
+      return false;
+    }
+  uint32_t nLanes = internalNqueue - 1;  // Exclude best-effort lane
+  m_weights.assign (numGoodRoute * nLanes, 0.0);
+  double *weight = m_weights.data ();
+  double tempSum = 0;
+  for (uint32_t i = 0; i < numGoodRoute; i ++)
+  {
+    double dn = 0.0;
+    if (budget < goodRoutes[i].distance)
+    {
+      dn = 0.0 ;
+    }
+    else
+    {
+      dn = (budget - goodRoutes[i].distance) * 1.0; // dn: per-hop budget in Microseconds
+      dn = dn/1000; // in Milliseconds
+    }
+    // ql_fast: fast lane queue length;  ql_slow: slow lane queue length; bf: buffer size
+    uint32_t interface = m_nextHops[goodRoutes[i].nextHop].interface;
+    const InterfaceState &state = GetInterfaceState (interface);
+    NS_ASSERT_MSG (state.slowLane != 0, "No fast/slow lanes on interface " << interface);
+    NS_ASSERT_MSG (state.bitRate != 0, "No DataRate on interface " << interface);
+    uint32_t ql_fast = GetLaneOccupancy (state, 0);
+    uint32_t ql_slow = GetLaneOccupancy (state, 1);
+    uint32_t bf_fast = state.laneSize[0];
+    uint32_t bf_slow = state.laneSize[1];
+    uint32_t packet_size = packetSize;
+    uint64_t linkrate = state.bitRate;
+    double bound_fast = ((bf_fast)*packet_size*8 / (0.5*linkrate))*1000; 
+    double bound_slow = ((bf_slow)*packet_size*8 / (0.3*linkrate))*1000; // in Milliseconds
+
+    if (LanesFull (state, i, ql_fast, ql_slow, trace, dest, budget))
+    {
+      return false;
+    }
+    
+    double edq_fast = ((ql_fast+1)*packet_size*8 / (0.5*linkrate))*1000;  // in Milliseconds
+    double edq_slow = ((ql_slow+1)*packet_size*8 / (0.3*linkrate))*1000;
+    double dnn = std::max(dn, 0.0); // in Milliseconds
+    double delayFlag;
+
+    if (dnn >= bound_slow)
+    {
+      delayFlag = bound_slow;
+    }
+    if (dnn >= bound_fast && dnn < bound_slow)
+    {
+      delayFlag = dnn;
+    }
+    if (dnn < bound_fast)
+    {
+      delayFlag = bound_fast;
+    }
+    weight[i*nLanes] = std::max(delayFlag - edq_fast, 0.0 ) * 0.1;
+    weight[i*nLanes+1] = std::max(delayFlag - edq_slow, 0.0 ) * 0.1;
+
+    if (ql_fast + 5 > bf_fast)
+    {
+      weight[i*nLanes] = bound_fast - edq_fast;
+    }
+    if (ql_slow + 5 > bf_slow)
+    {
+      weight[i*nLanes+1] = bound_slow - edq_slow;
+    }
+
+    
+    tempSum += (weight[i*nLanes] + weight[i*nLanes+1]);
+
+    // weight[i] = max((dn - E[dq]), 0) 
+    // dn = per-hop budget,  E[dq] = estimated next-hop delay
+    //  per-hop_budget = current_budget - next-hop cost, current_budget = delay_budget - (timestamp.now()-timestamp.begin())
+    //  estimated next-hop delay = Qh/(w*C),  Qh = next-hop queue length, w = fast/slow lane weight, C = link rate
+    // 
+    // total_weight = sum(weight)
+    // weight[i] = weight[i]/total_weight
+
+    if (trace)
+      {
+        DsrDecisionRecord record = DsrDecisionRecord ();
+        record.route = i;
+        record.qlFast = ql_fast;
+        record.qlSlow = ql_slow;
+        record.delay = delayFlag;
+        record.edqFast = edq_fast;
+        record.edqSlow = edq_slow;
+        record.boundFast = bound_fast;
+        record.boundSlow = bound_slow;
+        record.weightFast = weight[i*nLanes];
+        record.weightSlow = weight[i*nLanes+1];
+        TraceDecision (record, DsrDecisionRecord::GOOD_ROUTE, dest, budget);
+      }
+  }
+
+  uint32_t nWeights = m_weights.size ();
+  decision.lanes = nLanes;
+  decision.congested = (tempSum == 0);
+
+  // the heaviest lane, used by optimal forwarding
+  decision.best = 0;
+  for (uint32_t i = 0; i < nWeights; i ++)
+  {
+    if (weight[i] > weight[decision.best])
+    {
+      decision.best = i;
+    }
+  }
+
+  // cumulative weights normalised to 100, used by probabilistic forwarding
+  decision.cumulative.resize (nWeights);
+  for (uint32_t i = 0; i < nWeights; i ++)
+  {
+    decision.cumulative[i] = (weight[i]/tempSum) * 100;
+    if (i > 0)
+      {
+        decision.cumulative[i] += decision.cumulative[i-1];
+      }
+  }
+  return true;
+}
+
+Ptr<Ipv4Route>
+Ipv4DSRRouting::LookupDSRRoute (Ipv4Address dest, const DsrHeader &dsrHeader, uint32_t packetSize, uint32_t flowHash,
+                                uint8_t &priority, Ptr<NetDevice> oif)
+{
+  /**
+   * \author Pu Yang
+   * \todo to rewrite the lookup functions to find the best route from the routing table.
+   * the routing table in DSR routing is a SPF forest instead of a routing tree in global routing
+  */
+
+  NS_LOG_FUNCTION (this << dest << oif);
+  NS_LOG_LOGIC ("Looking for route for destination " << dest);
+  // all available routes that bring packets to their destination, by increasing distance
+  CandidateSet candidates = GetCandidates (dest, oif);
+  const HostRoute *allRoutes = candidates.routes;
+
+  if (candidates.nRoutes > 0 ) // if route(s) is found
     {
-      DsrHeader dsrHeader;
-      p->PeekHeader(dsrHeader);
       uint32_t budget_h = dsrHeader.GetBudget ();
       Time txTime = dsrHeader.GetTxTime ();
 
@@ -372,164 +762,117 @@ Ipv4DSRRouting::LookupDSRRoute (Ipv4Address dest, Ptr<Packet> p, Ptr<NetDevice>
       }
 
       uint32_t budget = budget_h + txTime.GetMicroSeconds () - Simulator::Now().GetMicroSeconds (); // in Microseconds
-      RouteVec_t fineRoutes;
-      RouteVec_t goodRoutes;
-      double cost = 0;
-      double avgCost = 0;
-      uint32_t numFineRoute = 0;
-
-      NS_LOG_INFO (" ALLROUTE SIZE: "<< allRoutes.size());
-      for (uint32_t i = 0; i < allRoutes.size (); i ++)
+      bool trace = dsrHeader.GetFlag () && DsrDecisionTrace::IsEnabled ();
+
+      NS_LOG_INFO (" ALLROUTE SIZE: "<< candidates.nRoutes);
+      // use FINEROUTE to filter out route beyond packet cost: the fine routes
+      // are the prefix of the candidates whose distance is below the budget
+      uint32_t numFineRoute = std::lower_bound (allRoutes, allRoutes + candidates.nRoutes,
+                                                budget, RouteDistanceLess) - allRoutes;
+      for (uint32_t i = numFineRoute; i < candidates.nRoutes; i ++)
         {
-          // std::cout << "All Distance: " << allRoutes.at(i)->GetDistance () << std::endl;
-          // use FINEROUTE to filter out route beyond packet cost
-          if (allRoutes.at(i)->GetDistance () < budget) // push route i to fineRoute if the current budget > route i's cost
-            {
-              fineRoutes.push_back(allRoutes.at (i)); 
-              NS_LOG_LOGIC ("FINEROUTE CURRENT NODE GATEWAY " << allRoutes.at (i)->GetGateway());
-              cost += allRoutes.at(i)->GetDistance ();
-              numFineRoute ++;
-            }
-          else
-            {
-              NS_LOG_INFO (" DROP ROUTE: " << allRoutes.at(i)->GetGateway () << " COST: "<< allRoutes.at(i)->GetDistance () );
-              if (dsrHeader.GetFlag () == true)
-              {
-                uint32_t q_fast = m_ipv4->GetNetDevice (allRoutes.at(i)->GetInterface ())->GetNode ()->GetObject<TrafficControlLayer> ()->GetRootQueueDiscOnDevice (m_ipv4->GetNetDevice(allRoutes.at (i)->GetInterface()))->GetInternalQueue (0)->GetCurrentSize ().GetValue ();
-                uint32_t q_slow = m_ipv4->GetNetDevice (allRoutes.at(i)->GetInterface ())->GetNode ()->GetObject<TrafficControlLayer> ()->GetRootQueueDiscOnDevice (m_ipv4->GetNetDevice(allRoutes.at (i)->GetInterface()))->GetInternalQueue (1)->GetCurrentSize ().GetValue ();
-                std::cout << "q_fast: "<< q_fast << " q_slow: " << q_slow << std::endl;
-                std::cout << "Budget: "<< budget << " DROP ROUTE: "<< i << std::endl;
-              }
-            }
+          const NextHop &nextHop = m_nextHops[allRoutes[i].nextHop];
+          NS_LOG_INFO (" DROP ROUTE: " << nextHop.gateway << " COST: "<< allRoutes[i].distance );
+          if (trace)
+          {
+            const InterfaceState &state = GetInterfaceState (nextHop.interface);
+            NS_ASSERT_MSG (state.slowLane != 0, "No fast/slow lanes on interface " << nextHop.interface);
+            DsrDecisionRecord record = DsrDecisionRecord ();
+            record.route = i;
+            record.qlFast = GetLaneOccupancy (state, 0);
+            record.qlSlow = GetLaneOccupancy (state, 1);
+            TraceDecision (record, DsrDecisionRecord::DROP_ROUTE, dest, budget);
+          }
         }
-      NS_LOG_INFO (" FINEROUTE SIZE: "<< fineRoutes.size());
+      NS_LOG_INFO (" FINEROUTE SIZE: "<< numFineRoute);
       
       if (numFineRoute == 0)
         {
           NS_LOG_ERROR ("NO ROUTE !!! " );
-          if (dsrHeader.GetFlag () == true)
+          if (trace)
             {
-              std::cout << "Budget: "<< budget<< " DROP PACKET: NO ROUTE" << std::endl;
+              DsrDecisionRecord record = DsrDecisionRecord ();
+              TraceDecision (record, DsrDecisionRecord::NO_ROUTE, dest, budget);
             }
           return 0;
         }
       
-      avgCost = cost / numFineRoute + 1500;
-
-      // use GOODROUTE to filter avoid loop when budget is sufficient
-      for (uint32_t i = 0; i < fineRoutes.size (); i ++)
-      {
-        double flag = fineRoutes.at(i)->GetDistance () * 1.0 ; // In MicroSeconds
-        // std::cout<< "avgCost: " << avgCost << "   " << "route Cost: " << flag << std::endl;
-        if (flag <= avgCost)                
+      uint32_t numGoodRoute = numFineRoute;
+      if (!m_loopFreeRoutes)
         {
-          goodRoutes.push_back(fineRoutes.at (i));  // BUG: Route not properly erased
-          NS_LOG_LOGIC ("GOODROUTE CURRENT NODE GATEWAY " << allRoutes.at (i)->GetGateway());
-        }
-        else
-        {
-          NS_LOG_INFO (" DROP ROUTE: " << fineRoutes.at(i)->GetGateway () << " COST: "<< fineRoutes.at(i)->GetDistance () );
-        }
-      }
-
-      uint32_t internalNqueue = m_ipv4->GetNetDevice (0)->GetNode ()->GetObject<TrafficControlLayer> ()-> GetRootQueueDiscOnDevice (m_ipv4->GetNetDevice(goodRoutes.at (0)->GetInterface()))->GetNInternalQueues();
-      uint32_t bf_fast = 12;
-      uint32_t bf_slow = 36;
-
-      double weight[goodRoutes.size ()* (internalNqueue - 1)];  // Exclude best-effort lane
-      double tempSum = 0;
-      for (uint32_t i = 0; i < goodRoutes.size (); i ++)
-      {
-        double dn = 0.0;
-        // weight[i] = 1.0 / (m_ipv4->GetNetDevice (allRoutes.at(i)->GetInterface ())->GetNode ()->GetObject<TrafficControlLayer> ()->GetRootQueueDiscOnDevice (m_ipv4->GetNetDevice(allRoutes.at (i)->GetInterface()))->GetCurrentSize ().GetValue () + 0.01);
-        if (budget < goodRoutes.at (i)->GetDistance())
-        {
-          dn = 0.0 ;
-        }
-        else
-        {
-          dn = (budget - goodRoutes.at (i)->GetDistance()) * 1.0; // dn: per-hop budget in Microseconds
-          dn = dn/1000; // in Milliseconds
-        }
-        // ql_fast: fast lane queue length;  ql_slow: slow lane queue length; bf: buffer size
-        uint32_t ql_fast = m_ipv4->GetNetDevice (goodRoutes.at(i)->GetInterface ())->GetNode ()->GetObject<TrafficControlLayer> ()->GetRootQueueDiscOnDevice (m_ipv4->GetNetDevice(goodRoutes.at (i)->GetInterface()))->GetInternalQueue (0)->GetCurrentSize ().GetValue ();
-        uint32_t ql_slow = m_ipv4->GetNetDevice (goodRoutes.at(i)->GetInterface ())->GetNode ()->GetObject<TrafficControlLayer> ()->GetRootQueueDiscOnDevice (m_ipv4->GetNetDevice(goodRoutes.at (i)->GetInterface()))->GetInternalQueue (1)->GetCurrentSize ().GetValue ();
-        uint32_t packet_size = p->GetSize ();
-        uint32_t linkrate;
-        Ptr<NetDevice> device = m_ipv4->GetNetDevice (goodRoutes.at (i)->GetInterface ());
-        DataRateValue dataRate;
-        device->GetAttribute ("DataRate", dataRate);
-        linkrate = dataRate.Get().GetBitRate ();
-        double bound_fast = ((bf_fast)*packet_size*8 / (0.5*linkrate))*1000; 
-        double bound_slow = ((bf_slow)*packet_size*8 / (0.3*linkrate))*1000; // in Milliseconds
-
-        if (ql_fast == bf_fast && ql_slow == bf_slow)
-        {
-          NS_LOG_ERROR ("All next-hops are congested!! Drop packet");
-          if (dsrHeader.GetFlag () == true)
-          {
-            std::cout << "DROP PACKETS: TIME OUT DUE TO CONGESTION" << std::endl;
-          }
-          return 0;
-        }
-        
-        double edq_fast = ((ql_fast+1)*packet_size*8 / (0.5*linkrate))*1000;  // in Milliseconds
-        double edq_slow = ((ql_slow+1)*packet_size*8 / (0.3*linkrate))*1000;
-        double dnn = std::max(dn, 0.0); // in Milliseconds
-        double delayFlag;
+          uint64_t costSum = 0;
+          for (uint32_t i = 0; i < numFineRoute; i ++)
+            {
+              costSum += allRoutes[i].distance;
+            }
+          double avgCost = (double)costSum / numFineRoute + 1500;
 
-        if (dnn >= bound_slow)
-        {
-          delayFlag = bound_slow;
-        }
-        if (dnn >= bound_fast && dnn < bound_slow)
-        {
-          delayFlag = dnn;
+          // use GOODROUTE to filter avoid loop when budget is sufficient: the good
+          // routes are the prefix of the fine routes not costlier than avgCost
+          numGoodRoute = std::upper_bound (allRoutes, allRoutes + numFineRoute,
+                                           avgCost, CostBelowRouteDistance) - allRoutes;
         }
-        if (dnn < bound_fast)
-        {
-          delayFlag = bound_fast;
-        }
-        weight[2*i] = std::max(delayFlag - edq_fast, 0.0 ) * 0.1;
-        weight[2*i+1] = std::max(delayFlag - edq_slow, 0.0 ) * 0.1;
+      const HostRoute *goodRoutes = allRoutes;
+      NS_LOG_INFO (" GOODROUTE SIZE: "<< numGoodRoute);
 
-        if (ql_fast > bf_fast - 5)
+      // lane weights of the good routes, possibly reused from an earlier packet
+      const LaneDecision *decision = 0;
+      DecisionKey key = DecisionKey ();
+      if (m_decisionCache && oif == 0)
         {
-          weight[2*i] = bound_fast - edq_fast;
+          key.dest = dest.Get ();
+          key.budgetBucket = budget / std::max<int64_t> (m_decisionBudgetQuantum.GetMicroSeconds (), 1);
+          key.packetSize = packetSize;
+          key.signature = 0;
+          uint32_t quantum = std::max<uint32_t> (m_decisionOccupancyQuantum, 1);
+          for (uint32_t i = 0; i < numGoodRoute; i ++)
+            {
+              uint32_t interface = m_nextHops[goodRoutes[i].nextHop].interface;
+              const InterfaceState &state = GetInterfaceState (interface);
+              NS_ASSERT_MSG (state.slowLane != 0, "No fast/slow lanes on interface " << interface);
+              uint32_t ql_fast = GetLaneOccupancy (state, 0);
+              uint32_t ql_slow = GetLaneOccupancy (state, 1);
+              if (LanesFull (state, i, ql_fast, ql_slow, trace, dest, budget))
+                {
+                  return 0;
+                }
+              key.signature = MixSignature (key.signature, m_nextHops[goodRoutes[i].nextHop].gateway.Get ());
+              key.signature = MixSignature (key.signature, interface);
+              key.signature = MixSignature (key.signature, state.epoch);
+              key.signature = MixSignature (key.signature, ql_fast / quantum);
+              key.signature = MixSignature (key.signature, ql_slow / quantum);
+            }
+          DecisionCache_t::const_iterator it = m_decisions.find (key);
+          if (it != m_decisions.end ())
+            {
+              NS_LOG_LOGIC ("Reusing lane decision for " << dest);
+              decision = &it->second;
+            }
         }
-        if (ql_slow > bf_slow - 5)
+      if (decision == 0)
         {
-          weight[2*i+1] = bound_slow - edq_slow;
+          if (!ComputeLaneDecision (dest, dsrHeader, budget, packetSize, goodRoutes, numGoodRoute, m_scratchDecision))
+            {
+              return 0;
+            }
+          decision = &m_scratchDecision;
+          if (m_decisionCache && oif == 0)
+            {
+              if (m_decisions.size () >= m_decisionCacheSize)
+                {
+                  m_decisions.clear ();
+                }
+              decision = &(m_decisions[key] = m_scratchDecision);
+            }
         }
-
-        
-        tempSum += (weight[2*i] + weight[2*i+1]);
-
-        // weight[i] = max((dn - E[dq]), 0) 
-        // dn = per-hop budget,  E[dq] = estimated next-hop delay
-        //  per-hop_budget = current_budget - next-hop cost, current_budget = delay_budget - (timestamp.now()-timestamp.begin())
-        //  estimated next-hop delay = Qh/(w*C),  Qh = next-hop queue length, w = fast/slow lane weight, C = link rate
-        // 
-        // total_weight = sum(weight)
-        // weight[i] = weight[i]/total_weight
-
-        if (dsrHeader.GetFlag () == true)
-          {
-            std::cout << "=======================================" << std::endl;
-            std::cout << "GoodRoute "<< i << " dn = " << delayFlag << std::endl; // Check the change of queue length
-            std::cout << "GoodRoute "<< i << " fql = " << ql_fast << ", sql = " << ql_slow << std::endl; // Check the change of queue length
-            std::cout << "GoodRoute "<< i << " edq_fast = " << edq_fast << ", edq_slow = " << edq_slow << std::endl; // Check the change of estimated delay
-            std::cout << "GoodRoute "<< i << " bound_fast = " << bound_fast << ", bound_slow = " << bound_slow << std::endl; // Check the change of estimated delay
-            std::cout << "GoodRoute "<< i << " Fast lane weight: " << weight[2*i] << " Slow lane: " << weight[2*i+1] << std::endl; // Check the change of weight
-          }
-      }
       
-      if (tempSum == 0)
+      if (decision->congested)
       {
         NS_LOG_ERROR ("All next-hops are congested!! Drop packet");
-        if (dsrHeader.GetFlag () == true)
+        if (trace)
         {
-          std::cout << "DROP PACKETS: TIME OUT" << std::endl;
+          DsrDecisionRecord record = DsrDecisionRecord ();
+          TraceDecision (record, DsrDecisionRecord::TIMEOUT, dest, budget);
         }
         return 0;
       }
@@ -541,66 +884,87 @@ Ipv4DSRRouting::LookupDSRRoute (Ipv4Address dest, Ptr<Packet> p, Ptr<NetDevice>
       if (dsrHeader.GetFlag () == true)
       {
         NS_LOG_LOGIC ("Select route by probability");
-        for (uint32_t i = 0; i < goodRoutes.size () * (internalNqueue - 1); i ++)
+        // ns3::RngSeedManager::SetSeed(2);
+        for (uint32_t i = 0; i < decision->cumulative.size (); i ++)
         {
-          weight[i] = (weight[i]/tempSum) * 100;
-        }      
-
-        for (uint32_t i = 0; i < goodRoutes.size () * (internalNqueue - 1) -1; i ++)
+          if (decision->cumulative[i] >= randInt)
+            {
+              selectRouteIndex = i / decision->lanes;
+              selectLaneIndex = i % decision->lanes;
+              break;
+            }
+        }
+        if (trace)
         {
-          weight[i+1] += weight[i];
+          DsrDecisionRecord record = DsrDecisionRecord ();
+          record.route = selectRouteIndex;
+          record.lane = selectLaneIndex;
+          TraceDecision (record, DsrDecisionRecord::SELECT, dest, budget);
         }
-     
-        // ns3::RngSeedManager::SetSeed(2);
-        for (uint32_t i = 0; i < goodRoutes.size () * (internalNqueue - 1); i ++)
+      }
+      else if (m_flowHashRouting)
+      {
+        NS_LOG_LOGIC ("Select route by flow hash");
+        // a flow stays on the route and lane it was pinned to while that lane
+        // is still a good one with some weight, so that its packets are not
+        // reordered when the weights move
+        bool pinned = false;
+        FlowPins_t::const_iterator pin = m_flowPins.find (flowHash);
+        if (pin != m_flowPins.end () && pin->second.lane < decision->lanes)
+        {
+          for (uint32_t i = 0; i < numGoodRoute; i ++)
+          {
+            if (goodRoutes[i].nextHop != pin->second.nextHop)
+              {
+                continue;
+              }
+            uint32_t lane = i * decision->lanes + pin->second.lane;
+            double weight = decision->cumulative[lane] - (lane == 0 ? 0 : decision->cumulative[lane - 1]);
+            if (weight > 0)
+              {
+                selectRouteIndex = i;
+                selectLaneIndex = pin->second.lane;
+                pinned = true;
+              }
+            break;
+          }
+        }
+        if (!pinned)
         {
-          if (weight[i] >= randInt)
+          // same draw as the flagged packets, but fixed per flow
+          double point = (flowHash + 1.0) / 4294967296.0 * 100;
+          for (uint32_t i = 0; i < decision->cumulative.size (); i ++)
+          {
+            if (decision->cumulative[i] >= point)
+              {
+                selectRouteIndex = i / decision->lanes;
+                selectLaneIndex = i % decision->lanes;
+                break;
+              }
+          }
+          if (m_flowPins.size () >= m_decisionCacheSize)
             {
-              selectRouteIndex = i / 2;
-              selectLaneIndex = i % 2;
-              break;
+              m_flowPins.clear ();
             }
+          FlowPin &newPin = m_flowPins[flowHash];
+          newPin.nextHop = goodRoutes[selectRouteIndex].nextHop;
+          newPin.lane = selectLaneIndex;
         }
-        std::cout << "******************************************" << std::endl;
-        // std::cout << "Random number: " << randInt << std::endl;
-        std::cout << "selectRouteIndex = " << selectRouteIndex << std::endl;
-        std::cout << "selectLaneIndex = " << selectLaneIndex << std::endl;
       }
       else
       // if (flagTag.GetFlagTag () == false)
       {
         NS_LOG_LOGIC ("Select optimal route with highest probability");
-        uint32_t flag = 0;
-        for (uint32_t i = 0; i < goodRoutes.size () * (internalNqueue - 1); i ++)
-        {
-          if (weight[i] > weight[flag])
-          {
-            flag = i;
-          }
-        }      
-        selectRouteIndex = flag / 2;
-        selectLaneIndex = flag % 2;
+        selectRouteIndex = decision->best / decision->lanes;
+        selectLaneIndex = decision->best % decision->lanes;
       }
 
       
-      Ipv4DSRRoutingTableEntry* route;
-      route = goodRoutes.at (selectRouteIndex);
-      uint8_t priority = (uint8_t)selectLaneIndex;
+      const HostRoute* route;
+      route = &goodRoutes[selectRouteIndex];
+      priority = (uint8_t)selectLaneIndex;
 
-      p->RemoveHeader (dsrHeader);
-      dsrHeader.SetPriority (priority);
-      p->AddHeader (dsrHeader);
-      
-      // create a Ipv4Route object from the selected routing table entry
-      rtentry = Create<Ipv4Route> ();
-      rtentry->SetDestination (route->GetDest ());
-      /// \todo handle multi-address case
-      rtentry->SetSource (m_ipv4->GetAddress (route->GetInterface (), 0).GetLocal ());
-      rtentry->SetGateway (route->GetGateway ());
-      uint32_t interfaceIdx = route->GetInterface ();
-      rtentry->SetOutputDevice (m_ipv4->GetNetDevice (interfaceIdx));
-
-      return rtentry;
+      return GetCachedRoute (route);
     }
   else 
     {
@@ -619,110 +983,104 @@ Ipv4DSRRouting::GetNRoutes (void) const
   return n;
 }
 
-Ipv4DSRRoutingTableEntry *
+Ipv4DSRRoutingTableEntry
 Ipv4DSRRouting::GetRoute (uint32_t index) const
 {
   NS_LOG_FUNCTION (this << index);
+  SortHostRoutes ();
   if (index < m_hostRoutes.size ())
     {
-      uint32_t tmp = 0;
-      for (HostRoutesCI i = m_hostRoutes.begin (); 
-           i != m_hostRoutes.end (); 
-           i++) 
-        {
-          if (tmp  == index)
-            {
-              return *i;
-            }
-          tmp++;
-        }
+      return MakeEntry (m_hostRoutes[index]);
     }
-  index -= m_hostRoutes.size ();
-  uint32_t tmp = 0;
-  if (index < m_networkRoutes.size ())
+  else if ((index -= m_hostRoutes.size ()) < m_networkRoutes.size ())
     {
-      for (NetworkRoutesCI j = m_networkRoutes.begin (); 
-           j != m_networkRoutes.end ();
-           j++)
-        {
-          if (tmp == index)
-            {
-              return *j;
-            }
-          tmp++;
-        }
+      return m_networkRoutes[index];
     }
   index -= m_networkRoutes.size ();
-  tmp = 0;
-  for (ASExternalRoutesCI k = m_ASexternalRoutes.begin (); 
-       k != m_ASexternalRoutes.end (); 
-       k++) 
-    {
-      if (tmp == index)
-        {
-          return *k;
-        }
-      tmp++;
-    }
-  NS_ASSERT (false);
-  // quiet compiler.
-  return 0;
+  NS_ASSERT (index < m_ASexternalRoutes.size ());
+  return m_ASexternalRoutes[index];
 }
+
 void 
 Ipv4DSRRouting::RemoveRoute (uint32_t index)
 {
   NS_LOG_FUNCTION (this << index);
+  SortHostRoutes ();
   if (index < m_hostRoutes.size ())
     {
-      uint32_t tmp = 0;
-      for (HostRoutesI i = m_hostRoutes.begin (); 
-           i != m_hostRoutes.end (); 
-           i++) 
-        {
-          if (tmp  == index)
-            {
-              NS_LOG_LOGIC ("Removing route " << index << "; size = " << m_hostRoutes.size ());
-              delete *i;
-              m_hostRoutes.erase (i);
-              NS_LOG_LOGIC ("Done removing host route " << index << "; host route remaining size = " << m_hostRoutes.size ());
-              return;
-            }
-          tmp++;
-        }
+      NS_LOG_LOGIC ("Removing route " << index << "; size = " << m_hostRoutes.size ());
+      m_hostRoutes.erase (m_hostRoutes.begin () + index);
+      NS_LOG_LOGIC ("Done removing host route " << index << "; host route remaining size = " << m_hostRoutes.size ());
     }
-  index -= m_hostRoutes.size ();
-  uint32_t tmp = 0;
-  for (NetworkRoutesI j = m_networkRoutes.begin (); 
-       j != m_networkRoutes.end (); 
-       j++) 
+  else if ((index -= m_hostRoutes.size ()) < m_networkRoutes.size ())
     {
-      if (tmp == index)
-        {
-          NS_LOG_LOGIC ("Removing route " << index << "; size = " << m_networkRoutes.size ());
-          delete *j;
-          m_networkRoutes.erase (j);
-          NS_LOG_LOGIC ("Done removing network route " << index << "; network route remaining size = " << m_networkRoutes.size ());
-          return;
-        }
-      tmp++;
+      NS_LOG_LOGIC ("Removing route " << index << "; size = " << m_networkRoutes.size ());
+      m_networkRoutes.erase (m_networkRoutes.begin () + index);
+      NS_LOG_LOGIC ("Done removing network route " << index << "; network route remaining size = " << m_networkRoutes.size ());
     }
-  index -= m_networkRoutes.size ();
-  tmp = 0;
-  for (ASExternalRoutesI k = m_ASexternalRoutes.begin (); 
-       k != m_ASexternalRoutes.end ();
-       k++)
+  else
+    {
+      index -= m_networkRoutes.size ();
+      NS_ASSERT (index < m_ASexternalRoutes.size ());
+      NS_LOG_LOGIC ("Removing route " << index << "; size = " << m_ASexternalRoutes.size ());
+      m_ASexternalRoutes.erase (m_ASexternalRoutes.begin () + index);
+      NS_LOG_LOGIC ("Done removing external route " << index << "; external route remaining size = " << m_ASexternalRoutes.size ());
+    }
+  RoutesChanged ();
+}
+
+void
+Ipv4DSRRouting::RemoveHostRoutes (uint32_t interface)
+{
+  NS_LOG_FUNCTION (this << interface);
+  // compact the remaining routes in place, keeping their order
+  HostRoutesI last = m_hostRoutes.begin ();
+  for (HostRoutesI i = m_hostRoutes.begin (); i != m_hostRoutes.end (); i++)
     {
-      if (tmp == index)
+      if (m_nextHops[i->nextHop].interface != interface)
         {
-          NS_LOG_LOGIC ("Removing route " << index << "; size = " << m_ASexternalRoutes.size ());
-          delete *k;
-          m_ASexternalRoutes.erase (k);
-          NS_LOG_LOGIC ("Done removing network route " << index << "; network route remaining size = " << m_networkRoutes.size ());
-          return;
+          *last++ = *i;
         }
-      tmp++;
     }
-  NS_ASSERT (false);
+  m_hostRoutes.erase (last, m_hostRoutes.end ());
+  RoutesChanged ();
+}
+
+void
+Ipv4DSRRouting::RemoveNetworkRoutes (void)
+{
+  NS_LOG_FUNCTION (this);
+  m_networkRoutes.clear ();
+  m_ASexternalRoutes.clear ();
+  RoutesChanged ();
+}
+
+void
+Ipv4DSRRouting::RemoveAllRoutes (void)
+{
+  NS_LOG_FUNCTION (this);
+  m_hostRoutes.clear ();
+  m_networkRoutes.clear ();
+  m_ASexternalRoutes.clear ();
+  m_nextHops.clear ();
+  m_nextHopIds.clear ();
+  m_flowPins.clear ();
+  RoutesChanged ();
+}
+
+bool
+Ipv4DSRRouting::IsIncrementalRecompute (void) const
+{
+  return m_respondToInterfaceEvents && m_incrementalRecompute;
+}
+
+void
+Ipv4DSRRouting::RoutesChanged (void)
+{
+  // the entries may have moved: drop everything that points to them
+  m_routeCache.clear ();
+  m_decisions.clear ();
+  m_hostRoutesDirty = true;
 }
 
 int64_t
@@ -737,24 +1095,26 @@ void
 Ipv4DSRRouting::DoDispose (void)
 {
   NS_LOG_FUNCTION (this);
-  for (HostRoutesI i = m_hostRoutes.begin (); 
-       i != m_hostRoutes.end (); 
-       i = m_hostRoutes.erase (i)) 
-    {
-      delete (*i);
-    }
-  for (NetworkRoutesI j = m_networkRoutes.begin (); 
-       j != m_networkRoutes.end (); 
-       j = m_networkRoutes.erase (j)) 
+  // release the storage, clear () keeps it
+  HostRoutes ().swap (m_hostRoutes);
+  NetworkRoutes ().swap (m_networkRoutes);
+  ASExternalRoutes ().swap (m_ASexternalRoutes);
+  std::vector<NextHop> ().swap (m_nextHops);
+  m_nextHopIds.clear ();
+  m_routeCache.clear ();
+  m_decisions.clear ();
+  m_flowPins.clear ();
+  m_scratchRoutes.clear ();
+  m_hostRoutesDirty = false;
+  for (uint32_t i = 0; i < m_interfaces.size (); i++)
     {
-      delete (*j);
-    }
-  for (ASExternalRoutesI l = m_ASexternalRoutes.begin (); 
-       l != m_ASexternalRoutes.end ();
-       l = m_ASexternalRoutes.erase (l))
-    {
-      delete (*l);
+      if (m_interfaces[i].laneSource != 0)
+        {
+          m_interfaces[i].laneSource->TraceDisconnectWithoutContext (
+            "LaneOccupancy", MakeBoundCallback (&Ipv4DSRRouting::LaneOccupancyChanged, this, i));
+        }
     }
+  m_interfaces.clear ();
 
   Ipv4RoutingProtocol::DoDispose ();
 }
@@ -860,7 +1220,13 @@ Ipv4DSRRouting::RouteOutput (Ptr<Packet> p, const Ipv4Header &header, Ptr<NetDev
       uint32_t budget = dsrHeader.GetBudget ();
       if (budget != 0)
       {
-        rtentry = LookupDSRRoute (header.GetDestination (), p, oif);
+        uint8_t priority;
+        uint32_t flowHash = FlowHash (header, p);
+        rtentry = LookupDSRRoute (header.GetDestination (), dsrHeader, p->GetSize (), flowHash, priority, oif);
+        if (rtentry)
+        {
+          SetDsrPriority (p, dsrHeader, priority);
+        }
       }
     }
     else
@@ -890,11 +1256,6 @@ Ipv4DSRRouting::RouteInput  (Ptr<const Packet> p, const Ipv4Header &header, Ptr<
                                 UnicastForwardCallback ucb, MulticastForwardCallback mcb,
                                 LocalDeliverCallback lcb, ErrorCallback ecb)
 { 
-  /**
-   * \author Pu Yang
-   * \brief make a copy of p, and process p_copy
-  */
-  Ptr <Packet> p_copy = p->Copy();
   NS_LOG_FUNCTION (this << p << header << header.GetSource () << header.GetDestination () << idev << &lcb << &ecb);
   // Check if input device supports IP
   NS_ASSERT (m_ipv4->GetInterfaceForDevice (idev) >= 0);
@@ -931,10 +1292,19 @@ Ipv4DSRRouting::RouteInput  (Ptr<const Packet> p, const Ipv4Header &header, Ptr<
   // Next, try to find a route
   NS_LOG_LOGIC ("Unicast destination- looking up global route");
   Ptr<Ipv4Route> rtentry; 
+  Ptr<const Packet> p_fwd = p;
   DsrHeader dsrHeader;
   if (p->PeekHeader (dsrHeader))
   {
-    rtentry = LookupDSRRoute (header.GetDestination (), p_copy); 
+    uint8_t priority;
+    rtentry = LookupDSRRoute (header.GetDestination (), dsrHeader, p->GetSize (), FlowHash (header, p), priority);
+    if (rtentry != 0 && priority != dsrHeader.GetPriority ())
+    {
+      // p is shared with the caller: copy it before changing the lane
+      Ptr<Packet> p_copy = p->Copy ();
+      SetDsrPriority (p_copy, dsrHeader, priority);
+      p_fwd = p_copy;
+    }
   }
   else
   {
@@ -950,10 +1320,9 @@ Ipv4DSRRouting::RouteInput  (Ptr<const Packet> p, const Ipv4Header &header, Ptr<
       // p_copy->RemovePacketTag (cost);
       // cost.SetCost (rtentry->GetDistance());
       // p_copy->AddPacketTag (cost);
-      const Ptr <Packet> p_c = p_copy->Copy();
       // std::cout << "RI: the input cost = " << rtentry->GetDistance() << "the next hop = " << rtentry->GetOutputDevice() << std::endl;
       NS_LOG_LOGIC ("Found unicast destination- calling unicast callback");
-      ucb (rtentry, p_c, header);
+      ucb (rtentry, p_fwd, header);
       return true; 
     }
   else
@@ -965,52 +1334,50 @@ Ipv4DSRRouting::RouteInput  (Ptr<const Packet> p, const Ipv4Header &header, Ptr<
     }
 }
 
+void
+Ipv4DSRRouting::RecomputeRoutes (void)
+{
+  NS_LOG_FUNCTION (this);
+  if (!m_respondToInterfaceEvents || Simulator::Now ().GetSeconds () <= 0)  // avoid startup events
+    {
+      return;
+    }
+  DSRRouteManager::ScheduleRoutesUpdate (m_ipv4->GetObject<Node> ()->GetId (),
+                                         m_recomputeHoldDown, m_incrementalRecompute);
+}
+
 void 
 Ipv4DSRRouting::NotifyInterfaceUp (uint32_t i)
 {
   NS_LOG_FUNCTION (this << i);
-  if (m_respondToInterfaceEvents && Simulator::Now ().GetSeconds () > 0)  // avoid startup events
-    {
-      DSRRouteManager::DeleteDSRRoutes ();
-      DSRRouteManager::BuildDSRRoutingDatabase ();
-      DSRRouteManager::InitializeRoutes ();
-    }
+  m_routeCache.clear ();
+  CacheNodeId ();
+  RefreshInterfaceState (i);
+  RecomputeRoutes ();
 }
 
 void 
 Ipv4DSRRouting::NotifyInterfaceDown (uint32_t i)
 {
   NS_LOG_FUNCTION (this << i);
-  if (m_respondToInterfaceEvents && Simulator::Now ().GetSeconds () > 0)  // avoid startup events
-    {
-      DSRRouteManager::DeleteDSRRoutes ();
-      DSRRouteManager::BuildDSRRoutingDatabase ();
-      DSRRouteManager::InitializeRoutes ();
-    }
+  m_routeCache.clear ();
+  RecomputeRoutes ();
 }
 
 void 
 Ipv4DSRRouting::NotifyAddAddress (uint32_t interface, Ipv4InterfaceAddress address)
 {
   NS_LOG_FUNCTION (this << interface << address);
-  if (m_respondToInterfaceEvents && Simulator::Now ().GetSeconds () > 0)  // avoid startup events
-    {
-      DSRRouteManager::DeleteDSRRoutes ();
-      DSRRouteManager::BuildDSRRoutingDatabase ();
-      DSRRouteManager::InitializeRoutes ();
-    }
+  m_routeCache.clear ();
+  RecomputeRoutes ();
 }
 
 void 
 Ipv4DSRRouting::NotifyRemoveAddress (uint32_t interface, Ipv4InterfaceAddress address)
 {
   NS_LOG_FUNCTION (this << interface << address);
-  if (m_respondToInterfaceEvents && Simulator::Now ().GetSeconds () > 0)  // avoid startup events
-    {
-      DSRRouteManager::DeleteDSRRoutes ();
-      DSRRouteManager::BuildDSRRoutingDatabase ();
-      DSRRouteManager::InitializeRoutes ();
-    }
+  m_routeCache.clear ();
+  RecomputeRoutes ();
 }
 
 void 
@@ -1019,6 +1386,180 @@ Ipv4DSRRouting::SetIpv4 (Ptr<Ipv4> ipv4)
   NS_LOG_FUNCTION (this << ipv4);
   NS_ASSERT (m_ipv4 == 0 && ipv4 != 0);
   m_ipv4 = ipv4;
+  CacheNodeId ();
+  m_interfaces.clear ();
+  for (uint32_t i = 0; i < m_ipv4->GetNInterfaces (); i++)
+    {
+      RefreshInterfaceState (i);
+    }
+}
+
+void
+Ipv4DSRRouting::CacheNodeId (void)
+{
+  NS_LOG_FUNCTION (this);
+  Ptr<Node> node = m_ipv4->GetObject<Node> ();
+  if (node != 0)
+    {
+      m_nodeId = node->GetId ();
+    }
+}
+
+void
+Ipv4DSRRouting::RefreshInterfaceState (uint32_t i)
+{
+  NS_LOG_FUNCTION (this << i);
+  NS_ASSERT (m_ipv4 != 0 && i < m_ipv4->GetNInterfaces ());
+  if (m_interfaces.size () < m_ipv4->GetNInterfaces ())
+    {
+      m_interfaces.resize (m_ipv4->GetNInterfaces ());
+    }
+  InterfaceState &state = m_interfaces[i];
+  state.epoch++;
+  state.device = m_ipv4->GetNetDevice (i);
+  state.rootQueueDisc = 0;
+  state.fastLane = 0;
+  state.slowLane = 0;
+  state.nInternalQueues = 0;
+  state.laneSize[0] = 0;
+  state.laneSize[1] = 0;
+  state.bitRate = 0;
+
+  DataRateValue dataRate;
+  if (state.device->GetAttributeFailSafe ("DataRate", dataRate))
+    {
+      state.bitRate = dataRate.Get ().GetBitRate ();
+    }
+  Ptr<TrafficControlLayer> tc = m_ipv4->GetObject<TrafficControlLayer> ();
+  if (tc != 0)
+    {
+      state.rootQueueDisc = tc->GetRootQueueDiscOnDevice (state.device);
+    }
+  if (state.rootQueueDisc != 0)
+    {
+      // internal queues only exist once the queue disc has been initialized
+      state.nInternalQueues = state.rootQueueDisc->GetNInternalQueues ();
+      if (state.nInternalQueues > 1)
+        {
+          state.fastLane = state.rootQueueDisc->GetInternalQueue (0);
+          state.slowLane = state.rootQueueDisc->GetInternalQueue (1);
+          // DsrVirtualQueueDisc holds fewer packets in a lane than its
+          // internal queues accept; other queue discs fill the queues,
+          // whose limit may be in bytes while occupancy is in packets
+          UintegerValue laneSize;
+          uint32_t mtu = state.device->GetMtu ();
+          state.laneSize[0] = state.rootQueueDisc->GetAttributeFailSafe ("FastLaneSize", laneSize)
+            ? laneSize.Get () : QueueSizeInPackets (state.fastLane, mtu);
+          state.laneSize[1] = state.rootQueueDisc->GetAttributeFailSafe ("SlowLaneSize", laneSize)
+            ? laneSize.Get () : QueueSizeInPackets (state.slowLane, mtu);
+        }
+    }
+  if (m_laneStatePush && state.fastLane != 0 && state.laneSource != state.rootQueueDisc)
+    {
+      Callback<void, uint32_t, uint32_t> sink = MakeBoundCallback (&Ipv4DSRRouting::LaneOccupancyChanged, this, i);
+      if (state.laneSource != 0)
+        {
+          state.laneSource->TraceDisconnectWithoutContext ("LaneOccupancy", sink);
+        }
+      state.laneSource = 0;
+      if (state.rootQueueDisc->TraceConnectWithoutContext ("LaneOccupancy", sink))
+        {
+          state.laneSource = state.rootQueueDisc;
+        }
+      else
+        {
+          NS_LOG_WARN ("Queue disc of interface " << i << " does not publish its lane occupancy");
+        }
+      state.laneOccupancy[0] = state.fastLane->GetNPackets ();
+      state.laneOccupancy[1] = state.slowLane->GetNPackets ();
+    }
+  NS_LOG_LOGIC ("Interface " << i << " rate " << state.bitRate << " bps, "
+                << state.nInternalQueues << " internal queues");
+}
+
+void
+Ipv4DSRRouting::SetDsrPriority (Ptr<Packet> p, DsrHeader &dsrHeader, uint8_t priority)
+{
+  NS_LOG_FUNCTION (this << p << (uint32_t)priority);
+  if (dsrHeader.GetPriority () == priority)
+    {
+      return;
+    }
+  // Packet has no API to write a byte in place, so the header is removed
+  // and added again.  A forwarded packet is a Copy () sharing its buffer
+  // with the received one, so AddHeader copies the whole buffer: only the
+  // packets whose lane changes pay for it.
+  p->RemoveHeader (dsrHeader);
+  dsrHeader.SetPriority (priority);
+  p->AddHeader (dsrHeader);
+}
+
+const Ipv4DSRRouting::InterfaceState &
+Ipv4DSRRouting::GetInterfaceState (uint32_t i)
+{
+  if (i >= m_interfaces.size () || m_interfaces[i].slowLane == 0)
+    {
+      RefreshInterfaceState (i);
+    }
+  return m_interfaces[i];
+}
+
+uint32_t
+Ipv4DSRRouting::GetLaneOccupancy (const InterfaceState &state, uint32_t lane) const
+{
+  if (state.laneSource != 0)
+    {
+      return state.laneOccupancy[lane];
+    }
+  return (lane == 0 ? state.fastLane : state.slowLane)->GetNPackets ();
+}
+
+bool
+Ipv4DSRRouting::LanesFull (const InterfaceState &state, uint32_t route, uint32_t qlFast, uint32_t qlSlow,
+                           bool trace, Ipv4Address dest, uint32_t budget)
+{
+  if (qlFast < state.laneSize[0] || qlSlow < state.laneSize[1])
+    {
+      return false;
+    }
+  NS_LOG_ERROR ("All next-hops are congested!! Drop packet");
+  if (trace)
+    {
+      DsrDecisionRecord record = DsrDecisionRecord ();
+      record.route = route;
+      record.qlFast = qlFast;
+      record.qlSlow = qlSlow;
+      TraceDecision (record, DsrDecisionRecord::CONGESTED, dest, budget);
+    }
+  return true;
+}
+
+void
+Ipv4DSRRouting::LaneOccupancyChanged (Ipv4DSRRouting *routing, uint32_t interface, uint32_t lane, uint32_t nPackets)
+{
+  if (lane > 1)
+    {
+      return; // best-effort lane
+    }
+  if (routing->m_laneStateDelay.IsZero ())
+    {
+      routing->SetLaneOccupancy (interface, lane, nPackets);
+    }
+  else
+    {
+      Simulator::Schedule (routing->m_laneStateDelay, &Ipv4DSRRouting::SetLaneOccupancy, routing,
+                           interface, lane, nPackets);
+    }
+}
+
+void
+Ipv4DSRRouting::SetLaneOccupancy (uint32_t interface, uint32_t lane, uint32_t nPackets)
+{
+  NS_LOG_FUNCTION (this << interface << lane << nPackets);
+  if (interface < m_interfaces.size ())
+    {
+      m_interfaces[interface].laneOccupancy[lane] = nPackets;
+    }
 }
 // static bool
 // Ipv4DSRRouting::CompareRouteCost(Ipv4DSRRoutingTableEntry* route1, Ipv4DSRRoutingTableEntry* route2)
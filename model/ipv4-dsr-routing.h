@@ -23,14 +23,18 @@
 #ifndef IPV4_DSR_ROUTING_H
 #define IPV4_DSR_ROUTING_H
 
-#include <list>
+#include <map>
+#include <unordered_map>
+#include <vector>
 #include <stdint.h>
 #include "ns3/ipv4-address.h"
 #include "ns3/ipv4-header.h"
 #include "ns3/ptr.h"
+#include "ns3/nstime.h"
 #include "ns3/ipv4.h"
 #include "ns3/ipv4-routing-protocol.h"
 #include "ns3/random-variable-stream.h"
+#include "ns3/queue-disc.h"
 #include "dsr-route-manager-impl.h"
 #include "ipv4-dsr-routing-table-entry.h"
 
@@ -44,6 +48,8 @@ class Ipv4Header;
 class Ipv4DSRRoutingTableEntry;
 class Ipv4MulticastRoutingTableEntry;
 class Node;
+class DsrHeader;
+struct DsrDecisionRecord;
 
 /**
  * \ingroup ipv4
@@ -211,13 +217,13 @@ public:
    *
    * \param i The index (into the routing table) of the route to retrieve.  If
    * the default route has been set, it will occupy index zero.
-   * \return If route is set, a pointer to that Ipv4RoutingTableEntry is returned, otherwise
-   * a zero pointer is returned.
+   * \return a copy of the route.  Host routes are stored packed, so there is
+   * no entry to point to.
    *
    * \see Ipv4RoutingTableEntry
    * \see Ipv4GlobalRouting::RemoveRoute
    */
-  Ipv4DSRRoutingTableEntry *GetRoute (uint32_t i) const;
+  Ipv4DSRRoutingTableEntry GetRoute (uint32_t i) const;
 
   /**
    * \brief Remove a route from the global unicast routing table.
@@ -237,6 +243,27 @@ public:
    */
   void RemoveRoute (uint32_t i);
 
+  /**
+   * \brief Remove the host routes going out of an interface.
+   * \param interface the outgoing interface
+   */
+  void RemoveHostRoutes (uint32_t interface);
+
+  /**
+   * \brief Remove all network and AS external routes.
+   */
+  void RemoveNetworkRoutes (void);
+
+  /**
+   * \brief Remove all routes.
+   */
+  void RemoveAllRoutes (void);
+
+  /**
+   * \return true if interface events only recompute the affected routes,
+   * see the RespondToInterfaceEvents and IncrementalRecompute attributes
+   */
+  bool IsIncrementalRecompute (void) const;
 
   /**
    * @brief Build the routing database by gathering Link State Advertisements
@@ -256,37 +283,271 @@ public:
 
   // static bool CompareRouteCost(Ipv4DSRRoutingTableEntry* route1, Ipv4DSRRoutingTableEntry* route2);
 
+  /**
+   * \brief Packed route to a host, 12 bytes.
+   *
+   * Host routes make up the SPF forest and outnumber the other routes by
+   * far.  They need no mask, and their gateway and outgoing interface are
+   * interned per node since a node only has a few neighbors.
+   */
+  struct HostRoute
+  {
+    uint32_t dest;     //!< destination address
+    uint32_t distance; //!< distance from the root of the SPF tree
+    uint16_t nextHop;  //!< index of the gateway and interface in m_nextHops
+    uint16_t loopFree; //!< 1 if the next hop is closer to dest than this node, see SortHostRoutes
+  };
+
 protected:
   void DoDispose (void);
 
 private:
+  friend class DsrRoutingSnapshot;
+
   /// Set to true if packets are randomly routed among ECMP; set to false for using only one route consistently
   bool m_randomEcmpRouting;
   /// Set to true if this interface should respond to interface events by globallly recomputing routes 
   bool m_respondToInterfaceEvents;
+  /// Set to true to only recompute the routes affected by an interface event
+  bool m_incrementalRecompute;
+  /// Delay between an interface event and the route recomputation; later events are coalesced into it
+  Time m_recomputeHoldDown;
+  /// Set to true to reuse lane decisions across packets of similar budget and lane occupancy
+  bool m_decisionCache;
+  /// Width of the remaining budget buckets of the decision cache
+  Time m_decisionBudgetQuantum;
+  /// Width of the lane occupancy buckets of the decision cache, in packets
+  uint32_t m_decisionOccupancyQuantum;
+  /// Maximum number of entries of the decision cache and of the flow pins
+  uint32_t m_decisionCacheSize;
+  /// Set to true to spread unflagged DSR packets over the good routes by a hash of their flow
+  bool m_flowHashRouting;
+  /// Set to true to only use the routes whose next hop is closer to the destination
+  bool m_loopFreeRoutes;
+  /// Set to true to read lane lengths from the table fed by the LaneOccupancy trace of the queue discs
+  bool m_laneStatePush;
+  /// Delay before a published lane length is seen by the routing decisions
+  Time m_laneStateDelay;
   /// A uniform random number generator for randomly routing packets among ECMP 
   Ptr<UniformRandomVariable> m_rand;
 
-  /// container of Ipv4RoutingTableEntry (routes to hosts)
-  typedef std::list<Ipv4DSRRoutingTableEntry *> HostRoutes;
-  /// const iterator of container of Ipv4RoutingTableEntry (routes to hosts)
-  typedef std::list<Ipv4DSRRoutingTableEntry *>::const_iterator HostRoutesCI;
-  /// iterator of container of Ipv4RoutingTableEntry (routes to hosts)
-  typedef std::list<Ipv4DSRRoutingTableEntry *>::iterator HostRoutesI;
+  /// Gateway and outgoing interface shared by host routes
+  struct NextHop
+  {
+    Ipv4Address gateway; //!< gateway, zero for a direct route
+    uint32_t interface;  //!< outgoing interface
+  };
+
+  /// container of packed routes to hosts
+  typedef std::vector<HostRoute> HostRoutes;
+  /// const iterator of container of packed routes to hosts
+  typedef std::vector<HostRoute>::const_iterator HostRoutesCI;
+  /// iterator of container of packed routes to hosts
+  typedef std::vector<HostRoute>::iterator HostRoutesI;
 
   /// container of Ipv4RoutingTableEntry (routes to networks)
-  typedef std::list<Ipv4DSRRoutingTableEntry *> NetworkRoutes;
+  typedef std::vector<Ipv4DSRRoutingTableEntry> NetworkRoutes;
   /// const iterator of container of Ipv4RoutingTableEntry (routes to networks)
-  typedef std::list<Ipv4DSRRoutingTableEntry *>::const_iterator NetworkRoutesCI;
+  typedef std::vector<Ipv4DSRRoutingTableEntry>::const_iterator NetworkRoutesCI;
   /// iterator of container of Ipv4RoutingTableEntry (routes to networks)
-  typedef std::list<Ipv4DSRRoutingTableEntry *>::iterator NetworkRoutesI;
+  typedef std::vector<Ipv4DSRRoutingTableEntry>::iterator NetworkRoutesI;
 
   /// container of Ipv4RoutingTableEntry (routes to external AS)
-  typedef std::list<Ipv4DSRRoutingTableEntry *> ASExternalRoutes;
+  typedef std::vector<Ipv4DSRRoutingTableEntry> ASExternalRoutes;
   /// const iterator of container of Ipv4RoutingTableEntry (routes to external AS)
-  typedef std::list<Ipv4DSRRoutingTableEntry *>::const_iterator ASExternalRoutesCI;
+  typedef std::vector<Ipv4DSRRoutingTableEntry>::const_iterator ASExternalRoutesCI;
   /// iterator of container of Ipv4RoutingTableEntry (routes to external AS)
-  typedef std::list<Ipv4DSRRoutingTableEntry *>::iterator ASExternalRoutesI;
+  typedef std::vector<Ipv4DSRRoutingTableEntry>::iterator ASExternalRoutesI;
+
+  /// Ipv4Route handed out for each destination and next hop
+  typedef std::map<std::pair<uint32_t, uint16_t>, Ptr<Ipv4Route> > RouteCache_t;
+
+  /**
+   * \brief Routes to one destination, sorted by increasing distance.
+   *
+   * The routes within a budget are found with a binary search.
+   */
+  struct CandidateSet
+  {
+    const HostRoute *routes; //!< routes, by increasing distance
+    uint32_t nRoutes;        //!< number of routes
+  };
+
+  /**
+   * \brief Lane weights of the good routes towards a destination.
+   *
+   * Lane i is lane i % lanes of good route i / lanes.
+   */
+  struct LaneDecision
+  {
+    std::vector<double> cumulative; //!< cumulative lane weights, normalised to 100
+    uint32_t lanes;                 //!< weighted lanes per route, best-effort lane excluded
+    uint32_t best;                  //!< index of the heaviest lane
+    bool congested;                 //!< all lane weights sum to zero
+  };
+
+  /**
+   * \brief Key of the decision cache.
+   *
+   * The signature folds in the interface, the epoch and the quantised lane
+   * occupancy of every good route, so that a re-resolved interface or a
+   * different occupancy never hits a stale entry.
+   */
+  struct DecisionKey
+  {
+    uint32_t dest;         //!< destination address
+    uint32_t budgetBucket; //!< quantised remaining budget
+    uint32_t packetSize;   //!< packet size, in bytes
+    uint64_t signature;    //!< next-hop lane occupancy signature
+    /**
+     * \brief Equality operator.
+     * \param other the key to compare with
+     * \return true if the keys are equal
+     */
+    bool operator== (const DecisionKey &other) const;
+  };
+
+  /// Hash function of DecisionKey
+  struct DecisionKeyHash
+  {
+    /**
+     * \brief Hash a key.
+     * \param key the key
+     * \return the hash value
+     */
+    std::size_t operator() (const DecisionKey &key) const;
+  };
+
+  /// lane decisions reused across packets
+  typedef std::unordered_map<DecisionKey, LaneDecision, DecisionKeyHash> DecisionCache_t;
+
+  /// Route and lane a flow was last sent on, see FlowHashRouting
+  struct FlowPin
+  {
+    uint16_t nextHop; //!< index of the gateway and interface in m_nextHops
+    uint8_t lane;     //!< lane on that next hop
+  };
+
+  /// pinned route and lane of each flow, by flow hash
+  typedef std::unordered_map<uint32_t, FlowPin> FlowPins_t;
+
+  /**
+   * \brief Compute the lane weights of the good routes.
+   *
+   * \param dest destination address
+   * \param dsrHeader the DSR header carried by the packet
+   * \param budget the remaining budget of the packet, in microseconds
+   * \param packetSize size of the packet, in bytes
+   * \param goodRoutes the good routes
+   * \param numGoodRoute the number of good routes
+   * \param decision filled with the lane weights
+   * \return false if the packet must be dropped because both lanes of a
+   * next hop are full
+   */
+  bool ComputeLaneDecision (Ipv4Address dest, const DsrHeader &dsrHeader, uint32_t budget, uint32_t packetSize,
+                            const HostRoute *goodRoutes, uint32_t numGoodRoute,
+                            LaneDecision &decision);
+
+  /**
+   * \brief Complete a decision record and append it to the decision trace.
+   * \param record the record, with its type-specific fields set
+   * \param type the record type, see DsrDecisionRecord::Type
+   * \param dest destination address
+   * \param budget remaining budget of the packet, in microseconds
+   */
+  void TraceDecision (DsrDecisionRecord &record, uint8_t type, Ipv4Address dest, uint32_t budget);
+
+  /**
+   * \brief Hash the flow of a packet, salted with the node id so that
+   * successive hops do not split flows alike.
+   *
+   * The flows between the same hosts are told apart by the DsrFlowTag
+   * their source sets, which carries their ports: the transport header
+   * does not exist yet when the source routes the packet.  Packets without
+   * the tag are hashed by addresses and protocol only.
+   *
+   * \param header the IPv4 header of the packet
+   * \param p the packet, without its IPv4 header
+   * \return the flow hash, or 0 if FlowHashRouting is disabled
+   */
+  uint32_t FlowHash (const Ipv4Header &header, Ptr<const Packet> p) const;
+
+  /**
+   * \brief Add a packed host route.
+   * \param dest destination address
+   * \param gateway gateway, zero for a direct route
+   * \param interface outgoing interface
+   * \param distance distance from the root of the SPF tree
+   */
+  void AddHostRoute (Ipv4Address dest, Ipv4Address gateway, uint32_t interface, uint32_t distance);
+
+  /**
+   * \brief Get the index of a next hop in m_nextHops, adding it if needed.
+   * \param gateway gateway, zero for a direct route
+   * \param interface outgoing interface
+   * \return the index of the next hop
+   */
+  uint16_t InternNextHop (Ipv4Address gateway, uint32_t interface);
+
+  /**
+   * \brief Sort the host routes by destination then distance, if they
+   * changed since they were last sorted.
+   *
+   * Equal routes keep the order they were added in.  Called from the const
+   * accessors too, so that route indices do not depend on lookups.
+   *
+   * With LoopFreeRoutes, the routes whose next hop is strictly closer to
+   * the destination than this node are then flagged and moved ahead of the
+   * other routes to the same destination.  Forwarding only along such
+   * routes decreases the distance to the destination at every hop, so a
+   * packet can not loop.  The distance of the next hop is the distance of
+   * the route minus the metric of the link to it, which is the distance of
+   * the route to the gateway itself.
+   */
+  void SortHostRoutes (void) const;
+
+  /**
+   * \brief Convert a packed host route to a routing table entry.
+   * \param route the host route
+   * \return the routing table entry
+   */
+  Ipv4DSRRoutingTableEntry MakeEntry (const HostRoute &route) const;
+
+  /**
+   * \brief Get the candidate routes to a destination.
+   *
+   * Host routes are a range of the sorted host routes, restricted to the
+   * loop-free ones with LoopFreeRoutes.  Other lookups scan the table into
+   * scratch space.
+   *
+   * \param dest destination address
+   * \param oif output interface if any (put 0 otherwise)
+   * \return the candidate routes, valid until the next lookup
+   */
+  CandidateSet GetCandidates (Ipv4Address dest, Ptr<NetDevice> oif);
+
+  /**
+   * \brief Collect the routing table entries leading to a destination.
+   *
+   * Host routes are preferred over network routes, which are preferred
+   * over the first matching external route.
+   *
+   * \param dest destination address
+   * \param oif output interface if any (put 0 otherwise)
+   * \param routes cleared and filled with the matching entries, packed
+   */
+  void CollectRoutes (Ipv4Address dest, Ptr<NetDevice> oif, std::vector<HostRoute> &routes);
+
+  /**
+   * \brief Get the Ipv4Route for a route.
+   *
+   * The Ipv4Route of a host route is created on first use and reused
+   * afterwards, until the routes or the interface addresses change.
+   *
+   * \param route the route
+   * \return the Ipv4Route for the route
+   */
+  Ptr<Ipv4Route> GetCachedRoute (const HostRoute *route);
 
   /**
    * \brief Lookup in the forwarding table for destination.
@@ -295,13 +556,159 @@ private:
    * \return Ipv4Route to route the packet to reach dest address
    */
   Ptr<Ipv4Route> LookupDSRRoute (Ipv4Address dest, Ptr<NetDevice> oif = 0);
-  Ptr<Ipv4Route> LookupDSRRoute (Ipv4Address dest, Ptr<Packet> p, Ptr<NetDevice> oif = 0);
+  /**
+   * \brief Budget-aware lookup in the forwarding table for destination.
+   *
+   * The packet itself is not modified; the caller applies the selected lane
+   * with SetDsrPriority so that a shared packet is only copied when needed.
+   *
+   * \param dest destination address
+   * \param dsrHeader the DSR header carried by the packet
+   * \param packetSize size of the packet, in bytes
+   * \param flowHash hash of the flow of the packet, see FlowHash
+   * \param priority set to the selected lane on success
+   * \param oif output interface if any (put 0 otherwise)
+   * \return Ipv4Route to route the packet to reach dest address, or 0
+   */
+  Ptr<Ipv4Route> LookupDSRRoute (Ipv4Address dest, const DsrHeader &dsrHeader, uint32_t packetSize, uint32_t flowHash,
+                                 uint8_t &priority, Ptr<NetDevice> oif = 0);
+
+  /**
+   * \brief Invalidate the lookup state after a change of the routing table.
+   *
+   * The routes are stored by value, so any change may move them.  Next hops
+   * stay interned until all the routes are removed.
+   */
+  void RoutesChanged (void);
+
+  /**
+   * \brief Schedule a route recomputation after an interface event, if
+   * enabled.
+   */
+  void RecomputeRoutes (void);
 
-  HostRoutes m_hostRoutes;             //!< Routes to hosts
+  /**
+   * \brief Write the selected lane into the DSR header of a packet.
+   *
+   * Nothing is done when the header already carries that lane.  Otherwise
+   * the header is written again, which copies the buffer of p when it is
+   * shared, as it is for a forwarded packet.
+   *
+   * \param p the packet, starting with dsrHeader
+   * \param dsrHeader the DSR header peeked from p
+   * \param priority the selected lane
+   */
+  void SetDsrPriority (Ptr<Packet> p, DsrHeader &dsrHeader, uint8_t priority);
+
+  /**
+   * \brief Per-interface state read by the budget-aware lookup.
+   *
+   * The lane queues and the link rate are resolved once, instead of going
+   * through the node, the traffic control layer and the attribute system
+   * for every candidate route of every packet.
+   */
+  struct InterfaceState
+  {
+    Ptr<NetDevice> device;                  //!< the NetDevice of the interface
+    Ptr<QueueDisc> rootQueueDisc;           //!< root queue disc installed on the device
+    Ptr<QueueDisc::InternalQueue> fastLane; //!< internal queue 0 of the root queue disc
+    Ptr<QueueDisc::InternalQueue> slowLane; //!< internal queue 1 of the root queue disc
+    uint32_t nInternalQueues;               //!< number of internal queues of the root queue disc
+    uint32_t laneSize[2];                   //!< buffer sizes of the fast and slow lanes, in packets
+    uint64_t bitRate;                       //!< DataRate of the device, in bit/s
+    uint32_t epoch;                         //!< incremented each time the state is resolved
+    Ptr<QueueDisc> laneSource;              //!< queue disc whose LaneOccupancy trace is connected
+    uint32_t laneOccupancy[2];              //!< last published fast and slow lane lengths, in packets
+  };
+
+  /**
+   * \brief Resolve and store the state of an interface.
+   * \param i the interface index
+   */
+  void RefreshInterfaceState (uint32_t i);
+
+  /**
+   * \brief Store the id of the node, so that the per-packet paths do not
+   * look up the Node aggregated to the Ipv4 object.
+   */
+  void CacheNodeId (void);
+
+  /**
+   * \brief Get the state of an interface, resolving it first if needed.
+   *
+   * Queue discs are usually installed (and create their internal queues)
+   * after the routing protocol has been bound to the node, so an entry whose
+   * lanes are not known yet is resolved again on access.
+   *
+   * \param i the interface index
+   * \return the interface state
+   */
+  const InterfaceState & GetInterfaceState (uint32_t i);
+
+  /**
+   * \brief Get the length of a lane of an interface, as pushed by its queue
+   * disc when LaneStatePush is set, read from the queue otherwise.
+   * \param state the interface state
+   * \param lane 0 for the fast lane, 1 for the slow lane
+   * \return the lane length, in packets
+   */
+  uint32_t GetLaneOccupancy (const InterfaceState &state, uint32_t lane) const;
+
+  /**
+   * \brief Check whether both lanes of a next hop are full, and trace the
+   * drop of a flagged packet if so.
+   * \param state the interface state of the next hop
+   * \param route the index of the candidate route
+   * \param qlFast the fast lane length, in packets
+   * \param qlSlow the slow lane length, in packets
+   * \param trace true to trace the decision
+   * \param dest the destination address
+   * \param budget the remaining budget, in microseconds
+   * \return true if both lanes are full
+   */
+  bool LanesFull (const InterfaceState &state, uint32_t route, uint32_t qlFast, uint32_t qlSlow,
+                  bool trace, Ipv4Address dest, uint32_t budget);
+
+  /**
+   * \brief Receive a lane length change from the queue disc of an interface.
+   *
+   * Static, so that the interface index can be bound to the trace sink.
+   *
+   * \param routing the routing protocol owning the interface
+   * \param interface the interface index
+   * \param lane the internal queue index
+   * \param nPackets the lane length, in packets
+   */
+  static void LaneOccupancyChanged (Ipv4DSRRouting *routing, uint32_t interface, uint32_t lane, uint32_t nPackets);
+
+  /**
+   * \brief Store a lane length in the lane occupancy table.
+   * \param interface the interface index
+   * \param lane the internal queue index
+   * \param nPackets the lane length, in packets
+   */
+  void SetLaneOccupancy (uint32_t interface, uint32_t lane, uint32_t nPackets);
+
+  mutable HostRoutes m_hostRoutes;     //!< Routes to hosts, see SortHostRoutes
   NetworkRoutes m_networkRoutes;       //!< Routes to networks
   ASExternalRoutes m_ASexternalRoutes; //!< External routes imported
 
   Ptr<Ipv4> m_ipv4; //!< associated IPv4 instance
+  uint32_t m_nodeId; //!< id of the node of m_ipv4, see CacheNodeId
+  std::vector<InterfaceState> m_interfaces; //!< state of each interface, by interface index
+  RouteCache_t m_routeCache;                //!< Ipv4Route of each destination and next hop
+
+  std::vector<NextHop> m_nextHops;          //!< next hops of the host routes
+  std::map<std::pair<uint32_t, uint32_t>, uint16_t> m_nextHopIds; //!< index in m_nextHops of each gateway and interface
+  mutable bool m_hostRoutesDirty;           //!< host routes changed since they were sorted
+  DecisionCache_t m_decisions;              //!< lane decisions, when m_decisionCache is set
+  FlowPins_t m_flowPins;                    //!< route and lane of each flow, when m_flowHashRouting is set
+
+  // Scratch space of LookupDSRRoute, kept across calls so that the
+  // forwarding path does not allocate once it has warmed up.
+  std::vector<HostRoute> m_scratchRoutes; //!< candidates of lookups not served by m_hostRoutes
+  std::vector<double> m_weights;    //!< fast/slow lane weight of each good route
+  LaneDecision m_scratchDecision;   //!< lane decision of the current packet
 
   // DSRRouteManagerNSDB* m_nsdb;
 };
@@ -0,0 +1,165 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+// Flow hash routing test
+//
+// Network topology
+//
+//          n1
+//         /  \
+//    n0 --    -- n3
+//         \  /
+//          n2
+//
+// - all links are point-to-point links of the same metric, so n0 has two
+//   equal cost routes to n3
+// - eight unflagged UDP flows of DsrApplication go from n0 to n3, each from
+//   its own socket
+// - with FlowHashRouting, the flows must spread over both routes, and each
+//   flow must keep to one of them
+
+#include <iostream>
+#include <map>
+#include <set>
+
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+#include "ns3/internet-module.h"
+#include "ns3/point-to-point-module.h"
+#include "ns3/traffic-control-module.h"
+#include "ns3/dsr-routing-module.h"
+
+using namespace ns3;
+
+NS_LOG_COMPONENT_DEFINE ("DsrFlowHashTest");
+
+static std::map<uint32_t, std::set<uint32_t> > g_routes; //!< devices of n0 each flow was sent on, by flow id
+
+/**
+ * \brief Record the device of n0 a packet is sent on.
+ * \param device the device index
+ * \param p the packet
+ */
+static void
+MacTx (uint32_t device, Ptr<const Packet> p)
+{
+  DsrFlowTag tag;
+  if (p->PeekPacketTag (tag))
+    {
+      g_routes[tag.GetFlowId ()].insert (device);
+    }
+}
+
+int
+main (int argc, char *argv[])
+{
+  uint32_t nFlows = 8;
+  CommandLine cmd (__FILE__);
+  cmd.AddValue ("Flows", "Number of flows from n0 to n3", nFlows);
+  cmd.Parse (argc, argv);
+
+  Config::SetDefault ("ns3::dsr-routing::Ipv4DSRRouting::FlowHashRouting", BooleanValue (true));
+
+  // ------------------ build topology ---------------------------
+  NodeContainer nodes;
+  nodes.Create (4);
+
+  Ipv4DSRRoutingHelper dsr;
+  Ipv4ListRoutingHelper list;
+  list.Add (dsr, 10);
+  InternetStackHelper internet;
+  internet.SetRoutingHelper (list);
+  internet.Install (nodes);
+
+  PointToPointHelper p2p;
+  p2p.SetDeviceAttribute ("DataRate", DataRateValue (DataRate ("10Mbps")));
+  p2p.SetChannelAttribute ("Delay", TimeValue (MicroSeconds (1000)));
+  NetDeviceContainer d0d1 = p2p.Install (nodes.Get (0), nodes.Get (1));
+  NetDeviceContainer d0d2 = p2p.Install (nodes.Get (0), nodes.Get (2));
+  NetDeviceContainer d1d3 = p2p.Install (nodes.Get (1), nodes.Get (3));
+  NetDeviceContainer d2d3 = p2p.Install (nodes.Get (2), nodes.Get (3));
+
+  TrafficControlHelper tch;
+  tch.SetRootQueueDisc ("ns3::DsrVirtualQueueDisc", "MaxSize", StringValue ("1000p"));
+  tch.Install (d0d1);
+  tch.Install (d0d2);
+  tch.Install (d1d3);
+  tch.Install (d2d3);
+
+  uint16_t metric = 1000;
+  Ipv4AddressHelper ipv4;
+  ipv4.SetBase ("10.1.1.0", "255.255.255.0");
+  Ipv4InterfaceContainer i0i1 = ipv4.Assign (d0d1);
+  ipv4.SetBase ("10.1.2.0", "255.255.255.0");
+  Ipv4InterfaceContainer i0i2 = ipv4.Assign (d0d2);
+  ipv4.SetBase ("10.1.3.0", "255.255.255.0");
+  Ipv4InterfaceContainer i1i3 = ipv4.Assign (d1d3);
+  ipv4.SetBase ("10.1.4.0", "255.255.255.0");
+  Ipv4InterfaceContainer i2i3 = ipv4.Assign (d2d3);
+  Ipv4InterfaceContainer links[4] = { i0i1, i0i2, i1i3, i2i3 };
+  for (uint32_t i = 0; i < 4; i++)
+    {
+      links[i].SetMetric (0, metric);
+      links[i].SetMetric (1, metric);
+    }
+
+  Ipv4DSRRoutingHelper::PopulateRoutingTables ();
+
+  // ------------------ flows ---------------------------
+  uint16_t sinkPort = 8080;
+  DsrSinkHelper dsrSinkHelper ("ns3::UdpSocketFactory", InetSocketAddress (Ipv4Address::GetAny (), sinkPort));
+  ApplicationContainer sinkApps = dsrSinkHelper.Install (nodes.Get (3));
+  sinkApps.Start (Seconds (0.));
+  sinkApps.Stop (Seconds (3.));
+
+  Address sinkAddress (InetSocketAddress (i1i3.GetAddress (1), sinkPort));
+  uint32_t budget = 100;
+  for (uint32_t i = 0; i < nFlows; i++)
+    {
+      Ptr<Socket> socket = Socket::CreateSocket (nodes.Get (0), UdpSocketFactory::GetTypeId ());
+      Ptr<DsrApplication> app = CreateObject<DsrApplication> ();
+      app->Setup (socket, sinkAddress, 200, 50, DataRate ("100kbps"), budget, false);
+      nodes.Get (0)->AddApplication (app);
+      app->SetStartTime (Seconds (1.));
+      app->SetStopTime (Seconds (2.));
+    }
+
+  d0d1.Get (0)->TraceConnectWithoutContext ("MacTx", MakeBoundCallback (&MacTx, 1));
+  d0d2.Get (0)->TraceConnectWithoutContext ("MacTx", MakeBoundCallback (&MacTx, 2));
+
+  Simulator::Stop (Seconds (3));
+  Simulator::Run ();
+  Simulator::Destroy ();
+
+  // ------------------ check ---------------------------
+  bool ok = g_routes.size () == nFlows;
+  std::set<uint32_t> used;
+  for (std::map<uint32_t, std::set<uint32_t> >::const_iterator f = g_routes.begin (); f != g_routes.end (); f++)
+    {
+      std::cout << "flow " << (f->first >> 16) << " -> " << (f->first & 0xffff) << ": via";
+      for (std::set<uint32_t>::const_iterator d = f->second.begin (); d != f->second.end (); d++)
+        {
+          std::cout << " n" << *d;
+          used.insert (*d);
+        }
+      std::cout << std::endl;
+      ok = ok && f->second.size () == 1;
+    }
+  ok = ok && used.size () == 2;
+  std::cout << g_routes.size () << " flows over " << used.size () << " routes: "
+            << (ok ? "spread, each flow on one route" : "FAILED") << std::endl;
+  return ok ? 0 : 1;
+}
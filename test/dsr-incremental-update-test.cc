@@ -0,0 +1,214 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+// Incremental route recomputation test
+//
+// Network topology
+//
+//    n0 --m-- n1 --m-- n2
+//    |m       |h       |m
+//    n3 --h-- n4 --h-- n5
+//    |m       |x       |m
+//    n6 --m-- n7 --m-- n8
+//
+//  h - metric 6000, m - metric 6500, x - metric 30000
+//
+// - all links are point-to-point links
+// - the n4 -- n7 link, which no shortest path uses, goes down at 1 s and
+//   up again at 2 s; the n1 -- n4 link, on many shortest paths, goes down
+//   at 3 s and up again at 4 s
+// - after each event the routes recomputed incrementally by UpdateRoutes
+//   are compared with those of a full recomputation
+
+#include <algorithm>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+#include "ns3/internet-module.h"
+#include "ns3/point-to-point-module.h"
+#include "ns3/ipv4-dsr-routing-helper.h"
+#include "ns3/ipv4-dsr-routing.h"
+#include "ns3/dsr-router-interface.h"
+#include "ns3/dsr-route-manager.h"
+
+using namespace ns3;
+
+NS_LOG_COMPONENT_DEFINE ("DsrIncrementalUpdateTest");
+
+static uint32_t g_failures = 0; //!< comparisons which found different tables
+
+/**
+ * \brief Describe the routing tables of all the nodes.
+ * \return one line per route, sorted, since UpdateRoutes may install the
+ * routes in another order than a full recomputation
+ */
+static std::vector<std::string>
+DumpRoutes (void)
+{
+  std::vector<std::string> routes;
+  for (uint32_t i = 0; i < NodeList::GetNNodes (); i++)
+    {
+      Ptr<DSRRouter> router = NodeList::GetNode (i)->GetObject<DSRRouter> ();
+      if (router == 0)
+        {
+          continue;
+        }
+      Ptr<Ipv4DSRRouting> routing = router->GetRoutingProtocol ();
+      for (uint32_t j = 0; j < routing->GetNRoutes (); j++)
+        {
+          Ipv4DSRRoutingTableEntry route = routing->GetRoute (j);
+          std::ostringstream os;
+          os << "node " << i << ": " << route << ", distance=" << route.GetDistance ();
+          routes.push_back (os.str ());
+        }
+    }
+  std::sort (routes.begin (), routes.end ());
+  return routes;
+}
+
+/**
+ * \brief Compare the current routes with those of a full recomputation.
+ * \param event the event the routes were updated for
+ */
+static void
+CheckRoutes (std::string event)
+{
+  std::vector<std::string> incremental = DumpRoutes ();
+  DSRRouteManager::DeleteDSRRoutes ();
+  DSRRouteManager::BuildDSRRoutingDatabase ();
+  DSRRouteManager::InitializeRoutes ();
+  std::vector<std::string> full = DumpRoutes ();
+  if (incremental == full)
+    {
+      std::cout << event << ": " << full.size () << " routes, same as a full recomputation" << std::endl;
+      return;
+    }
+  g_failures++;
+  std::cout << event << ": routes differ from a full recomputation" << std::endl;
+  std::vector<std::string> diff;
+  std::set_difference (incremental.begin (), incremental.end (), full.begin (), full.end (),
+                       std::back_inserter (diff));
+  for (uint32_t i = 0; i < diff.size (); i++)
+    {
+      std::cout << "  only incremental: " << diff[i] << std::endl;
+    }
+  diff.clear ();
+  std::set_difference (full.begin (), full.end (), incremental.begin (), incremental.end (),
+                       std::back_inserter (diff));
+  for (uint32_t i = 0; i < diff.size (); i++)
+    {
+      std::cout << "  only full: " << diff[i] << std::endl;
+    }
+}
+
+/**
+ * \brief Bring both ends of a point-to-point link down or up.
+ * \param link the interfaces of the link
+ * \param up true to bring the link up
+ */
+static void
+SetLink (Ipv4InterfaceContainer link, bool up)
+{
+  for (uint32_t i = 0; i < link.GetN (); i++)
+    {
+      std::pair<Ptr<Ipv4>, uint32_t> end = link.Get (i);
+      if (up)
+        {
+          end.first->SetUp (end.second);
+        }
+      else
+        {
+          end.first->SetDown (end.second);
+        }
+    }
+}
+
+int
+main (int argc, char *argv[])
+{
+  CommandLine cmd (__FILE__);
+  cmd.Parse (argc, argv);
+
+  Config::SetDefault ("ns3::dsr-routing::Ipv4DSRRouting::RespondToInterfaceEvents", BooleanValue (true));
+  Config::SetDefault ("ns3::dsr-routing::Ipv4DSRRouting::IncrementalRecompute", BooleanValue (true));
+
+  // ------------------ build topology ---------------------------
+  NodeContainer nodes;
+  nodes.Create (9);
+
+  Ipv4DSRRoutingHelper dsr;
+  Ipv4ListRoutingHelper list;
+  list.Add (dsr, 10);
+  InternetStackHelper internet;
+  internet.SetRoutingHelper (list);
+  internet.Install (nodes);
+
+  PointToPointHelper p2p;
+  p2p.SetDeviceAttribute ("DataRate", DataRateValue (DataRate ("10Mbps")));
+  p2p.SetChannelAttribute ("Delay", TimeValue (MicroSeconds (5000)));
+
+  uint16_t hMetric = 6000;
+  uint16_t mMetric = 6500;
+  uint16_t xMetric = 30000;
+  const uint32_t links[12][3] =
+  {
+    { 0, 1, mMetric }, { 1, 2, mMetric }, { 3, 4, hMetric }, { 4, 5, hMetric },
+    { 6, 7, mMetric }, { 7, 8, mMetric }, { 0, 3, mMetric }, { 3, 6, mMetric },
+    { 1, 4, hMetric }, { 4, 7, xMetric }, { 2, 5, mMetric }, { 5, 8, mMetric }
+  };
+
+  Ipv4AddressHelper ipv4;
+  ipv4.SetBase ("10.1.1.0", "255.255.255.0");
+  std::vector<Ipv4InterfaceContainer> interfaces;
+  for (uint32_t i = 0; i < 12; i++)
+    {
+      NetDeviceContainer devices = p2p.Install (nodes.Get (links[i][0]), nodes.Get (links[i][1]));
+      Ipv4InterfaceContainer link = ipv4.Assign (devices);
+      link.SetMetric (0, links[i][2]);
+      link.SetMetric (1, links[i][2]);
+      interfaces.push_back (link);
+      ipv4.NewNetwork ();
+    }
+
+  // ---------------- Create routingTable ---------------------
+  Ipv4DSRRoutingHelper::PopulateRoutingTables ();
+
+  // n4 -- n7, off the shortest paths
+  Simulator::Schedule (Seconds (1), &SetLink, interfaces[9], false);
+  Simulator::Schedule (Seconds (1.5), &CheckRoutes, "n4 -- n7 down");
+  Simulator::Schedule (Seconds (2), &SetLink, interfaces[9], true);
+  Simulator::Schedule (Seconds (2.5), &CheckRoutes, "n4 -- n7 up");
+  // n1 -- n4, on shortest paths
+  Simulator::Schedule (Seconds (3), &SetLink, interfaces[8], false);
+  Simulator::Schedule (Seconds (3.5), &CheckRoutes, "n1 -- n4 down");
+  Simulator::Schedule (Seconds (4), &SetLink, interfaces[8], true);
+  Simulator::Schedule (Seconds (4.5), &CheckRoutes, "n1 -- n4 up");
+
+  Simulator::Stop (Seconds (5));
+  Simulator::Run ();
+  Simulator::Destroy ();
+
+  if (g_failures != 0)
+    {
+      std::cout << g_failures << " updates differ from a full recomputation" << std::endl;
+      return 1;
+    }
+  return 0;
+}
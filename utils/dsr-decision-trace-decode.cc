@@ -0,0 +1,90 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+
+// Print a DSR decision trace, written by Ipv4DSRRoutingHelper::EnableDecisionTrace,
+// as text.
+//
+// Usage: dsr-decision-trace-decode <trace file>
+
+#include <fstream>
+#include <iostream>
+#include "ns3/ipv4-address.h"
+#include "ns3/dsr-decision-trace.h"
+
+using namespace ns3;
+
+static void
+PrintRecord (const DsrDecisionRecord &r)
+{
+  std::cout << r.time * 1e-9 << "s node " << r.node << " dest " << Ipv4Address (r.dest)
+            << " budget " << r.budget << "us: ";
+  switch (r.type)
+    {
+    case DsrDecisionRecord::DROP_ROUTE:
+      std::cout << "DROP ROUTE " << r.route
+                << " q_fast = " << r.qlFast << " q_slow = " << r.qlSlow;
+      break;
+    case DsrDecisionRecord::NO_ROUTE:
+      std::cout << "DROP PACKET: NO ROUTE";
+      break;
+    case DsrDecisionRecord::CONGESTED:
+      std::cout << "DROP PACKET: TIME OUT DUE TO CONGESTION on route " << r.route
+                << " fql = " << r.qlFast << " sql = " << r.qlSlow;
+      break;
+    case DsrDecisionRecord::TIMEOUT:
+      std::cout << "DROP PACKET: TIME OUT";
+      break;
+    case DsrDecisionRecord::GOOD_ROUTE:
+      std::cout << "GoodRoute " << r.route
+                << " dn = " << r.delay
+                << " fql = " << r.qlFast << " sql = " << r.qlSlow
+                << " edq_fast = " << r.edqFast << " edq_slow = " << r.edqSlow
+                << " bound_fast = " << r.boundFast << " bound_slow = " << r.boundSlow
+                << " fast lane weight = " << r.weightFast << " slow lane weight = " << r.weightSlow;
+      break;
+    case DsrDecisionRecord::SELECT:
+      std::cout << "selectRouteIndex = " << r.route
+                << " selectLaneIndex = " << (uint32_t)r.lane;
+      break;
+    default:
+      std::cout << "unknown record type " << (uint32_t)r.type;
+      break;
+    }
+  std::cout << std::endl;
+}
+
+int
+main (int argc, char *argv[])
+{
+  if (argc != 2)
+    {
+      std::cerr << "Usage: " << argv[0] << " <trace file>" << std::endl;
+      return 1;
+    }
+  std::ifstream file (argv[1], std::ios::in | std::ios::binary);
+  if (!file.is_open ())
+    {
+      std::cerr << "Can not open " << argv[1] << std::endl;
+      return 1;
+    }
+
+  uint32_t fileHeader[3];
+  if (!file.read ((char *)fileHeader, sizeof (fileHeader))
+      || fileHeader[0] != DSR_DECISION_TRACE_MAGIC)
+    {
+      std::cerr << argv[1] << " is not a DSR decision trace" << std::endl;
+      return 1;
+    }
+  if (fileHeader[1] != DSR_DECISION_TRACE_VERSION || fileHeader[2] != sizeof (DsrDecisionRecord))
+    {
+      std::cerr << argv[1] << ": unsupported trace version " << fileHeader[1]
+                << " (record size " << fileHeader[2] << ")" << std::endl;
+      return 1;
+    }
+
+  DsrDecisionRecord record;
+  while (file.read ((char *)&record, sizeof (record)))
+    {
+      PrintRecord (record);
+    }
+  return 0;
+}